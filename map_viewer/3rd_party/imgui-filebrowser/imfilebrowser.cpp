@@ -26,6 +26,8 @@
 #include <imgui.h>
 
 #include <algorithm>
+#include <chrono>
+#include <thread>
 
 
 ImGui::FileBrowser::FileBrowser(ImGuiFileBrowserFlags flags)
@@ -69,6 +71,10 @@ ImGui::FileBrowser &ImGui::FileBrowser::operator=(const FileBrowser &copyFrom)
     selectedFilename_ = copyFrom.selectedFilename_;
 
     fileRecords_ = copyFrom.fileRecords_;
+    listingCache_ = copyFrom.listingCache_;
+    listing_ = copyFrom.listing_;
+    numListedRecords_ = copyFrom.numListedRecords_;
+    listingFinished_ = copyFrom.listingFinished_;
 
     *inputNameBuf_ = *copyFrom.inputNameBuf_;
 
@@ -144,6 +150,8 @@ void ImGui::FileBrowser::Display()
     isOpened_ = true;
     ScopeGuard endPopup([] { EndPopup(); });
 
+    PollListing();
+
     // display elements in pwd
 
 #ifdef _WIN32
@@ -212,7 +220,7 @@ void ImGui::FileBrowser::Display()
     SameLine();
 
     if(SmallButton("*"))
-        SetPwd(pwd_);
+        Refresh();
 
     if(newDirNameBuf_)
     {
@@ -232,7 +240,7 @@ void ImGui::FileBrowser::Display()
             {
                 ScopeGuard closeNewDirPopup([] { CloseCurrentPopup(); });
                 if(create_directory(pwd_ / newDirNameBuf_->data()))
-                    SetPwd(pwd_);
+                    Refresh();
                 else
                     statusStr_ = "failed to create " + std::string(newDirNameBuf_->data());
             }
@@ -341,6 +349,11 @@ void ImGui::FileBrowser::Display()
         SameLine();
         Text("%s", statusStr_.c_str());
     }
+    else if(!listingFinished_ && !(flags_ & ImGuiFileBrowserFlags_NoStatusBar))
+    {
+        SameLine();
+        Text("listing... (%d entries)", int(fileRecords_.size()) - 1);
+    }
 
     if (!typeFilters_.empty())
     {
@@ -396,39 +409,133 @@ void ImGui::FileBrowser::SetTypeFilters(const std::vector<const char*> &typeFilt
 
 void ImGui::FileBrowser::SetPwdUncatched(const std::filesystem::path &pwd)
 {
+    pwd_ = absolute(pwd);
+    selectedFilename_ = std::string();
+    (*inputNameBuf_)[0] = '\0';
+
+    auto &cached = listingCache_[pwd_];
+    if(!cached)
+    {
+        cached = std::make_shared<DirectoryListing>();
+
+        // detached, since joining would block on unresponsive file systems.
+        // the thread only touches the listing, which it keeps alive itself
+        std::thread(ListDirectory, pwd_, cached).detach();
+    }
+
+    listing_ = cached;
+    numListedRecords_ = 0;
+    listingFinished_ = false;
     fileRecords_ = { FileRecord{ true, "..", "[D] ..", "" } };
 
-    for(auto &p : std::filesystem::directory_iterator(pwd))
+    PollListing();
+}
+
+void ImGui::FileBrowser::Refresh()
+{
+    listingCache_.erase(pwd_);
+    SetPwd(pwd_);
+}
+
+void ImGui::FileBrowser::ListDirectory(std::filesystem::path dir, std::shared_ptr<DirectoryListing> listing)
+{
+    constexpr auto PUBLISH_INTERVAL = std::chrono::milliseconds(50);
+
+    std::vector<FileRecord> records;
+    size_t numPublished = 0;
+    auto nextPublishTime = std::chrono::steady_clock::now() + PUBLISH_INTERVAL;
+    std::string error;
+
+    try
     {
-        FileRecord rcd;
+        for(auto &p : std::filesystem::directory_iterator(dir))
+        {
+            FileRecord rcd;
 
-        if(p.is_regular_file())
-            rcd.isDir = false;
-        else if(p.is_directory())
-            rcd.isDir = true;
-        else
-            continue;
+            if(p.is_regular_file())
+                rcd.isDir = false;
+            else if(p.is_directory())
+                rcd.isDir = true;
+            else
+                continue;
 
-        rcd.name = p.path().filename().u8string();
-        if(rcd.name.empty())
-            continue;
+            rcd.name = p.path().filename().u8string();
+            if(rcd.name.empty())
+                continue;
+
+            rcd.extension = p.path().filename().extension().u8string();
+            std::transform(rcd.extension.begin(), rcd.extension.end(), rcd.extension.begin(), [](const char c) { return char(std::tolower(c)); });
 
-        rcd.extension = p.path().filename().extension().u8string();
-        std::transform(rcd.extension.begin(), rcd.extension.end(), rcd.extension.begin(), [](const char c) { return char(std::tolower(c)); });
+            rcd.showName = (rcd.isDir ? "[D] " : "[F] ") + p.path().filename().u8string();
+            records.push_back(std::move(rcd));
 
-        rcd.showName = (rcd.isDir ? "[D] " : "[F] ") + p.path().filename().u8string();
-        fileRecords_.push_back(rcd);
+            if(std::chrono::steady_clock::now() >= nextPublishTime)
+            {
+                std::lock_guard<std::mutex> lock(listing->mutex);
+                listing->records.insert(listing->records.end(), records.begin() + numPublished, records.end());
+                numPublished = records.size();
+                nextPublishTime = std::chrono::steady_clock::now() + PUBLISH_INTERVAL;
+            }
+        }
+    }
+    catch(const std::exception &err)
+    {
+        error = err.what();
+    }
+    catch(...)
+    {
+        error = "unknown";
     }
 
-    std::sort(fileRecords_.begin(), fileRecords_.end(),
+    std::sort(records.begin(), records.end(),
         [](const FileRecord &L, const FileRecord &R)
     {
         return (L.isDir ^ R.isDir) ? L.isDir : (L.name < R.name);
     });
 
-    pwd_ = absolute(pwd);
-    selectedFilename_ = std::string();
-    (*inputNameBuf_)[0] = '\0';
+    std::lock_guard<std::mutex> lock(listing->mutex);
+    listing->records = std::move(records);
+    listing->error = std::move(error);
+    listing->finished = true;
+}
+
+void ImGui::FileBrowser::PollListing()
+{
+    if(!listing_ || listingFinished_)
+        return;
+
+    std::string error;
+
+    {
+        std::lock_guard<std::mutex> lock(listing_->mutex);
+
+        if(!listing_->finished)
+        {
+            fileRecords_.insert(fileRecords_.end(), listing_->records.begin() + numListedRecords_, listing_->records.end());
+            numListedRecords_ = listing_->records.size();
+            return;
+        }
+
+        // the complete list is sorted, so it replaces the partial one
+        fileRecords_.resize(1);
+        fileRecords_.insert(fileRecords_.end(), listing_->records.begin(), listing_->records.end());
+        listingFinished_ = true;
+        error = listing_->error;
+    }
+
+    if(error.empty())
+        return;
+
+    statusStr_ = "last error: " + error;
+    listingCache_.erase(pwd_);
+
+    // same as when SetPwd fails: fall back to the working directory, unless
+    // that is the one which failed. done outside of the lock, since this
+    // replaces listing_
+    std::error_code ec;
+    const auto fallback = std::filesystem::current_path(ec);
+    if(!ec && fallback != pwd_)
+        SetPwd(fallback);
 }
 
 #ifdef _WIN32
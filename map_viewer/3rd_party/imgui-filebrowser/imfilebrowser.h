@@ -27,7 +27,9 @@
 #include <cstring>
 #include <filesystem>
 #include <functional>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -106,6 +108,9 @@ namespace ImGui
 
         void SetPwdUncatched(const std::filesystem::path &pwd);
 
+        // drop the cached listing of pwd and list it again
+        void Refresh();
+
 #ifdef _WIN32
         static std::uint32_t GetDrivesBitMask();
 #endif
@@ -139,6 +144,26 @@ namespace ImGui
         };
         std::vector<FileRecord> fileRecords_;
 
+        // directories are enumerated and sorted on a background thread, so
+        // that slow file systems don't stall the UI. entries are published
+        // in batches while listing is in progress, and picked up by Display().
+        // listings are cached per directory, revisiting one is instant
+        struct DirectoryListing
+        {
+            std::mutex mutex;
+            std::vector<FileRecord> records;
+            std::string error;
+            bool finished = false;
+        };
+
+        static void ListDirectory(std::filesystem::path dir, std::shared_ptr<DirectoryListing> listing);
+        void PollListing();
+
+        std::map<std::filesystem::path, std::shared_ptr<DirectoryListing>> listingCache_;
+        std::shared_ptr<DirectoryListing> listing_;
+        size_t numListedRecords_ = 0;
+        bool listingFinished_ = false;
+
         // IMPROVE: truncate when selectedFilename_.length() > inputNameBuf_.size() - 1
         static constexpr size_t INPUT_NAME_BUF_SIZE = 512;
         std::unique_ptr<std::array<char, INPUT_NAME_BUF_SIZE>> inputNameBuf_;
@@ -0,0 +1,459 @@
+/* Copyright (C) 2024, Nikolai Wuttke. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ambient_occlusion.hpp"
+
+#include "bake_cache.hpp"
+#include "worker_pool.hpp"
+
+RIGEL_DISABLE_WARNINGS
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+RIGEL_RESTORE_WARNINGS
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+
+namespace saucer
+{
+
+namespace
+{
+
+// Bump this whenever the parameters or the algorithm change, to invalidate
+// previously cached results
+constexpr auto AO_BAKE_VERSION = std::uint64_t(2);
+
+// Per-vertex AO is interpolated over whole faces, so a few well-spread
+// rays are enough
+constexpr auto NUM_SAMPLES = 16;
+
+// In world units, i.e. grid cells. Larger values darken more of the level
+// but make the bake slower.
+constexpr auto MAX_OCCLUDER_DISTANCE = 1.0f;
+
+// Offsets ray origins from the surface to avoid self-intersection
+constexpr auto RAY_EPSILON = 0.002f;
+
+constexpr auto CELL_SIZE = 1.0f;
+constexpr auto BOUNDARY_EPSILON = 0.0001f;
+
+constexpr auto QUERIES_PER_BATCH = std::size_t(256);
+
+
+struct Triangle
+{
+  std::array<glm::vec3, 3> mVertices;
+};
+
+
+/** A triangle prepared for testing rays starting at a fixed origin
+ *
+ * All rays of a query share their origin, so most of the intersection test
+ * can be done once per triangle instead of once per ray. With the origin
+ * at zero, a ray passes through the triangle if it is on the same side of
+ * the three planes spanned by the origin and each of the triangle's edges.
+ */
+struct Occluder
+{
+  Occluder(const Triangle& triangle, const glm::vec3& origin)
+  {
+    const auto a = triangle.mVertices[0] - origin;
+    const auto b = triangle.mVertices[1] - origin;
+    const auto c = triangle.mVertices[2] - origin;
+
+    mEdgeNormals = {glm::cross(a, b), glm::cross(b, c), glm::cross(c, a)};
+    mNormal = glm::cross(b - a, c - a);
+    mPlaneDistance = glm::dot(a, mNormal);
+  }
+
+  /** Two-sided test, direction must be normalized */
+  bool intersects(const glm::vec3& direction, const float maxDistance) const
+  {
+    const auto s0 = glm::dot(direction, mEdgeNormals[0]);
+    const auto s1 = glm::dot(direction, mEdgeNormals[1]);
+    const auto s2 = glm::dot(direction, mEdgeNormals[2]);
+
+    if (
+      !(s0 >= 0.0f && s1 >= 0.0f && s2 >= 0.0f) &&
+      !(s0 <= 0.0f && s1 <= 0.0f && s2 <= 0.0f))
+    {
+      return false;
+    }
+
+    // The distance along the ray is mPlaneDistance / cosine. The triangle
+    // is only hit in front of the origin if both have the same sign.
+    const auto cosine = glm::dot(direction, mNormal);
+    return mPlaneDistance * cosine > 0.0f &&
+      std::abs(mPlaneDistance) <= maxDistance * std::abs(cosine);
+  }
+
+  std::array<glm::vec3, 3> mEdgeNormals;
+  glm::vec3 mNormal;
+  float mPlaneDistance;
+};
+
+
+/** Uniform grid of triangle lists, for finding the occluders near a point
+ *
+ * Cells are stored in a compact form: mCellStarts[i] to mCellStarts[i + 1]
+ * is the range of mTriangleIndices belonging to cell i. Triangles are
+ * entered into every cell their bounding box overlaps.
+ *
+ * Since occlusion rays are short, all rays of a query share the same small
+ * set of potential occluders. These are gathered once per query, and culled
+ * further than the grid alone could, see findOccluders().
+ */
+class OcclusionGrid
+{
+public:
+  explicit OcclusionGrid(rigel::base::ArrayView<glm::vec3> triangles);
+
+  /** Collects triangles which rays into the hemisphere around the normal
+   * could hit within maxDistance
+   *
+   * Triangles completely behind the hemisphere's base plane, or whose
+   * bounding box is farther away than maxDistance, are left out.
+   */
+  void findOccluders(
+    const glm::vec3& origin,
+    const glm::vec3& normal,
+    float maxDistance,
+    std::vector<Occluder>& occluders) const;
+
+private:
+  glm::ivec3 cellFor(const glm::vec3& point) const
+  {
+    return glm::clamp(
+      glm::ivec3(glm::floor((point - mMin) / CELL_SIZE)),
+      glm::ivec3(0),
+      mSize - 1);
+  }
+
+  int cellIndex(const glm::ivec3& cell) const
+  {
+    return cell.x + cell.y * mSize.x + cell.z * mSize.x * mSize.y;
+  }
+
+  std::vector<Triangle> mTriangles;
+  std::vector<uint32_t> mCellStarts;
+  std::vector<uint32_t> mTriangleIndices;
+  glm::vec3 mMin;
+  glm::ivec3 mSize;
+};
+
+
+OcclusionGrid::OcclusionGrid(rigel::base::ArrayView<glm::vec3> positions)
+{
+  const auto numTriangles = positions.size() / 3;
+
+  auto min = glm::vec3(std::numeric_limits<float>::max());
+  auto max = glm::vec3(std::numeric_limits<float>::lowest());
+
+  for (const auto& position : positions)
+  {
+    min = glm::min(min, position);
+    max = glm::max(max, position);
+  }
+
+  if (positions.empty())
+  {
+    min = max = glm::vec3(0.0f);
+  }
+
+  // Rays start slightly off the surface, so we need some margin
+  mMin = min - CELL_SIZE;
+  mSize = glm::ivec3(glm::ceil((max + CELL_SIZE - mMin) / CELL_SIZE));
+  mSize = glm::max(mSize, glm::ivec3(1));
+
+  mTriangles.reserve(numTriangles);
+
+  for (auto i = 0u; i < numTriangles; ++i)
+  {
+    mTriangles.push_back(
+      {{positions[i * 3], positions[i * 3 + 1], positions[i * 3 + 2]}});
+  }
+
+  auto forEachOverlappedCell = [&](const uint32_t triangle, auto&& func) {
+    const auto& v0 = positions[triangle * 3];
+    const auto& v1 = positions[triangle * 3 + 1];
+    const auto& v2 = positions[triangle * 3 + 2];
+
+    // Geometry is mostly aligned to the grid. Without the epsilon, every
+    // triangle ending on a cell boundary would also be entered into the
+    // neighboring cell.
+    const auto first = cellFor(glm::min(v0, glm::min(v1, v2)));
+    const auto last = glm::max(
+      first, cellFor(glm::max(v0, glm::max(v1, v2)) - BOUNDARY_EPSILON));
+
+    for (auto z = first.z; z <= last.z; ++z)
+    {
+      for (auto y = first.y; y <= last.y; ++y)
+      {
+        for (auto x = first.x; x <= last.x; ++x)
+        {
+          func(cellIndex({x, y, z}));
+        }
+      }
+    }
+  };
+
+
+  // Counting sort: Determine each cell's size first, then fill in the
+  // triangle indices
+  const auto numCells = size_t(mSize.x) * mSize.y * mSize.z;
+  mCellStarts.assign(numCells + 1, 0);
+
+  for (auto i = 0u; i < numTriangles; ++i)
+  {
+    forEachOverlappedCell(i, [&](const int cell) { ++mCellStarts[cell + 1]; });
+  }
+
+  for (auto i = size_t(1); i < mCellStarts.size(); ++i)
+  {
+    mCellStarts[i] += mCellStarts[i - 1];
+  }
+
+  mTriangleIndices.resize(mCellStarts.back());
+  auto fillPositions =
+    std::vector<uint32_t>(mCellStarts.begin(), mCellStarts.end() - 1);
+
+  for (auto i = 0u; i < numTriangles; ++i)
+  {
+    forEachOverlappedCell(i, [&](const int cell) {
+      mTriangleIndices[fillPositions[cell]++] = i;
+    });
+  }
+}
+
+
+void OcclusionGrid::findOccluders(
+  const glm::vec3& origin,
+  const glm::vec3& normal,
+  const float maxDistance,
+  std::vector<Occluder>& occluders) const
+{
+  const auto first = cellFor(origin - maxDistance);
+  const auto last = cellFor(origin + maxDistance);
+
+  // Triangles spanning multiple cells are found once per cell
+  thread_local std::vector<uint32_t> candidates;
+  candidates.clear();
+
+  for (auto z = first.z; z <= last.z; ++z)
+  {
+    for (auto y = first.y; y <= last.y; ++y)
+    {
+      for (auto x = first.x; x <= last.x; ++x)
+      {
+        const auto index = cellIndex({x, y, z});
+        candidates.insert(
+          candidates.end(),
+          mTriangleIndices.begin() + mCellStarts[index],
+          mTriangleIndices.begin() + mCellStarts[index + 1]);
+      }
+    }
+  }
+
+  std::sort(candidates.begin(), candidates.end());
+  candidates.erase(
+    std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+  occluders.clear();
+
+  for (const auto index : candidates)
+  {
+    const auto& [v0, v1, v2] = mTriangles[index].mVertices;
+
+    // Every point a ray into the hemisphere reaches lies in front of the
+    // base plane
+    if (
+      glm::dot(v0 - origin, normal) <= 0.0f &&
+      glm::dot(v1 - origin, normal) <= 0.0f &&
+      glm::dot(v2 - origin, normal) <= 0.0f)
+    {
+      continue;
+    }
+
+    const auto boxMin = glm::min(v0, glm::min(v1, v2));
+    const auto boxMax = glm::max(v0, glm::max(v1, v2));
+    const auto toBox =
+      glm::max(boxMin - origin, glm::max(origin - boxMax, glm::vec3(0.0f)));
+
+    if (glm::dot(toBox, toBox) > maxDistance * maxDistance)
+    {
+      continue;
+    }
+
+    const auto occluder = Occluder{mTriangles[index], origin};
+
+    // Also too far away if its plane is
+    if (
+      std::abs(occluder.mPlaneDistance) >
+      maxDistance * glm::length(occluder.mNormal))
+    {
+      continue;
+    }
+
+    occluders.push_back(occluder);
+  }
+}
+
+
+/** Cosine-weighted hemisphere directions around +Z (Hammersley points) */
+std::array<glm::vec3, NUM_SAMPLES> makeSampleDirections()
+{
+  std::array<glm::vec3, NUM_SAMPLES> directions;
+
+  for (auto i = 0u; i < directions.size(); ++i)
+  {
+    auto bits = i;
+    auto radicalInverse = 0.0f;
+    auto scale = 0.5f;
+
+    while (bits)
+    {
+      if (bits & 1)
+      {
+        radicalInverse += scale;
+      }
+
+      bits >>= 1;
+      scale *= 0.5f;
+    }
+
+    const auto u = (float(i) + 0.5f) / NUM_SAMPLES;
+    const auto radius = std::sqrt(u);
+    const auto angle = 2.0f * glm::pi<float>() * radicalInverse;
+
+    directions[i] = glm::vec3(
+      radius * std::cos(angle), radius * std::sin(angle), std::sqrt(1.0f - u));
+  }
+
+  return directions;
+}
+
+
+/** occluders is scratch space, to avoid allocating it for every query */
+float computeOcclusion(
+  const OcclusionGrid& grid,
+  const std::array<glm::vec3, NUM_SAMPLES>& sampleDirections,
+  const OcclusionQuery& query,
+  std::vector<Occluder>& occluders)
+{
+  if (glm::dot(query.mNormal, query.mNormal) == 0.0f)
+  {
+    return 1.0f;
+  }
+
+  const auto normal = glm::normalize(query.mNormal);
+  const auto origin = query.mPosition + normal * RAY_EPSILON;
+
+  grid.findOccluders(origin, normal, MAX_OCCLUDER_DISTANCE, occluders);
+
+  if (occluders.empty())
+  {
+    return 1.0f;
+  }
+
+  const auto helper = std::abs(normal.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f)
+                                                : glm::vec3(0.0f, 1.0f, 0.0f);
+  const auto tangent = glm::normalize(glm::cross(helper, normal));
+  const auto bitangent = glm::cross(normal, tangent);
+
+  auto numUnoccluded = 0;
+
+  for (const auto& sample : sampleDirections)
+  {
+    const auto direction =
+      tangent * sample.x + bitangent * sample.y + normal * sample.z;
+
+    const auto isOccluded = std::any_of(
+      occluders.begin(), occluders.end(), [&](const Occluder& occluder) {
+        return occluder.intersects(direction, MAX_OCCLUDER_DISTANCE);
+      });
+
+    if (!isOccluded)
+    {
+      ++numUnoccluded;
+    }
+  }
+
+  return float(numUnoccluded) / NUM_SAMPLES;
+}
+
+} // namespace
+
+
+std::vector<float> bakeAmbientOcclusion(
+  rigel::base::ArrayView<glm::vec3> triangles,
+  rigel::base::ArrayView<OcclusionQuery> queries,
+  const bool useCache)
+{
+  auto cacheKey = hashBytes(
+    &AO_BAKE_VERSION, sizeof(AO_BAKE_VERSION), INITIAL_BAKE_HASH);
+  cacheKey = hashArray(triangles, cacheKey);
+  cacheKey = hashArray(queries, cacheKey);
+
+  std::vector<float> result(queries.size());
+
+  if (const auto oCached =
+        useCache ? loadBakedData("ao", cacheKey) : std::nullopt;
+      oCached && oCached->size() == result.size() * sizeof(float))
+  {
+    std::memcpy(result.data(), oCached->data(), oCached->size());
+    return result;
+  }
+
+
+  const auto grid = OcclusionGrid{triangles};
+  const auto sampleDirections = makeSampleDirections();
+
+  const auto numBatches =
+    (queries.size() + QUERIES_PER_BATCH - 1) / QUERIES_PER_BATCH;
+
+  parallelFor(numBatches, [&](const std::size_t batch) {
+    const auto start = batch * QUERIES_PER_BATCH;
+    const auto end = std::min(start + QUERIES_PER_BATCH, queries.size());
+
+    std::vector<Occluder> occluders;
+
+    for (auto i = start; i < end; ++i)
+    {
+      result[i] =
+        computeOcclusion(grid, sampleDirections, queries[i], occluders);
+    }
+  });
+
+
+  if (useCache)
+  {
+    storeBakedData(
+      "ao",
+      cacheKey,
+      rigel::base::ArrayView<std::uint8_t>(
+        reinterpret_cast<const std::uint8_t*>(result.data()),
+        result.size() * sizeof(float)));
+  }
+
+  return result;
+}
+
+} // namespace saucer
@@ -0,0 +1,58 @@
+/* Copyright (C) 2024, Nikolai Wuttke. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <rigel/base/array_view.hpp>
+#include <rigel/base/warnings.hpp>
+
+RIGEL_DISABLE_WARNINGS
+#include <glm/vec3.hpp>
+RIGEL_RESTORE_WARNINGS
+
+#include <vector>
+
+
+namespace saucer
+{
+
+struct OcclusionQuery
+{
+  glm::vec3 mPosition;
+  glm::vec3 mNormal;
+};
+
+
+/** Computes ambient occlusion at the given surface points
+ *
+ * Casts a fixed set of cosine-weighted rays over the hemisphere around each
+ * query's normal against the given triangle soup (3 positions per triangle),
+ * only considering hits up to a short distance away. The result is the
+ * fraction of unoccluded rays for each query, i.e. 1.0 for points that are
+ * fully exposed.
+ *
+ * Triangles are binned into a uniform grid. For each query, the few
+ * triangles within reach are gathered once and all of its rays are tested
+ * against that list. Queries are distributed over the shared worker pool,
+ * see parallelFor(). Unless useCache is false, results are cached on disk,
+ * keyed by the input data.
+ */
+std::vector<float> bakeAmbientOcclusion(
+  rigel::base::ArrayView<glm::vec3> triangles,
+  rigel::base::ArrayView<OcclusionQuery> queries,
+  bool useCache);
+
+} // namespace saucer
@@ -0,0 +1,255 @@
+/* Copyright (C) 2024, Nikolai Wuttke. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "bake_cache.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <system_error>
+#include <vector>
+
+
+namespace saucer
+{
+
+namespace
+{
+
+constexpr auto FNV_PRIME = std::uint64_t(1099511628211ull);
+
+// Once the cache grows beyond this, the least recently used entries are
+// removed
+constexpr auto MAX_CACHE_SIZE = std::uintmax_t(512) * 1024 * 1024;
+
+
+std::string hexString(const std::uint64_t value)
+{
+  char string[17];
+  std::snprintf(string, sizeof(string), "%016llx", (unsigned long long)value);
+  return string;
+}
+
+
+std::filesystem::path cacheDirectory()
+{
+  std::error_code error;
+  auto directory = std::filesystem::temp_directory_path(error);
+
+  if (error)
+  {
+    return {};
+  }
+
+  return directory / "saucer_map_viewer_cache";
+}
+
+
+std::filesystem::path cacheFilePath(
+  std::string_view kind,
+  const std::uint64_t key)
+{
+  const auto directory = cacheDirectory();
+
+  if (directory.empty())
+  {
+    return {};
+  }
+
+  return directory / (std::string(kind) + "_" + hexString(key) + ".bin");
+}
+
+
+/** Random suffix for temporary files
+ *
+ * Loads of the same level can run concurrently, in this or another instance
+ * of the viewer. Each writer needs its own temporary file.
+ */
+std::string uniqueSuffix()
+{
+  thread_local std::mt19937_64 generator{std::random_device{}()};
+  return hexString(generator());
+}
+
+
+/** Removes least recently used entries until the cache fits its size limit
+ *
+ * Entries are marked as used by updating their modification time.
+ */
+void evictOldEntries(const std::filesystem::path& directory)
+{
+  struct Entry
+  {
+    std::filesystem::path mPath;
+    std::filesystem::file_time_type mLastUse;
+    std::uintmax_t mSize;
+  };
+
+  std::vector<Entry> entries;
+  auto totalSize = std::uintmax_t(0);
+
+  std::error_code error;
+
+  for (
+    auto iEntry = std::filesystem::directory_iterator(directory, error);
+    !error && iEntry != std::filesystem::directory_iterator();
+    iEntry.increment(error))
+  {
+    if (iEntry->path().extension() != ".bin")
+    {
+      continue;
+    }
+
+    std::error_code entryError;
+    const auto size = iEntry->file_size(entryError);
+    const auto lastUse = iEntry->last_write_time(entryError);
+
+    if (!entryError)
+    {
+      entries.push_back({iEntry->path(), lastUse, size});
+      totalSize += size;
+    }
+  }
+
+  if (totalSize <= MAX_CACHE_SIZE)
+  {
+    return;
+  }
+
+  std::sort(
+    entries.begin(), entries.end(), [](const Entry& lhs, const Entry& rhs) {
+      return lhs.mLastUse < rhs.mLastUse;
+    });
+
+  for (const auto& entry : entries)
+  {
+    if (totalSize <= MAX_CACHE_SIZE)
+    {
+      break;
+    }
+
+    if (std::filesystem::remove(entry.mPath, error))
+    {
+      totalSize -= entry.mSize;
+    }
+  }
+}
+
+} // namespace
+
+
+std::uint64_t
+  hashBytes(const void* pData, const std::size_t size, std::uint64_t hash)
+{
+  const auto pBytes = static_cast<const std::uint8_t*>(pData);
+
+  for (auto i = std::size_t(0); i < size; ++i)
+  {
+    hash ^= pBytes[i];
+    hash *= FNV_PRIME;
+  }
+
+  return hash;
+}
+
+
+std::optional<std::vector<std::uint8_t>>
+  loadBakedData(std::string_view kind, const std::uint64_t key)
+{
+  const auto path = cacheFilePath(kind, key);
+
+  if (path.empty())
+  {
+    return {};
+  }
+
+  std::ifstream file(path, std::ios::binary);
+
+  if (!file.is_open())
+  {
+    return {};
+  }
+
+  auto data = std::vector<std::uint8_t>(
+    std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+
+  if (file.bad())
+  {
+    return {};
+  }
+
+  std::error_code error;
+  std::filesystem::last_write_time(
+    path, std::filesystem::file_time_type::clock::now(), error);
+
+  return data;
+}
+
+
+void storeBakedData(
+  std::string_view kind,
+  const std::uint64_t key,
+  rigel::base::ArrayView<std::uint8_t> data)
+{
+  const auto path = cacheFilePath(kind, key);
+
+  if (path.empty())
+  {
+    return;
+  }
+
+  std::error_code error;
+  std::filesystem::create_directories(path.parent_path(), error);
+
+  if (error)
+  {
+    return;
+  }
+
+  // Write to a temporary file first, so that readers never see a partially
+  // written entry.
+  auto tempPath = path;
+  tempPath += "." + uniqueSuffix() + ".tmp";
+
+  {
+    std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+    file.write(
+      reinterpret_cast<const char*>(data.data()), std::streamsize(data.size()));
+
+    if (!file.good())
+    {
+      file.close();
+      std::filesystem::remove(tempPath, error);
+      return;
+    }
+  }
+
+  std::filesystem::rename(tempPath, path, error);
+
+  if (error)
+  {
+    std::filesystem::remove(tempPath, error);
+    return;
+  }
+
+  evictOldEntries(path.parent_path());
+}
+
+} // namespace saucer
@@ -0,0 +1,66 @@
+/* Copyright (C) 2024, Nikolai Wuttke. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <rigel/base/array_view.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+
+namespace saucer
+{
+
+constexpr auto INITIAL_BAKE_HASH = std::uint64_t(14695981039346656037ull);
+
+
+/** 64-bit FNV-1a hash, can be chained by passing in a previous result */
+std::uint64_t
+  hashBytes(const void* pData, std::size_t size, std::uint64_t hash);
+
+
+template <typename T>
+std::uint64_t hashArray(
+  rigel::base::ArrayView<T> data,
+  const std::uint64_t hash = INITIAL_BAKE_HASH)
+{
+  return hashBytes(data.data(), data.size() * sizeof(T), hash);
+}
+
+
+/** Persistent storage for data that's expensive to compute at load time
+ *
+ * Entries are identified by a kind (used as file name prefix) and a hash of
+ * all inputs that went into computing them, so there is no need for explicit
+ * invalidation. Files live in a directory below the system's temp directory.
+ * The cache's total size is capped, least recently used entries are removed
+ * first.
+ * Missing or unreadable entries are reported as empty, errors while
+ * storing are ignored - the cache is purely an optimization.
+ */
+std::optional<std::vector<std::uint8_t>>
+  loadBakedData(std::string_view kind, std::uint64_t key);
+
+void storeBakedData(
+  std::string_view kind,
+  std::uint64_t key,
+  rigel::base::ArrayView<std::uint8_t> data);
+
+} // namespace saucer
@@ -0,0 +1,218 @@
+/* Copyright (C) 2024, Nikolai Wuttke. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+
+namespace saucer
+{
+
+/** A little-endian integer field (or fixed-size array of them) in a record
+ *
+ * Offset is in bytes, relative to the start of the record. Since both offset
+ * and type are known at compile time, decoding a field boils down to a
+ * single load for scalar fields.
+ */
+template <typename T, std::size_t Offset, std::size_t Count = 1>
+struct RecordField
+{
+  static_assert(std::is_integral_v<T>);
+  static_assert(Count > 0);
+
+  using Value = std::conditional_t<Count == 1, T, std::array<T, Count>>;
+
+  static constexpr auto OFFSET = Offset;
+  static constexpr auto SIZE = sizeof(T) * Count;
+
+  static Value decode(const std::uint8_t* pRecord)
+  {
+    if constexpr (Count == 1)
+    {
+      return decodeElement(pRecord + Offset);
+    }
+    else
+    {
+      Value result;
+
+      for (auto i = std::size_t(0); i < Count; ++i)
+      {
+        result[i] = decodeElement(pRecord + Offset + i * sizeof(T));
+      }
+
+      return result;
+    }
+  }
+
+  static void encode(std::uint8_t* pRecord, const Value& value)
+  {
+    if constexpr (Count == 1)
+    {
+      encodeElement(pRecord + Offset, value);
+    }
+    else
+    {
+      for (auto i = std::size_t(0); i < Count; ++i)
+      {
+        encodeElement(pRecord + Offset + i * sizeof(T), value[i]);
+      }
+    }
+  }
+
+private:
+  using Unsigned = std::make_unsigned_t<T>;
+
+  static T decodeElement(const std::uint8_t* pBytes)
+  {
+    auto value = Unsigned(0);
+
+    for (auto i = std::size_t(0); i < sizeof(T); ++i)
+    {
+      value |= Unsigned(Unsigned(pBytes[i]) << (i * 8));
+    }
+
+    return T(value);
+  }
+
+  static void encodeElement(std::uint8_t* pBytes, const T value)
+  {
+    for (auto i = std::size_t(0); i < sizeof(T); ++i)
+    {
+      pBytes[i] = std::uint8_t(Unsigned(value) >> (i * 8));
+    }
+  }
+};
+
+
+/** Bytes whose meaning is unknown, or which we don't need */
+template <std::size_t Offset, std::size_t Size>
+using UnknownBytes = RecordField<std::uint8_t, Offset, Size>;
+
+
+template <typename... Fields>
+constexpr bool fieldsAreContiguous()
+{
+  auto expectedOffset = std::size_t(0);
+  auto result = true;
+
+  ((result = result && Fields::OFFSET == expectedOffset,
+    expectedOffset += Fields::SIZE),
+   ...);
+
+  return result;
+}
+
+
+/** Describes a fixed-size record as a list of fields
+ *
+ * The fields must cover the entire record without gaps or overlap, in order
+ * of their offsets. This mirrors the tables in file_format_specs.md and makes
+ * the record size derived from the fields, so that a static_assert on the
+ * size catches any mismatch with the spec at compile time.
+ */
+template <typename... Fields>
+struct RecordLayout
+{
+  static_assert(
+    fieldsAreContiguous<Fields...>(),
+    "Record fields must be listed in order, without gaps or overlap");
+
+  static constexpr auto SIZE = (std::size_t(0) + ... + Fields::SIZE);
+
+  template <typename Field>
+  static constexpr bool contains()
+  {
+    return (std::is_same_v<Field, Fields> || ...);
+  }
+};
+
+
+/** Raw bytes of a single record, with typed access to its fields
+ *
+ * Description is a struct declaring the record's fields as nested types, and
+ * listing all of them in a nested Layout type.
+ */
+template <typename Description>
+struct Record
+{
+  using Layout = typename Description::Layout;
+
+  std::array<std::uint8_t, Layout::SIZE> mBytes{};
+
+  template <typename Field>
+  typename Field::Value get() const
+  {
+    static_assert(Layout::template contains<Field>());
+    return Field::decode(mBytes.data());
+  }
+
+  template <typename Field>
+  void set(const typename Field::Value& value)
+  {
+    static_assert(Layout::template contains<Field>());
+    Field::encode(mBytes.data(), value);
+  }
+};
+
+
+template <typename Description>
+Record<Description> readRecord(std::istream& stream)
+{
+  Record<Description> record;
+  stream.read(
+    reinterpret_cast<char*>(record.mBytes.data()), record.mBytes.size());
+  return record;
+}
+
+
+template <typename Description>
+void writeRecord(std::ostream& stream, const Record<Description>& record)
+{
+  stream.write(
+    reinterpret_cast<const char*>(record.mBytes.data()), record.mBytes.size());
+}
+
+
+/** Reads a record from the given offset within an in-memory buffer
+ *
+ * Throws std::out_of_range if the record doesn't fit into the buffer.
+ */
+template <typename Description>
+Record<Description>
+  recordAt(const std::vector<std::uint8_t>& data, const std::size_t offset)
+{
+  Record<Description> record;
+  const auto size = record.mBytes.size();
+
+  if (offset > data.size() || data.size() - offset < size)
+  {
+    throw std::out_of_range("Record exceeds data buffer");
+  }
+
+  std::memcpy(record.mBytes.data(), data.data() + offset, size);
+  return record;
+}
+
+} // namespace saucer
@@ -0,0 +1,259 @@
+/* Copyright (C) 2024, Nikolai Wuttke. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "camera_bookmarks.hpp"
+
+RIGEL_DISABLE_WARNINGS
+#include <glm/glm.hpp>
+#include <imgui.h>
+RIGEL_RESTORE_WARNINGS
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+
+namespace saucer
+{
+
+namespace
+{
+
+constexpr auto EYE_HEIGHT = 1.5f;
+
+
+/** Lists the given bookmarks, returns the index of the clicked one */
+std::optional<std::size_t>
+  showBookmarkList(const std::vector<CameraBookmark>& bookmarks)
+{
+  std::optional<std::size_t> oClicked;
+
+  for (auto i = std::size_t(0); i < bookmarks.size(); ++i)
+  {
+    const auto& bookmark = bookmarks[i];
+
+    ImGui::PushID(int(i));
+
+    if (ImGui::Selectable(bookmark.mName.c_str()))
+    {
+      oClicked = i;
+    }
+
+    if (ImGui::IsItemHovered())
+    {
+      ImGui::SetTooltip(
+        "%.2f, %.2f, %.2f",
+        bookmark.mPosition.x,
+        bookmark.mPosition.y,
+        bookmark.mPosition.z);
+    }
+
+    ImGui::PopID();
+  }
+
+  return oClicked;
+}
+
+} // namespace
+
+
+std::vector<CameraBookmark> mapCameraBookmarks(const MapData& map)
+{
+  std::vector<CameraBookmark> bookmarks;
+  bookmarks.reserve(map.mCameraPositions.size());
+
+  for (const auto& camera : map.mCameraPositions)
+  {
+    const auto x = std::min(int(camera.x), MAP_SIZE - 1);
+    const auto y = std::min(int(camera.y), MAP_SIZE - 1);
+    const auto terrainHeight = map.terrainAt(x, y).verticalOffset / -256.0f;
+
+    bookmarks.push_back(
+      {"Camera " + std::to_string(bookmarks.size() + 1),
+       {camera.x - MAP_SIZE / 2 + 0.5f,
+        terrainHeight + EYE_HEIGHT,
+        camera.y - MAP_SIZE / 2 + 0.5f},
+       {0.0f, 0.0f, -1.0f}});
+  }
+
+  return bookmarks;
+}
+
+
+std::filesystem::path userBookmarksFile(const std::filesystem::path& mapFile)
+{
+  return mapFile.parent_path() /
+    std::filesystem::u8path(mapFile.stem().u8string() + "_bookmarks.txt");
+}
+
+
+std::vector<CameraBookmark>
+  loadUserBookmarks(const std::filesystem::path& file)
+{
+  std::vector<CameraBookmark> bookmarks;
+
+  // One bookmark per line: position, direction, and then the name, which
+  // takes up the rest of the line
+  std::ifstream stream(file);
+  std::string line;
+
+  while (std::getline(stream, line))
+  {
+    std::istringstream lineStream(line);
+    CameraBookmark bookmark;
+
+    lineStream >> bookmark.mPosition.x >> bookmark.mPosition.y >>
+      bookmark.mPosition.z >> bookmark.mDirection.x >>
+      bookmark.mDirection.y >> bookmark.mDirection.z >> std::ws;
+
+    if (!lineStream || glm::length(bookmark.mDirection) == 0.0f)
+    {
+      continue;
+    }
+
+    std::getline(lineStream, bookmark.mName);
+    bookmark.mDirection = glm::normalize(bookmark.mDirection);
+    bookmarks.push_back(std::move(bookmark));
+  }
+
+  return bookmarks;
+}
+
+
+bool saveUserBookmarks(
+  const std::filesystem::path& file,
+  const std::vector<CameraBookmark>& bookmarks)
+{
+  std::ofstream stream(file, std::ios::trunc);
+
+  for (const auto& bookmark : bookmarks)
+  {
+    stream << bookmark.mPosition.x << ' ' << bookmark.mPosition.y << ' '
+           << bookmark.mPosition.z << ' ' << bookmark.mDirection.x << ' '
+           << bookmark.mDirection.y << ' ' << bookmark.mDirection.z << ' '
+           << bookmark.mName << '\n';
+  }
+
+  return bool(stream);
+}
+
+
+void BookmarkPanel::setMap(
+  const MapData* pMap,
+  const std::filesystem::path& mapFile)
+{
+  mMapBookmarks.clear();
+  mUserBookmarks.clear();
+  mUserBookmarksFile.clear();
+
+  if (pMap)
+  {
+    mMapBookmarks = mapCameraBookmarks(*pMap);
+    mUserBookmarksFile = userBookmarksFile(mapFile);
+    mUserBookmarks = loadUserBookmarks(mUserBookmarksFile);
+  }
+}
+
+
+std::optional<CameraBookmark> BookmarkPanel::updateAndRender(
+  bool* pIsOpen,
+  const glm::vec3& cameraPosition,
+  const glm::vec3& cameraDirection)
+{
+  ImGui::SetNextWindowSize({280, 360}, ImGuiCond_FirstUseEver);
+
+  if (!ImGui::Begin("Bookmarks", pIsOpen))
+  {
+    ImGui::End();
+    return {};
+  }
+
+  if (mUserBookmarksFile.empty())
+  {
+    ImGui::TextDisabled("No map loaded");
+    ImGui::End();
+    return {};
+  }
+
+  std::optional<CameraBookmark> oJumpTarget;
+
+  ImGui::InputTextWithHint(
+    "##name", "Name", mNewBookmarkName.data(), mNewBookmarkName.size());
+  ImGui::SameLine();
+
+  if (ImGui::Button("Add current view"))
+  {
+    auto name = std::string(mNewBookmarkName.data());
+
+    if (name.empty())
+    {
+      name = "Bookmark " + std::to_string(mUserBookmarks.size() + 1);
+    }
+
+    mUserBookmarks.push_back({name, cameraPosition, cameraDirection});
+    saveUserBookmarks(mUserBookmarksFile, mUserBookmarks);
+    mNewBookmarkName.fill('\0');
+  }
+
+  ImGui::BeginChild("BookmarkList");
+
+  if (ImGui::CollapsingHeader("Map cameras", ImGuiTreeNodeFlags_DefaultOpen))
+  {
+    ImGui::PushID("map");
+
+    if (const auto oIndex = showBookmarkList(mMapBookmarks))
+    {
+      oJumpTarget = mMapBookmarks[*oIndex];
+    }
+
+    if (mMapBookmarks.empty())
+    {
+      ImGui::TextDisabled("None");
+    }
+
+    ImGui::PopID();
+  }
+
+  if (ImGui::CollapsingHeader("Saved", ImGuiTreeNodeFlags_DefaultOpen))
+  {
+    ImGui::PushID("user");
+
+    if (const auto oIndex = showBookmarkList(mUserBookmarks))
+    {
+      oJumpTarget = mUserBookmarks[*oIndex];
+    }
+
+    if (mUserBookmarks.empty())
+    {
+      ImGui::TextDisabled("None");
+    }
+    else if (ImGui::Button("Remove last"))
+    {
+      mUserBookmarks.pop_back();
+      saveUserBookmarks(mUserBookmarksFile, mUserBookmarks);
+    }
+
+    ImGui::PopID();
+  }
+
+  ImGui::EndChild();
+  ImGui::End();
+
+  return oJumpTarget;
+}
+
+} // namespace saucer
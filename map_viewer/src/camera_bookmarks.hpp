@@ -0,0 +1,89 @@
+/* Copyright (C) 2024, Nikolai Wuttke. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "map_file.hpp"
+
+#include <rigel/base/warnings.hpp>
+
+RIGEL_DISABLE_WARNINGS
+#include <glm/vec3.hpp>
+RIGEL_RESTORE_WARNINGS
+
+#include <array>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+
+namespace saucer
+{
+
+struct CameraBookmark
+{
+  std::string mName;
+  glm::vec3 mPosition;
+  glm::vec3 mDirection;
+};
+
+
+/** Bookmarks for the camera position records found in the map
+ *
+ * Since the records' contents aren't understood yet, the camera is placed
+ * at eye height above the terrain in the record's grid cell, looking
+ * north.
+ */
+std::vector<CameraBookmark> mapCameraBookmarks(const MapData& map);
+
+
+/** User bookmarks are stored in a text file next to the map file, named
+ * after it.
+ */
+std::filesystem::path userBookmarksFile(const std::filesystem::path& mapFile);
+
+std::vector<CameraBookmark>
+  loadUserBookmarks(const std::filesystem::path& file);
+bool saveUserBookmarks(
+  const std::filesystem::path& file,
+  const std::vector<CameraBookmark>& bookmarks);
+
+
+/** Panel listing the map's camera bookmarks as well as user-saved ones */
+class BookmarkPanel
+{
+public:
+  void setMap(const MapData* pMap, const std::filesystem::path& mapFile);
+
+  /** Returns the bookmark to jump to, if one was clicked
+   *
+   * The given camera is what gets saved when adding a new bookmark.
+   */
+  std::optional<CameraBookmark> updateAndRender(
+    bool* pIsOpen,
+    const glm::vec3& cameraPosition,
+    const glm::vec3& cameraDirection);
+
+private:
+  std::vector<CameraBookmark> mMapBookmarks;
+  std::vector<CameraBookmark> mUserBookmarks;
+  std::filesystem::path mUserBookmarksFile;
+  std::array<char, 64> mNewBookmarkName{};
+};
+
+} // namespace saucer
@@ -0,0 +1,420 @@
+/* Copyright (C) 2024, Nikolai Wuttke. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "binary_record.hpp"
+
+#include <cstdint>
+
+
+namespace saucer
+{
+
+// Fixed-size records found in the game's WAD and map files. Each struct
+// corresponds to one of the tables in file_format_specs.md, the size
+// assertions check against the record sizes given there.
+
+// Shared by WAD and map files
+
+struct TextureDefRecord
+{
+  using Uv1 = RecordField<uint8_t, 0, 2>;
+  using BitmapIndex = RecordField<uint16_t, 2>;
+  using Uv2 = RecordField<uint8_t, 4, 2>;
+  using Unknown = RecordField<uint8_t, 6>;
+  using BlendMode = RecordField<uint8_t, 7>;
+  using Uv3 = RecordField<uint8_t, 8, 2>;
+  using XOrigin = RecordField<int8_t, 10>;
+  using YOrigin = RecordField<int8_t, 11>;
+  using Uv4 = RecordField<uint8_t, 12, 2>;
+  using Flags = RecordField<uint16_t, 14>;
+
+  using Layout = RecordLayout<
+    Uv1,
+    BitmapIndex,
+    Uv2,
+    Unknown,
+    BlendMode,
+    Uv3,
+    XOrigin,
+    YOrigin,
+    Uv4,
+    Flags>;
+};
+
+static_assert(TextureDefRecord::Layout::SIZE == 16);
+
+
+// WAD file
+
+struct LanguageHeaderRecord
+{
+  using Unknown = RecordField<uint16_t, 0>;
+  using Count = RecordField<uint16_t, 2>;
+  using StartOffset = RecordField<uint32_t, 4>;
+  using EndOffset = RecordField<uint32_t, 8>;
+
+  using Layout = RecordLayout<Unknown, Count, StartOffset, EndOffset>;
+};
+
+static_assert(LanguageHeaderRecord::Layout::SIZE == 12);
+
+
+struct BitmapRecord
+{
+  using Offset = RecordField<uint32_t, 0>;
+  using Unknown = RecordField<uint32_t, 4>;
+  using Width = RecordField<uint16_t, 8>;
+  using Height = RecordField<uint16_t, 10>;
+
+  using Layout = RecordLayout<Offset, Unknown, Width, Height>;
+};
+
+static_assert(BitmapRecord::Layout::SIZE == 12);
+
+
+struct ModelTableRecord
+{
+  using DataOffset = RecordField<uint32_t, 0>;
+  using Unknown1 = UnknownBytes<4, 8>;
+  using ParamsOffset = RecordField<uint32_t, 12>;
+  using Unknown2 = UnknownBytes<16, 20>;
+
+  using Layout = RecordLayout<DataOffset, Unknown1, ParamsOffset, Unknown2>;
+};
+
+static_assert(ModelTableRecord::Layout::SIZE == 36);
+
+
+struct ModelDataRecord
+{
+  using Unknown1 = UnknownBytes<0, 40>;
+  using NumVertices = RecordField<uint32_t, 40>;
+  using VertexListOffset = RecordField<uint32_t, 44>;
+  using NumFaces = RecordField<uint32_t, 48>;
+  using FaceListOffset = RecordField<uint32_t, 52>;
+  using Unknown2 = UnknownBytes<56, 24>;
+
+  using Layout = RecordLayout<
+    Unknown1,
+    NumVertices,
+    VertexListOffset,
+    NumFaces,
+    FaceListOffset,
+    Unknown2>;
+};
+
+static_assert(ModelDataRecord::Layout::SIZE == 80);
+
+
+struct ModelParamsRecord
+{
+  using TransformationMatrix = RecordField<int16_t, 0, 12>;
+  using Unknown = UnknownBytes<24, 36>;
+
+  using Layout = RecordLayout<TransformationMatrix, Unknown>;
+};
+
+static_assert(ModelParamsRecord::Layout::SIZE == 60);
+
+
+struct ModelFaceRecord
+{
+  using Texture = RecordField<uint32_t, 0>;
+  using Indices = RecordField<uint16_t, 4, 4>;
+  using Type = RecordField<uint16_t, 12>;
+  using Unknown = UnknownBytes<14, 18>;
+
+  using Layout = RecordLayout<Texture, Indices, Type, Unknown>;
+};
+
+static_assert(ModelFaceRecord::Layout::SIZE == 32);
+
+
+struct SoundEffectRecord
+{
+  using FormatOffset = RecordField<uint32_t, 0>;
+  using DataOffset = RecordField<uint32_t, 4>;
+  using Size = RecordField<uint32_t, 8>;
+  using Unknown = UnknownBytes<12, 104>;
+
+  using Layout = RecordLayout<FormatOffset, DataOffset, Size, Unknown>;
+};
+
+static_assert(SoundEffectRecord::Layout::SIZE == 116);
+
+
+// Leading part of a WAVEFORMATEX structure, as found in the packed data
+// block. The cbSize member is not needed for PCM data.
+struct WaveFormatRecord
+{
+  using FormatTag = RecordField<uint16_t, 0>;
+  using NumChannels = RecordField<uint16_t, 2>;
+  using SamplesPerSecond = RecordField<uint32_t, 4>;
+  using AvgBytesPerSecond = RecordField<uint32_t, 8>;
+  using BlockAlign = RecordField<uint16_t, 12>;
+  using BitsPerSample = RecordField<uint16_t, 14>;
+
+  using Layout = RecordLayout<
+    FormatTag,
+    NumChannels,
+    SamplesPerSecond,
+    AvgBytesPerSecond,
+    BlockAlign,
+    BitsPerSample>;
+};
+
+static_assert(WaveFormatRecord::Layout::SIZE == 16);
+
+
+// Map file
+
+struct MapHeaderRecord
+{
+  using Signature = RecordField<char, 0, 4>;
+  using Version = RecordField<uint32_t, 4>;
+  using NumTextureDefs = RecordField<uint32_t, 8>;
+  using NumBlockDefs = RecordField<uint32_t, 12>;
+  using NumUnknown = RecordField<uint32_t, 16>;
+  using NumMapItems = RecordField<uint32_t, 20>;
+  using NumTextureAnimations = RecordField<uint32_t, 24>;
+  using NumImportedTextures = RecordField<uint32_t, 28>;
+  using NumEntities = RecordField<uint16_t, 32>;
+  using NumModelInstances = RecordField<uint16_t, 34>;
+
+  using Layout = RecordLayout<
+    Signature,
+    Version,
+    NumTextureDefs,
+    NumBlockDefs,
+    NumUnknown,
+    NumMapItems,
+    NumTextureAnimations,
+    NumImportedTextures,
+    NumEntities,
+    NumModelInstances>;
+};
+
+static_assert(MapHeaderRecord::Layout::SIZE == 36);
+
+
+struct BlockDefRecord
+{
+  using InsideFront = RecordField<uint16_t, 0>;
+  using InsideTop = RecordField<uint16_t, 2>;
+  using InsideLeft = RecordField<uint16_t, 4>;
+  using InsideBack = RecordField<uint16_t, 6>;
+  using InsideRight = RecordField<uint16_t, 8>;
+  using InsideBottom = RecordField<uint16_t, 10>;
+  using OutsideBack = RecordField<uint16_t, 12>;
+  using OutsideTop = RecordField<uint16_t, 14>;
+  using OutsideLeft = RecordField<uint16_t, 16>;
+  using OutsideFront = RecordField<uint16_t, 18>;
+  using OutsideRight = RecordField<uint16_t, 20>;
+  using OutsideBottom = RecordField<uint16_t, 22>;
+  using VertexCoordinatesY = RecordField<int16_t, 24, 8>;
+  using Unknown = UnknownBytes<40, 20>;
+
+  using Layout = RecordLayout<
+    InsideFront,
+    InsideTop,
+    InsideLeft,
+    InsideBack,
+    InsideRight,
+    InsideBottom,
+    OutsideBack,
+    OutsideTop,
+    OutsideLeft,
+    OutsideFront,
+    OutsideRight,
+    OutsideBottom,
+    VertexCoordinatesY,
+    Unknown>;
+};
+
+static_assert(BlockDefRecord::Layout::SIZE == 60);
+
+
+struct MapItemHeaderRecord
+{
+  using X = RecordField<uint32_t, 0>;
+  using Y = RecordField<uint32_t, 4>;
+  using TypeFlags = RecordField<uint32_t, 8>;
+
+  using Layout = RecordLayout<X, Y, TypeFlags>;
+};
+
+static_assert(MapItemHeaderRecord::Layout::SIZE == 12);
+
+
+struct TerrainTileRecord
+{
+  using Unknown1 = RecordField<uint32_t, 0>;
+  using BlockDefIndex = RecordField<uint32_t, 4>;
+  using Flags = RecordField<uint8_t, 8>;
+  using Unused = RecordField<uint8_t, 9>;
+  using BrightnessAdjustment = RecordField<int16_t, 10>;
+  using Unknown2 = RecordField<int16_t, 12>;
+  using VerticalOffset = RecordField<int16_t, 14>;
+  using Unknown3 = RecordField<int16_t, 16, 2>;
+
+  using Layout = RecordLayout<
+    Unknown1,
+    BlockDefIndex,
+    Flags,
+    Unused,
+    BrightnessAdjustment,
+    Unknown2,
+    VerticalOffset,
+    Unknown3>;
+};
+
+static_assert(TerrainTileRecord::Layout::SIZE == 20);
+
+
+struct ExtraTerrainTileRecord
+{
+  using Unknown1 = RecordField<uint32_t, 0>;
+  using BlockDefIndex = RecordField<uint32_t, 4>;
+  using Flags = RecordField<uint8_t, 8>;
+  using Unused = RecordField<uint8_t, 9>;
+  using BrightnessAdjustment = RecordField<int16_t, 10>;
+  using Unknown2 = RecordField<int16_t, 12>;
+  using VertexCoordinatesY = RecordField<int16_t, 14, 4>;
+  using Unknown3 = UnknownBytes<22, 2>;
+
+  using Layout = RecordLayout<
+    Unknown1,
+    BlockDefIndex,
+    Flags,
+    Unused,
+    BrightnessAdjustment,
+    Unknown2,
+    VertexCoordinatesY,
+    Unknown3>;
+};
+
+static_assert(ExtraTerrainTileRecord::Layout::SIZE == 24);
+
+
+struct BillboardRecord
+{
+  using Texture = RecordField<uint32_t, 0>;
+  using Unknown1 = RecordField<uint8_t, 4>;
+  using XOffset = RecordField<int8_t, 5>;
+  using YOffset = RecordField<uint8_t, 6>;
+  using Unknown2 = RecordField<uint8_t, 7>;
+  using VerticalOffset = RecordField<int16_t, 8>;
+  using Scale = RecordField<uint16_t, 10>;
+
+  using Layout = RecordLayout<
+    Texture,
+    Unknown1,
+    XOffset,
+    YOffset,
+    Unknown2,
+    VerticalOffset,
+    Scale>;
+};
+
+static_assert(BillboardRecord::Layout::SIZE == 12);
+
+
+struct BlockInstanceRecord
+{
+  using Unknown1 = RecordField<uint32_t, 0>;
+  using BlockDefIndex = RecordField<uint32_t, 4>;
+  using Flags = RecordField<uint8_t, 8>;
+  using Unused = RecordField<uint8_t, 9>;
+  using BrightnessAdjustment = RecordField<int16_t, 10>;
+  using Unknown2 = RecordField<int16_t, 12>;
+  using VerticalOffset = RecordField<int16_t, 14>;
+  using VertexOffsetsY = RecordField<int8_t, 16, 8>;
+
+  using Layout = RecordLayout<
+    Unknown1,
+    BlockDefIndex,
+    Flags,
+    Unused,
+    BrightnessAdjustment,
+    Unknown2,
+    VerticalOffset,
+    VertexOffsetsY>;
+};
+
+static_assert(BlockInstanceRecord::Layout::SIZE == 24);
+
+
+struct ModelInstanceRecord
+{
+  using XOffset = RecordField<uint8_t, 0>;
+  using YOffset = RecordField<uint8_t, 1>;
+  using VerticalOffset = RecordField<int16_t, 2>;
+  using RotationX = RecordField<uint16_t, 4>;
+  using RotationY = RecordField<uint16_t, 6>;
+  using RotationZ = RecordField<uint16_t, 8>;
+  using ModelIndex = RecordField<uint32_t, 10>;
+  using Scale = RecordField<uint16_t, 14>;
+
+  using Layout = RecordLayout<
+    XOffset,
+    YOffset,
+    VerticalOffset,
+    RotationX,
+    RotationY,
+    RotationZ,
+    ModelIndex,
+    Scale>;
+};
+
+static_assert(ModelInstanceRecord::Layout::SIZE == 16);
+
+
+// Item types whose contents aren't known or not used yet
+
+struct UnknownItem0x20Record
+{
+  using Layout = RecordLayout<UnknownBytes<0, 8>>;
+};
+
+static_assert(UnknownItem0x20Record::Layout::SIZE == 8);
+
+
+struct UnknownItem0x100Record
+{
+  using Layout = RecordLayout<UnknownBytes<0, 8>>;
+};
+
+static_assert(UnknownItem0x100Record::Layout::SIZE == 8);
+
+
+struct EntityRecord
+{
+  using Layout = RecordLayout<UnknownBytes<0, 32>>;
+};
+
+static_assert(EntityRecord::Layout::SIZE == 32);
+
+
+struct CameraPositionRecord
+{
+  using Layout = RecordLayout<UnknownBytes<0, 24>>;
+};
+
+static_assert(CameraPositionRecord::Layout::SIZE == 24);
+
+} // namespace saucer
@@ -0,0 +1,376 @@
+/* Copyright (C) 2024, Nikolai Wuttke. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "frame_capture.hpp"
+
+#include <rigel/base/image.hpp>
+#include <rigel/base/image_loading.hpp>
+#include <rigel/base/warnings.hpp>
+
+RIGEL_DISABLE_WARNINGS
+#include <loguru.hpp>
+RIGEL_RESTORE_WARNINGS
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+
+namespace saucer
+{
+
+using namespace rigel;
+
+
+namespace
+{
+
+// When encoding can't keep up while recording a sequence, the main thread
+// waits once this many frames are queued, instead of using up all memory.
+constexpr auto MAX_QUEUED_FRAMES = std::size_t(16);
+
+constexpr auto BYTES_PER_PIXEL = 4;
+
+
+std::string timestamp()
+{
+  const auto now = std::chrono::system_clock::now();
+  const auto time = std::chrono::system_clock::to_time_t(now);
+  const auto milliseconds =
+    std::chrono::duration_cast<std::chrono::milliseconds>(
+      now.time_since_epoch())
+      .count() %
+    1000;
+
+  char dateAndTime[32];
+  std::strftime(
+    dateAndTime, sizeof(dateAndTime), "%Y%m%d_%H%M%S", std::localtime(&time));
+
+  char result[48];
+  std::snprintf(
+    result, sizeof(result), "%s_%03d", dateAndTime, int(milliseconds));
+  return result;
+}
+
+
+base::Image toImage(const std::vector<std::uint8_t>& data, base::Size size)
+{
+  // OpenGL returns rows bottom to top. The framebuffer's alpha channel isn't
+  // meaningful for the final image, so we make the result fully opaque.
+  base::PixelBuffer pixels;
+  pixels.reserve(size_t(size.width * size.height));
+
+  for (auto y = size.height - 1; y >= 0; --y)
+  {
+    const auto* pRow = data.data() + y * size.width * BYTES_PER_PIXEL;
+
+    for (auto x = 0; x < size.width; ++x)
+    {
+      const auto* pPixel = pRow + x * BYTES_PER_PIXEL;
+      pixels.emplace_back(pPixel[0], pPixel[1], pPixel[2], std::uint8_t(255));
+    }
+  }
+
+  return base::Image{
+    std::move(pixels), size_t(size.width), size_t(size.height)};
+}
+
+} // namespace
+
+
+FrameCapture::FrameCapture()
+{
+#ifndef RIGEL_USE_GL_ES
+  for (auto& readback : mReadbacks)
+  {
+    readback.mBuffer = opengl::Handle<opengl::tag::Buffer>::create();
+  }
+#endif
+
+  mWorker = std::thread([this]() { runWorker(); });
+}
+
+
+FrameCapture::~FrameCapture()
+{
+#ifndef RIGEL_USE_GL_ES
+  // Make sure that all frames captured so far end up on disk
+  for (auto i = 0; i < NUM_READBACK_BUFFERS; ++i)
+  {
+    finishReadback(
+      mReadbacks[(mNextReadback + i) % NUM_READBACK_BUFFERS], true);
+  }
+#endif
+
+  {
+    std::lock_guard<std::mutex> lock(mQueueMutex);
+    mQuit = true;
+  }
+
+  mQueueChanged.notify_all();
+  mWorker.join();
+}
+
+
+void FrameCapture::requestScreenshot()
+{
+  mScreenshotRequested = true;
+}
+
+
+void FrameCapture::startSequence()
+{
+  mSequenceDirectory = "capture_" + timestamp();
+  mSequenceFrame = 0;
+
+  std::error_code error;
+  std::filesystem::create_directories(mSequenceDirectory, error);
+
+  if (error)
+  {
+    LOG_F(
+      ERROR,
+      "Failed to create directory '%s': %s",
+      mSequenceDirectory.u8string().c_str(),
+      error.message().c_str());
+    return;
+  }
+
+  mIsRecordingSequence = true;
+}
+
+
+void FrameCapture::stopSequence()
+{
+  mIsRecordingSequence = false;
+}
+
+
+std::size_t FrameCapture::numPendingFrames() const
+{
+  auto numPending = std::size_t(0);
+
+#ifndef RIGEL_USE_GL_ES
+  for (const auto& readback : mReadbacks)
+  {
+    if (readback.mFence)
+    {
+      ++numPending;
+    }
+  }
+#endif
+
+  std::lock_guard<std::mutex> lock(mQueueMutex);
+  return numPending + mQueue.size() + mNumJobsInProgress;
+}
+
+
+void FrameCapture::update(const base::Size& size)
+{
+#ifndef RIGEL_USE_GL_ES
+  // Readbacks are started in order, so once we encounter one that's not
+  // done yet, the following ones won't be either.
+  for (auto i = 0; i < NUM_READBACK_BUFFERS; ++i)
+  {
+    auto& readback = mReadbacks[(mNextReadback + i) % NUM_READBACK_BUFFERS];
+
+    if (readback.mFence && !finishReadback(readback, false))
+    {
+      break;
+    }
+  }
+#endif
+
+  if (size.width <= 0 || size.height <= 0)
+  {
+    return;
+  }
+
+  if (mScreenshotRequested)
+  {
+    startReadback(size, "screenshot_" + timestamp() + ".png");
+    mScreenshotRequested = false;
+  }
+
+  if (mIsRecordingSequence)
+  {
+    char filename[32];
+    std::snprintf(filename, sizeof(filename), "frame_%05d.png", mSequenceFrame);
+    ++mSequenceFrame;
+
+    startReadback(size, mSequenceDirectory / filename);
+  }
+}
+
+
+#ifndef RIGEL_USE_GL_ES
+
+bool FrameCapture::finishReadback(Readback& readback, const bool wait)
+{
+  if (!readback.mFence)
+  {
+    return true;
+  }
+
+  const auto status = glClientWaitSync(
+    readback.mFence,
+    wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0,
+    wait ? GL_TIMEOUT_IGNORED : 0);
+
+  if (status == GL_TIMEOUT_EXPIRED)
+  {
+    return false;
+  }
+
+  glDeleteSync(readback.mFence);
+  readback.mFence = nullptr;
+
+  if (status == GL_WAIT_FAILED)
+  {
+    return true;
+  }
+
+  const auto numBytes =
+    size_t(readback.mSize.width * readback.mSize.height * BYTES_PER_PIXEL);
+
+  auto job = EncodeJob{
+    std::vector<std::uint8_t>(numBytes), readback.mSize, readback.mPath};
+
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.mBuffer);
+
+  if (
+    const auto pData =
+      glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, numBytes, GL_MAP_READ_BIT))
+  {
+    std::memcpy(job.mPixels.data(), pData, numBytes);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  }
+
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  queueJob(std::move(job));
+  return true;
+}
+
+
+void FrameCapture::startReadback(
+  const base::Size& size,
+  std::filesystem::path path)
+{
+  auto& readback = mReadbacks[mNextReadback];
+  mNextReadback = (mNextReadback + 1) % NUM_READBACK_BUFFERS;
+
+  // Only happens if the GPU is lagging behind by more frames than we have
+  // buffers, e.g. when capturing both a screenshot and a sequence frame.
+  finishReadback(readback, true);
+
+  const auto numBytes = size_t(size.width * size.height * BYTES_PER_PIXEL);
+
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.mBuffer);
+
+  if (numBytes > readback.mCapacity)
+  {
+    glBufferData(GL_PIXEL_PACK_BUFFER, numBytes, nullptr, GL_STREAM_READ);
+    readback.mCapacity = numBytes;
+  }
+
+  // With a pack buffer bound, this only schedules the transfer and returns
+  // right away.
+  glReadPixels(
+    0, 0, size.width, size.height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  readback.mFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  readback.mSize = size;
+  readback.mPath = std::move(path);
+}
+
+#else
+
+void FrameCapture::startReadback(
+  const base::Size& size,
+  std::filesystem::path path)
+{
+  const auto numBytes = size_t(size.width * size.height * BYTES_PER_PIXEL);
+
+  auto job =
+    EncodeJob{std::vector<std::uint8_t>(numBytes), size, std::move(path)};
+
+  glReadPixels(
+    0,
+    0,
+    size.width,
+    size.height,
+    GL_RGBA,
+    GL_UNSIGNED_BYTE,
+    job.mPixels.data());
+
+  queueJob(std::move(job));
+}
+
+#endif
+
+
+void FrameCapture::queueJob(EncodeJob job)
+{
+  {
+    std::unique_lock<std::mutex> lock(mQueueMutex);
+    mQueueChanged.wait(
+      lock, [this]() { return mQueue.size() < MAX_QUEUED_FRAMES; });
+    mQueue.push_back(std::move(job));
+  }
+
+  mQueueChanged.notify_all();
+}
+
+
+void FrameCapture::runWorker()
+{
+  for (;;)
+  {
+    EncodeJob job;
+
+    {
+      std::unique_lock<std::mutex> lock(mQueueMutex);
+      mQueueChanged.wait(lock, [this]() { return mQuit || !mQueue.empty(); });
+
+      // Remaining jobs are still processed when quitting
+      if (mQueue.empty())
+      {
+        return;
+      }
+
+      job = std::move(mQueue.front());
+      mQueue.pop_front();
+      ++mNumJobsInProgress;
+    }
+
+    mQueueChanged.notify_all();
+
+    if (!base::saveImage(job.mPath.u8string(), toImage(job.mPixels, job.mSize)))
+    {
+      LOG_F(ERROR, "Failed to save '%s'", job.mPath.u8string().c_str());
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mQueueMutex);
+      --mNumJobsInProgress;
+    }
+  }
+}
+
+} // namespace saucer
@@ -0,0 +1,120 @@
+/* Copyright (C) 2024, Nikolai Wuttke. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <rigel/base/spatial_types.hpp>
+#include <rigel/opengl/handle.hpp>
+#include <rigel/opengl/opengl.hpp>
+
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace saucer
+{
+
+/** Saves rendered frames to PNG files without stalling the GPU pipeline
+ *
+ * Pixels are read back into a ring of pixel buffer objects, and only copied
+ * out a frame or two later once a fence indicates that the transfer has
+ * completed. Flipping and PNG encoding happen on a worker thread.
+ *
+ * OpenGL ES 2 has neither pixel buffer objects nor fences. There, pixels are
+ * read back right away, which stalls until the frame is rendered.
+ */
+class FrameCapture
+{
+public:
+  FrameCapture();
+  ~FrameCapture();
+
+  FrameCapture(const FrameCapture&) = delete;
+  FrameCapture& operator=(const FrameCapture&) = delete;
+
+  /** Captures the next frame to a file in the current working directory */
+  void requestScreenshot();
+
+  /** Captures every frame to a numbered image sequence in a new directory */
+  void startSequence();
+  void stopSequence();
+  bool isRecordingSequence() const { return mIsRecordingSequence; }
+
+  /** Number of frames which have been captured but not written out yet */
+  std::size_t numPendingFrames() const;
+
+  /** Must be called once per frame, after rendering the area to capture
+   *
+   * Captures an area of the given size at the bottom left of the current
+   * framebuffer, i.e. starting at the origin in OpenGL window coordinates.
+   */
+  void update(const rigel::base::Size& size);
+
+private:
+  struct EncodeJob
+  {
+    std::vector<std::uint8_t> mPixels;
+    rigel::base::Size mSize;
+    std::filesystem::path mPath;
+  };
+
+#ifndef RIGEL_USE_GL_ES
+  struct Readback
+  {
+    rigel::opengl::Handle<rigel::opengl::tag::Buffer> mBuffer;
+    GLsync mFence = nullptr;
+    rigel::base::Size mSize{0, 0};
+    std::size_t mCapacity = 0;
+    std::filesystem::path mPath;
+  };
+
+  static constexpr auto NUM_READBACK_BUFFERS = 3;
+
+  bool finishReadback(Readback& readback, bool wait);
+#endif
+
+  void startReadback(
+    const rigel::base::Size& size,
+    std::filesystem::path path);
+  void queueJob(EncodeJob job);
+  void runWorker();
+
+#ifndef RIGEL_USE_GL_ES
+  std::array<Readback, NUM_READBACK_BUFFERS> mReadbacks;
+  std::size_t mNextReadback = 0;
+#endif
+
+  bool mScreenshotRequested = false;
+  bool mIsRecordingSequence = false;
+  std::filesystem::path mSequenceDirectory;
+  int mSequenceFrame = 0;
+
+  mutable std::mutex mQueueMutex;
+  std::condition_variable mQueueChanged;
+  std::deque<EncodeJob> mQueue;
+  std::size_t mNumJobsInProgress = 0;
+  bool mQuit = false;
+  std::thread mWorker;
+};
+
+} // namespace saucer
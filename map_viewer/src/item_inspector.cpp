@@ -0,0 +1,513 @@
+/* Copyright (C) 2024, Nikolai Wuttke. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "item_inspector.hpp"
+
+#include <rigel/base/match.hpp>
+
+RIGEL_DISABLE_WARNINGS
+#include <imgui.h>
+RIGEL_RESTORE_WARNINGS
+
+#include <algorithm>
+#include <cstdio>
+#include <unordered_map>
+
+
+namespace saucer
+{
+
+namespace base = rigel::base;
+
+
+namespace
+{
+
+constexpr const char* ITEM_TYPE_NAMES[] = {"Extra terrain", "Block", "Model"};
+
+// Items outside of the map grid all end up in one extra cell
+constexpr auto NUM_CELL_KEYS = std::size_t(MAP_SIZE * MAP_SIZE + 1);
+
+
+std::size_t cellKey(const int x, const int y)
+{
+  if (x < 0 || x >= MAP_SIZE || y < 0 || y >= MAP_SIZE)
+  {
+    return NUM_CELL_KEYS - 1;
+  }
+
+  return std::size_t(y * MAP_SIZE + x);
+}
+
+
+glm::vec3 cellCenter(const MapItemCommon& item, const float height)
+{
+  return {
+    item.x - MAP_SIZE / 2 + 0.5f, height, item.y - MAP_SIZE / 2 + 0.5f};
+}
+
+} // namespace
+
+
+base::ArrayView<uint32_t> ItemIndex::itemsInRange(
+  const std::size_t firstKey,
+  const std::size_t lastKey) const
+{
+  if (firstKey >= lastKey || lastKey >= mGroupStarts.size())
+  {
+    return {};
+  }
+
+  const auto first = mGroupStarts[firstKey];
+  const auto last = mGroupStarts[lastKey];
+  return base::ArrayView<uint32_t>(mItems.data() + first, last - first);
+}
+
+
+bool ItemInspector::Filter::operator==(const Filter& other) const
+{
+  return mTypes == other.mTypes && mFilterBlockDef == other.mFilterBlockDef &&
+    mBlockDef == other.mBlockDef && mFilterModel == other.mFilterModel &&
+    mModelId == other.mModelId && mFilterArea == other.mFilterArea &&
+    mArea == other.mArea;
+}
+
+
+void ItemInspector::setMap(const MapData* pMap)
+{
+  mpMap = pMap;
+  mSummaries.clear();
+  mModelNames.clear();
+  mFilter = {};
+  moSelectedItem.reset();
+
+  if (!pMap)
+  {
+    mItemsByType = {};
+    mItemsByBlockDef = {};
+    mItemsByModel = {};
+    mItemsByCell = {};
+    mFilteredItems.clear();
+    return;
+  }
+
+  // Model IDs are assigned in alphabetical order, so that the model filter
+  // can list them directly
+  std::unordered_map<std::string, uint32_t> modelIds;
+
+  for (const auto& item : pMap->mItems)
+  {
+    if (const auto pModel = std::get_if<ModelInstance>(&item))
+    {
+      if (modelIds.emplace(pModel->modelName, 0).second)
+      {
+        mModelNames.push_back(pModel->modelName);
+      }
+    }
+  }
+
+  std::sort(mModelNames.begin(), mModelNames.end());
+
+  for (auto i = size_t(0); i < mModelNames.size(); ++i)
+  {
+    modelIds[mModelNames[i]] = uint32_t(i);
+  }
+
+  auto numBlockDefs = pMap->mBlockDefs.size();
+  mSummaries.reserve(pMap->mItems.size());
+
+  for (const auto& item : pMap->mItems)
+  {
+    mSummaries.push_back(base::match(
+      item,
+      [](const ExtraTerrainTile& tile) {
+        return ItemSummary{
+          tile.x, tile.y, ItemType::ExtraTerrain, tile.blockDefIndex};
+      },
+      [](const BlockInstance& block) {
+        return ItemSummary{
+          block.x, block.y, ItemType::Block, block.blockDefIndex};
+      },
+      [&](const ModelInstance& model) {
+        return ItemSummary{
+          model.x, model.y, ItemType::Model, modelIds[model.modelName]};
+      }));
+
+    if (mSummaries.back().mType != ItemType::Model)
+    {
+      numBlockDefs =
+        std::max(numBlockDefs, std::size_t(mSummaries.back().mKey) + 1);
+    }
+  }
+
+  // Items without a block def or model go into an extra group at the end,
+  // since every item needs a key
+  const auto numItems = mSummaries.size();
+  const auto noBlockDefKey = numBlockDefs;
+  const auto noModelKey = mModelNames.size();
+
+  mItemsByType.build(NUM_ITEM_TYPES, numItems, [&](const size_t i) {
+    return size_t(mSummaries[i].mType);
+  });
+  mItemsByBlockDef.build(numBlockDefs + 1, numItems, [&](const size_t i) {
+    const auto& summary = mSummaries[i];
+    return summary.mType != ItemType::Model ? size_t(summary.mKey)
+                                            : noBlockDefKey;
+  });
+  mItemsByModel.build(noModelKey + 1, numItems, [&](const size_t i) {
+    const auto& summary = mSummaries[i];
+    return summary.mType == ItemType::Model ? size_t(summary.mKey)
+                                            : noModelKey;
+  });
+  mItemsByCell.build(NUM_CELL_KEYS, numItems, [&](const size_t i) {
+    return cellKey(mSummaries[i].mX, mSummaries[i].mY);
+  });
+
+  applyFilter();
+}
+
+
+void ItemInspector::applyFilter()
+{
+  mAppliedFilter = mFilter;
+  mFilteredItems.clear();
+
+  const auto& area = mFilter.mArea;
+  mAreaBounds = {
+    std::clamp(std::min(area[0], area[2]), 0, MAP_SIZE - 1),
+    std::clamp(std::min(area[1], area[3]), 0, MAP_SIZE - 1),
+    std::clamp(std::max(area[0], area[2]), 0, MAP_SIZE - 1),
+    std::clamp(std::max(area[1], area[3]), 0, MAP_SIZE - 1)};
+
+  if (!mpMap)
+  {
+    return;
+  }
+
+  // Each active filter narrows down the candidates to a few index ranges.
+  // Only the smallest set of candidates is scanned, with the remaining
+  // filters checked per item.
+  using Ranges = std::vector<base::ArrayView<uint32_t>>;
+
+  auto countItems = [](const Ranges& ranges) {
+    auto count = std::size_t(0);
+
+    for (const auto& range : ranges)
+    {
+      count += range.size();
+    }
+
+    return count;
+  };
+
+  Ranges candidates;
+
+  for (auto type = 0; type < NUM_ITEM_TYPES; ++type)
+  {
+    if (mFilter.mTypes[type])
+    {
+      candidates.push_back(mItemsByType.items(type));
+    }
+  }
+
+  auto candidateCount = countItems(candidates);
+
+  auto consider = [&](Ranges&& ranges) {
+    const auto count = countItems(ranges);
+
+    if (count < candidateCount)
+    {
+      candidates = std::move(ranges);
+      candidateCount = count;
+    }
+  };
+
+  if (mFilter.mFilterBlockDef)
+  {
+    if (mFilter.mBlockDef >= 0)
+    {
+      consider({mItemsByBlockDef.items(size_t(mFilter.mBlockDef))});
+    }
+    else
+    {
+      consider({});
+    }
+  }
+
+  if (mFilter.mFilterModel)
+  {
+    if (mFilter.mModelId >= 0 && size_t(mFilter.mModelId) < mModelNames.size())
+    {
+      consider({mItemsByModel.items(size_t(mFilter.mModelId))});
+    }
+    else
+    {
+      consider({});
+    }
+  }
+
+  if (mFilter.mFilterArea)
+  {
+    Ranges rows;
+
+    for (auto y = mAreaBounds[1]; y <= mAreaBounds[3]; ++y)
+    {
+      rows.push_back(mItemsByCell.itemsInRange(
+        cellKey(mAreaBounds[0], y), cellKey(mAreaBounds[2], y) + 1));
+    }
+
+    consider(std::move(rows));
+  }
+
+  mFilteredItems.reserve(candidateCount);
+
+  for (const auto& range : candidates)
+  {
+    for (const auto itemIndex : range)
+    {
+      if (matches(mSummaries[itemIndex]))
+      {
+        mFilteredItems.push_back(itemIndex);
+      }
+    }
+  }
+
+  // Candidates from multiple ranges aren't in item order
+  if (candidates.size() > 1)
+  {
+    std::sort(mFilteredItems.begin(), mFilteredItems.end());
+  }
+}
+
+
+bool ItemInspector::matches(const ItemSummary& item) const
+{
+  const auto& filter = mAppliedFilter;
+
+  if (!filter.mTypes[size_t(item.mType)])
+  {
+    return false;
+  }
+
+  if (
+    filter.mFilterBlockDef &&
+    (item.mType == ItemType::Model ||
+     int64_t(item.mKey) != int64_t(filter.mBlockDef)))
+  {
+    return false;
+  }
+
+  if (
+    filter.mFilterModel &&
+    (item.mType != ItemType::Model ||
+     int64_t(item.mKey) != int64_t(filter.mModelId)))
+  {
+    return false;
+  }
+
+  if (filter.mFilterArea)
+  {
+    return item.mX >= mAreaBounds[0] && item.mY >= mAreaBounds[1] &&
+      item.mX <= mAreaBounds[2] && item.mY <= mAreaBounds[3];
+  }
+
+  return true;
+}
+
+
+glm::vec3 ItemInspector::itemPosition(const uint32_t itemIndex) const
+{
+  return base::match(
+    mpMap->mItems[itemIndex],
+    [](const ExtraTerrainTile& tile) {
+      return cellCenter(tile, tile.vertexCoordinatesY[0] / -256.0f);
+    },
+    [](const BlockInstance& block) {
+      return cellCenter(block, block.verticalOffset / -256.0f);
+    },
+    [](const ModelInstance& model) {
+      return cellCenter(model, model.verticalOffset / -256.0f);
+    });
+}
+
+
+void ItemInspector::showItemDetails(const uint32_t itemIndex) const
+{
+  base::match(
+    mpMap->mItems[itemIndex],
+    [](const ExtraTerrainTile& tile) {
+      ImGui::Text(
+        "Block def %u, rotation %d",
+        tile.blockDefIndex,
+        int(tile.flags.rotation()));
+    },
+    [](const BlockInstance& block) {
+      ImGui::Text(
+        "Block def %u, rotation %d, offset %d",
+        block.blockDefIndex,
+        int(block.flags.rotation()),
+        int(block.verticalOffset));
+    },
+    [](const ModelInstance& model) {
+      ImGui::Text(
+        "%s, scale %u, offset %d",
+        model.modelName.c_str(),
+        unsigned(model.scale),
+        int(model.verticalOffset));
+    });
+}
+
+
+void ItemInspector::showFilterControls()
+{
+  for (auto type = 0; type < NUM_ITEM_TYPES; ++type)
+  {
+    if (type > 0)
+    {
+      ImGui::SameLine();
+    }
+
+    ImGui::Checkbox(ITEM_TYPE_NAMES[type], &mFilter.mTypes[type]);
+  }
+
+  ImGui::Checkbox("Block def", &mFilter.mFilterBlockDef);
+  ImGui::SameLine();
+  ImGui::SetNextItemWidth(120);
+  ImGui::InputInt("##blockDef", &mFilter.mBlockDef);
+
+  ImGui::Checkbox("Model", &mFilter.mFilterModel);
+  ImGui::SameLine();
+  ImGui::SetNextItemWidth(200);
+
+  const auto hasModel = mFilter.mModelId >= 0 &&
+    size_t(mFilter.mModelId) < mModelNames.size();
+  const auto pPreview =
+    hasModel ? mModelNames[size_t(mFilter.mModelId)].c_str() : "";
+
+  if (ImGui::BeginCombo("##model", pPreview))
+  {
+    ImGuiListClipper clipper;
+    clipper.Begin(int(mModelNames.size()));
+
+    while (clipper.Step())
+    {
+      for (auto i = clipper.DisplayStart; i < clipper.DisplayEnd; ++i)
+      {
+        if (ImGui::Selectable(
+              mModelNames[size_t(i)].c_str(), i == mFilter.mModelId))
+        {
+          mFilter.mModelId = i;
+          mFilter.mFilterModel = true;
+        }
+      }
+    }
+
+    ImGui::EndCombo();
+  }
+
+  ImGui::Checkbox("Area", &mFilter.mFilterArea);
+  ImGui::SameLine();
+  ImGui::SetNextItemWidth(240);
+  ImGui::InputInt4("##area", mFilter.mArea.data());
+}
+
+
+std::optional<glm::vec3> ItemInspector::updateAndRender(bool* pIsOpen)
+{
+  ImGui::SetNextWindowSize({520, 480}, ImGuiCond_FirstUseEver);
+
+  if (!ImGui::Begin("Items", pIsOpen))
+  {
+    ImGui::End();
+    return {};
+  }
+
+  if (!mpMap)
+  {
+    ImGui::TextDisabled("No map loaded");
+    ImGui::End();
+    return {};
+  }
+
+  showFilterControls();
+
+  if (mFilter != mAppliedFilter)
+  {
+    applyFilter();
+  }
+
+  ImGui::Text("%zu of %zu items", mFilteredItems.size(), mSummaries.size());
+
+  std::optional<glm::vec3> oFocusPosition;
+
+  const auto tableFlags = ImGuiTableFlags_ScrollY | ImGuiTableFlags_RowBg |
+    ImGuiTableFlags_Borders | ImGuiTableFlags_Resizable;
+
+  if (ImGui::BeginTable("##items", 5, tableFlags))
+  {
+    ImGui::TableSetupScrollFreeze(0, 1);
+    ImGui::TableSetupColumn("#");
+    ImGui::TableSetupColumn("Type");
+    ImGui::TableSetupColumn("X");
+    ImGui::TableSetupColumn("Y");
+    ImGui::TableSetupColumn("Details", ImGuiTableColumnFlags_WidthStretch);
+    ImGui::TableHeadersRow();
+
+    ImGuiListClipper clipper;
+    clipper.Begin(int(mFilteredItems.size()));
+
+    while (clipper.Step())
+    {
+      for (auto row = clipper.DisplayStart; row < clipper.DisplayEnd; ++row)
+      {
+        const auto itemIndex = mFilteredItems[size_t(row)];
+        const auto& summary = mSummaries[itemIndex];
+
+        ImGui::TableNextRow();
+        ImGui::TableNextColumn();
+
+        char label[16];
+        std::snprintf(label, sizeof(label), "%u", itemIndex);
+
+        if (ImGui::Selectable(
+              label,
+              moSelectedItem == itemIndex,
+              ImGuiSelectableFlags_SpanAllColumns))
+        {
+          moSelectedItem = itemIndex;
+          oFocusPosition = itemPosition(itemIndex);
+        }
+
+        ImGui::TableNextColumn();
+        ImGui::TextUnformatted(ITEM_TYPE_NAMES[size_t(summary.mType)]);
+        ImGui::TableNextColumn();
+        ImGui::Text("%u", unsigned(summary.mX));
+        ImGui::TableNextColumn();
+        ImGui::Text("%u", unsigned(summary.mY));
+        ImGui::TableNextColumn();
+        showItemDetails(itemIndex);
+      }
+    }
+
+    ImGui::EndTable();
+  }
+
+  ImGui::End();
+  return oFocusPosition;
+}
+
+} // namespace saucer
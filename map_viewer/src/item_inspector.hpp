@@ -0,0 +1,172 @@
+/* Copyright (C) 2024, Nikolai Wuttke. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "map_file.hpp"
+
+#include <rigel/base/array_view.hpp>
+#include <rigel/base/warnings.hpp>
+
+RIGEL_DISABLE_WARNINGS
+#include <glm/vec3.hpp>
+RIGEL_RESTORE_WARNINGS
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+
+namespace saucer
+{
+
+/** Groups item indices by an integer key, with items in ascending order
+ *
+ * All groups share a single array (compressed sparse row layout), so a
+ * group, or a run of consecutive groups, can be accessed as one contiguous
+ * range.
+ */
+class ItemIndex
+{
+public:
+  template <typename KeyFunc>
+  void build(std::size_t numKeys, std::size_t numItems, KeyFunc keyForItem);
+
+  rigel::base::ArrayView<uint32_t> items(std::size_t key) const
+  {
+    return itemsInRange(key, key + 1);
+  }
+
+  /** All items with keys in the range [firstKey, lastKey) */
+  rigel::base::ArrayView<uint32_t>
+    itemsInRange(std::size_t firstKey, std::size_t lastKey) const;
+
+private:
+  std::vector<uint32_t> mGroupStarts;
+  std::vector<uint32_t> mItems;
+};
+
+
+/** Panel listing a map's items, with filters
+ *
+ * The list only submits visible rows, and all filters are answered from
+ * indices built once when the map is set. Filtering starts from the most
+ * selective of the active filters' index ranges, and checks the remaining
+ * criteria against a compact per-item summary, so that even maps with
+ * millions of items can be filtered interactively.
+ */
+class ItemInspector
+{
+public:
+  /** Must be called before the currently set MapData is destroyed */
+  void setMap(const MapData* pMap);
+
+  /** Returns the selected item's position, if an item was clicked */
+  std::optional<glm::vec3> updateAndRender(bool* pIsOpen);
+
+private:
+  enum class ItemType : uint8_t
+  {
+    ExtraTerrain,
+    Block,
+    Model
+  };
+
+  static constexpr auto NUM_ITEM_TYPES = 3;
+
+  /** Everything needed for checking filters, without touching MapData */
+  struct ItemSummary
+  {
+    uint16_t mX;
+    uint16_t mY;
+    ItemType mType;
+
+    // Block def index for terrain and blocks, model ID for models
+    uint32_t mKey;
+  };
+
+  struct Filter
+  {
+    std::array<bool, NUM_ITEM_TYPES> mTypes{true, true, true};
+    bool mFilterBlockDef = false;
+    int mBlockDef = 0;
+    bool mFilterModel = false;
+    int mModelId = 0;
+    bool mFilterArea = false;
+    std::array<int, 4> mArea{0, 0, MAP_SIZE - 1, MAP_SIZE - 1};
+
+    bool operator==(const Filter& other) const;
+    bool operator!=(const Filter& other) const { return !(*this == other); }
+  };
+
+  void showFilterControls();
+  void applyFilter();
+  bool matches(const ItemSummary& item) const;
+  void showItemDetails(uint32_t itemIndex) const;
+  glm::vec3 itemPosition(uint32_t itemIndex) const;
+
+  const MapData* mpMap = nullptr;
+
+  std::vector<ItemSummary> mSummaries;
+  std::vector<std::string> mModelNames;
+  ItemIndex mItemsByType;
+  ItemIndex mItemsByBlockDef;
+  ItemIndex mItemsByModel;
+  ItemIndex mItemsByCell;
+
+  Filter mFilter;
+  Filter mAppliedFilter;
+
+  // Applied area as min x, min y, max x, max y, clamped to the map
+  std::array<int, 4> mAreaBounds{};
+  std::vector<uint32_t> mFilteredItems;
+  std::optional<uint32_t> moSelectedItem;
+};
+
+
+template <typename KeyFunc>
+void ItemIndex::build(
+  const std::size_t numKeys,
+  const std::size_t numItems,
+  KeyFunc keyForItem)
+{
+  // Counting sort: count group sizes, turn them into start offsets, then
+  // place the items. Iterating in order keeps items sorted within groups.
+  mGroupStarts.assign(numKeys + 1, 0);
+
+  for (auto i = std::size_t(0); i < numItems; ++i)
+  {
+    ++mGroupStarts[keyForItem(i) + 1];
+  }
+
+  for (auto key = std::size_t(0); key < numKeys; ++key)
+  {
+    mGroupStarts[key + 1] += mGroupStarts[key];
+  }
+
+  auto nextSlots =
+    std::vector<uint32_t>(mGroupStarts.begin(), mGroupStarts.end() - 1);
+  mItems.resize(numItems);
+
+  for (auto i = std::size_t(0); i < numItems; ++i)
+  {
+    mItems[nextSlots[keyForItem(i)]++] = uint32_t(i);
+  }
+}
+
+} // namespace saucer
@@ -0,0 +1,264 @@
+/* Copyright (C) 2024, Nikolai Wuttke. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "level_hashes.hpp"
+
+#include "map_file.hpp"
+#include "map_renderer.hpp"
+#include "test_level.hpp"
+
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <sstream>
+#include <string>
+
+
+namespace saucer
+{
+
+namespace
+{
+
+using LevelHashes = std::map<std::string, std::uint64_t>;
+
+
+// Name of the generated test level in golden files
+constexpr auto TEST_LEVEL_NAME = "test_level";
+
+
+/** Build options used for hashing
+ *
+ * All optional baking steps are enabled so that they are covered by the
+ * hash, and the bake cache is bypassed so that its contents can't affect
+ * the result.
+ */
+LevelBuildOptions hashingBuildOptions()
+{
+  LevelBuildOptions options;
+  options.mCompressTextures = true;
+  options.mAmbientOcclusion = true;
+  options.mUseBakeCache = false;
+  return options;
+}
+
+
+/** Builds level data for each map in turn, and hashes it
+ *
+ * Only one level is kept in memory at a time. Maps which fail to load are
+ * left out of the result.
+ */
+std::optional<LevelHashes>
+  computeLevelHashes(const std::filesystem::path& mapDirectory)
+{
+  const auto mapFiles = findMapFiles(mapDirectory);
+
+  if (mapFiles.empty())
+  {
+    std::fprintf(
+      stderr, "No map files found in '%s'\n", mapDirectory.u8string().c_str());
+    return {};
+  }
+
+  LevelHashes hashes;
+
+  const auto options = hashingBuildOptions();
+
+  for (const auto& mapFile : mapFiles)
+  {
+    if (const auto oLevel = loadLevelData(mapFile, options))
+    {
+      hashes[mapFile.filename().u8string()] = oLevel->contentHash();
+    }
+  }
+
+  return hashes;
+}
+
+
+LevelHashes computeTestLevelHash()
+{
+  const auto testLevel = makeTestLevel();
+  const auto level =
+    buildLevelData(testLevel.mMap, testLevel.mWad, hashingBuildOptions());
+
+  return {{TEST_LEVEL_NAME, level.contentHash()}};
+}
+
+
+std::optional<LevelHashes>
+  readGoldenFile(const std::filesystem::path& goldenFile)
+{
+  std::ifstream file(goldenFile);
+
+  if (!file)
+  {
+    std::fprintf(
+      stderr,
+      "Failed to open golden file '%s'\n",
+      goldenFile.u8string().c_str());
+    return {};
+  }
+
+  LevelHashes hashes;
+
+  std::string line;
+
+  while (std::getline(file, line))
+  {
+    std::istringstream lineStream(line);
+
+    std::string mapName;
+    std::string hashText;
+
+    if (!(lineStream >> mapName) || mapName[0] == '#')
+    {
+      continue;
+    }
+
+    lineStream >> hashText;
+
+    try
+    {
+      hashes[mapName] = std::stoull(hashText, nullptr, 16);
+    }
+    catch (const std::exception&)
+    {
+      std::fprintf(
+        stderr,
+        "Invalid hash '%s' for '%s'\n",
+        hashText.c_str(),
+        mapName.c_str());
+      return {};
+    }
+  }
+
+  return hashes;
+}
+
+
+void printHashes(const LevelHashes& hashes)
+{
+  for (const auto& [mapName, hash] : hashes)
+  {
+    std::printf("%s %016" PRIx64 "\n", mapName.c_str(), hash);
+  }
+}
+
+
+/** Reports all mismatches, returns the process exit code */
+int compareHashes(const LevelHashes& expected, const LevelHashes& actual)
+{
+  auto numMismatches = 0;
+
+  for (const auto& [mapName, expectedHash] : expected)
+  {
+    const auto iActual = actual.find(mapName);
+
+    if (iActual == actual.end())
+    {
+      std::printf("%s: missing, or failed to load\n", mapName.c_str());
+      ++numMismatches;
+    }
+    else if (iActual->second != expectedHash)
+    {
+      std::printf(
+        "%s: expected %016" PRIx64 ", got %016" PRIx64 "\n",
+        mapName.c_str(),
+        expectedHash,
+        iActual->second);
+      ++numMismatches;
+    }
+  }
+
+  for (const auto& [mapName, hash] : actual)
+  {
+    if (!expected.count(mapName))
+    {
+      std::printf("%s: not in golden file\n", mapName.c_str());
+      ++numMismatches;
+    }
+  }
+
+  if (numMismatches > 0)
+  {
+    std::printf("%d mismatches\n", numMismatches);
+    return 1;
+  }
+
+  std::printf("All %zu levels match\n", actual.size());
+  return 0;
+}
+
+} // namespace
+
+
+int printLevelHashes(const std::filesystem::path& mapDirectory)
+{
+  const auto oHashes = computeLevelHashes(mapDirectory);
+
+  if (!oHashes)
+  {
+    return 1;
+  }
+
+  printHashes(*oHashes);
+  return 0;
+}
+
+
+int verifyLevelHashes(
+  const std::filesystem::path& mapDirectory,
+  const std::filesystem::path& goldenFile)
+{
+  const auto oExpected = readGoldenFile(goldenFile);
+  const auto oActual = oExpected ? computeLevelHashes(mapDirectory)
+                                 : std::optional<LevelHashes>{};
+
+  if (!oExpected || !oActual)
+  {
+    return 1;
+  }
+
+  return compareHashes(*oExpected, *oActual);
+}
+
+
+int printTestLevelHash()
+{
+  printHashes(computeTestLevelHash());
+  return 0;
+}
+
+
+int verifyTestLevelHash(const std::filesystem::path& goldenFile)
+{
+  const auto oExpected = readGoldenFile(goldenFile);
+
+  if (!oExpected)
+  {
+    return 1;
+  }
+
+  return compareHashes(*oExpected, computeTestLevelHash());
+}
+
+} // namespace saucer
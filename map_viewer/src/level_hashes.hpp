@@ -0,0 +1,60 @@
+/* Copyright (C) 2024, Nikolai Wuttke. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <filesystem>
+
+
+namespace saucer
+{
+
+/** Prints a hash of the level data built for each map in the given directory
+ *
+ * Output is one line per map, with the map's file name followed by its hash
+ * as a hexadecimal number. This is also the format expected by
+ * verifyLevelHashes, so the output can be saved as a golden file. Golden
+ * files may additionally contain comment lines starting with '#'.
+ * Returns the process exit code.
+ */
+int printLevelHashes(const std::filesystem::path& mapDirectory);
+
+
+/** Checks level data for all maps in the directory against a golden file
+ *
+ * Meant for verifying that changes to mesh or texture atlas generation don't
+ * alter their output. Reports all mismatches, including maps which only
+ * appear on one side. Returns the process exit code, which is non-zero if
+ * there were any mismatches.
+ */
+int verifyLevelHashes(
+  const std::filesystem::path& mapDirectory,
+  const std::filesystem::path& goldenFile);
+
+
+/** Like printLevelHashes, for the generated test level
+ *
+ * See makeTestLevel(). Unlike the game's maps, the test level is always
+ * available, which makes it suitable for automated tests.
+ */
+int printTestLevelHash();
+
+
+/** Like verifyLevelHashes, for the generated test level */
+int verifyTestLevelHash(const std::filesystem::path& goldenFile);
+
+} // namespace saucer
@@ -0,0 +1,308 @@
+/* Copyright (C) 2024, Nikolai Wuttke. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "level_statistics.hpp"
+
+#include <rigel/base/warnings.hpp>
+
+RIGEL_DISABLE_WARNINGS
+#include <imgui.h>
+RIGEL_RESTORE_WARNINGS
+
+#include <algorithm>
+#include <cfloat>
+#include <numeric>
+
+
+namespace saucer
+{
+
+namespace
+{
+
+constexpr auto NUM_TOP_ENTRIES = std::size_t(10);
+
+
+std::size_t texelArea(const TextureDef& textureDef)
+{
+  auto minU = 255, maxU = 0, minV = 255, maxV = 0;
+
+  for (const auto& uv : textureDef.uvs)
+  {
+    minU = std::min(minU, int(uv.u));
+    maxU = std::max(maxU, int(uv.u));
+    minV = std::min(minV, int(uv.v));
+    maxV = std::max(maxV, int(uv.v));
+  }
+
+  // UVs address texel centers, see getTexCoords()
+  return std::size_t(maxU - minU + 1) * std::size_t(maxV - minV + 1);
+}
+
+
+std::size_t numUsed(const std::vector<uint32_t>& usage)
+{
+  return std::size_t(
+    std::count_if(usage.begin(), usage.end(), [](const uint32_t count) {
+      return count > 0;
+    }));
+}
+
+
+/** Lists the definitions used most often, in descending order */
+void showTopUsage(const char* label, const std::vector<uint32_t>& usage)
+{
+  std::vector<uint32_t> indices(usage.size());
+  std::iota(indices.begin(), indices.end(), 0u);
+
+  const auto numShown = std::min(NUM_TOP_ENTRIES, indices.size());
+  std::partial_sort(
+    indices.begin(),
+    indices.begin() + numShown,
+    indices.end(),
+    [&](const uint32_t lhs, const uint32_t rhs) {
+      return usage[lhs] > usage[rhs];
+    });
+
+  ImGui::Text("%s", label);
+
+  for (auto i = std::size_t(0); i < numShown; ++i)
+  {
+    if (usage[indices[i]] == 0)
+    {
+      break;
+    }
+
+    ImGui::Text("  #%u: %u", indices[i], usage[indices[i]]);
+  }
+}
+
+
+void showDetails(const LevelStatistics& statistics)
+{
+  constexpr auto BYTES_PER_MB = 1024.0 * 1024.0;
+
+  ImGui::Text(
+    "Items: %zu terrain tiles, %zu extra terrain tiles, %zu blocks, "
+    "%zu models, %zu camera positions",
+    statistics.mNumTerrainTiles,
+    statistics.mNumExtraTerrainTiles,
+    statistics.mNumBlocks,
+    statistics.mNumModels,
+    statistics.mNumCameraPositions);
+  ImGui::Text(
+    "Triangles: %zu terrain, %zu extra terrain, %zu blocks, "
+    "%zu block interiors, %zu models",
+    statistics.mNumTerrainTriangles,
+    statistics.mNumExtraTerrainTriangles,
+    statistics.mNumBlockTriangles,
+    statistics.mNumBlockInteriorTriangles,
+    statistics.mNumModelTriangles);
+  ImGui::Text(
+    "Atlas: %zu pages, %.1f%% of world pages used",
+    statistics.mNumAtlasPages,
+    statistics.atlasUtilization() * 100.0f);
+  ImGui::Text(
+    "Memory: %.1f MB", double(statistics.mMemoryUsage) / BYTES_PER_MB);
+
+  ImGui::Spacing();
+  ImGui::Text(
+    "Texture def usage (%zu of %zu used)",
+    statistics.numTextureDefsUsed(),
+    statistics.mTextureDefUsage.size());
+
+  std::vector<float> histogram(
+    statistics.mTextureDefUsage.begin(), statistics.mTextureDefUsage.end());
+  ImGui::PlotHistogram(
+    "##textureDefUsage",
+    histogram.data(),
+    int(histogram.size()),
+    0,
+    nullptr,
+    0.0f,
+    FLT_MAX,
+    ImVec2(-1.0f, 80.0f));
+
+  showTopUsage("Most used texture defs:", statistics.mTextureDefUsage);
+  ImGui::Spacing();
+  showTopUsage("Most used block defs:", statistics.mBlockDefUsage);
+}
+
+} // namespace
+
+
+void LevelStatistics::reset(const MapData& map)
+{
+  *this = LevelStatistics{};
+
+  mBlockDefUsage.assign(map.mBlockDefs.size(), 0);
+  mTextureDefUsage.assign(map.mTextureDefs.size(), 0);
+  mNumCameraPositions = map.mCameraPositions.size();
+}
+
+
+void LevelStatistics::addBlockDefUse(const uint32_t blockDefIndex)
+{
+  if (blockDefIndex < mBlockDefUsage.size())
+  {
+    ++mBlockDefUsage[blockDefIndex];
+  }
+}
+
+
+void LevelStatistics::addTextureDefUse(
+  const MapData& map,
+  const uint16_t texture)
+{
+  if (texture == 0 || texture >= mTextureDefUsage.size())
+  {
+    return;
+  }
+
+  // A texture def's texels only count once, no matter how often it's used
+  if (mTextureDefUsage[texture]++ == 0)
+  {
+    mNumUsedAtlasTexels += texelArea(map.mTextureDefs[texture]);
+  }
+}
+
+
+std::size_t LevelStatistics::numBlockDefsUsed() const
+{
+  return numUsed(mBlockDefUsage);
+}
+
+
+std::size_t LevelStatistics::numTextureDefsUsed() const
+{
+  return numUsed(mTextureDefUsage);
+}
+
+
+std::size_t LevelStatistics::numTriangles() const
+{
+  return mNumTerrainTriangles + mNumExtraTerrainTriangles +
+    mNumBlockTriangles + mNumBlockInteriorTriangles + mNumModelTriangles;
+}
+
+
+float LevelStatistics::atlasUtilization() const
+{
+  if (mNumWorldAtlasTexels == 0)
+  {
+    return 0.0f;
+  }
+
+  return std::min(
+    float(mNumUsedAtlasTexels) / float(mNumWorldAtlasTexels), 1.0f);
+}
+
+
+void LevelStatisticsPanel::updateAndRender(
+  bool* pIsOpen,
+  const std::vector<NamedLevelStatistics>& levels)
+{
+  constexpr auto BYTES_PER_MB = 1024.0 * 1024.0;
+
+  ImGui::SetNextWindowSize({640, 480}, ImGuiCond_FirstUseEver);
+
+  if (!ImGui::Begin("Level statistics", pIsOpen))
+  {
+    ImGui::End();
+    return;
+  }
+
+  if (levels.empty())
+  {
+    ImGui::TextDisabled("No levels loaded");
+    ImGui::End();
+    return;
+  }
+
+  const LevelStatistics* pSelected = nullptr;
+
+  const auto tableFlags = ImGuiTableFlags_ScrollY | ImGuiTableFlags_RowBg |
+    ImGuiTableFlags_Borders | ImGuiTableFlags_Resizable;
+  const auto tableHeight = ImGui::GetContentRegionAvail().y * 0.4f;
+
+  if (ImGui::BeginTable("##levels", 7, tableFlags, ImVec2(0, tableHeight)))
+  {
+    ImGui::TableSetupScrollFreeze(0, 1);
+    ImGui::TableSetupColumn("Level", ImGuiTableColumnFlags_WidthStretch);
+    ImGui::TableSetupColumn("Items");
+    ImGui::TableSetupColumn("Block defs");
+    ImGui::TableSetupColumn("Texture defs");
+    ImGui::TableSetupColumn("Triangles");
+    ImGui::TableSetupColumn("Atlas");
+    ImGui::TableSetupColumn("Memory");
+    ImGui::TableHeadersRow();
+
+    for (const auto& level : levels)
+    {
+      const auto& statistics = *level.mpStatistics;
+      const auto isSelected = level.mName == mSelectedLevel;
+
+      if (isSelected)
+      {
+        pSelected = &statistics;
+      }
+
+      ImGui::TableNextRow();
+      ImGui::TableNextColumn();
+
+      if (ImGui::Selectable(
+            level.mName.c_str(),
+            isSelected,
+            ImGuiSelectableFlags_SpanAllColumns))
+      {
+        mSelectedLevel = level.mName;
+        pSelected = &statistics;
+      }
+
+      ImGui::TableNextColumn();
+      ImGui::Text(
+        "%zu",
+        statistics.mNumTerrainTiles + statistics.mNumExtraTerrainTiles +
+          statistics.mNumBlocks + statistics.mNumModels);
+      ImGui::TableNextColumn();
+      ImGui::Text("%zu", statistics.numBlockDefsUsed());
+      ImGui::TableNextColumn();
+      ImGui::Text("%zu", statistics.numTextureDefsUsed());
+      ImGui::TableNextColumn();
+      ImGui::Text("%zu", statistics.numTriangles());
+      ImGui::TableNextColumn();
+      ImGui::Text("%.0f%%", statistics.atlasUtilization() * 100.0f);
+      ImGui::TableNextColumn();
+      ImGui::Text("%.1f MB", double(statistics.mMemoryUsage) / BYTES_PER_MB);
+    }
+
+    ImGui::EndTable();
+  }
+
+  if (pSelected)
+  {
+    showDetails(*pSelected);
+  }
+  else
+  {
+    ImGui::TextDisabled("Select a level for details");
+  }
+
+  ImGui::End();
+}
+
+} // namespace saucer
@@ -0,0 +1,107 @@
+/* Copyright (C) 2024, Nikolai Wuttke. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "map_file.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+namespace saucer
+{
+
+/** Aggregate numbers describing a level's content
+ *
+ * Filled in while building the level data, by the passes over the terrain
+ * grid and item list that build the meshes anyway.
+ */
+struct LevelStatistics
+{
+  /** Sizes the per-definition counts, and takes counts stored in the map */
+  void reset(const MapData& map);
+
+  void addBlockDefUse(uint32_t blockDefIndex);
+  void addTextureDefUse(const MapData& map, uint16_t texture);
+
+  std::size_t numBlockDefsUsed() const;
+  std::size_t numTextureDefsUsed() const;
+  std::size_t numTriangles() const;
+
+  /** Part of the world texture pages covered by texture defs in use */
+  float atlasUtilization() const;
+
+  // Terrain and extra terrain tiles without a texture aren't visible, and
+  // not counted
+  std::size_t mNumTerrainTiles = 0;
+  std::size_t mNumExtraTerrainTiles = 0;
+  std::size_t mNumBlocks = 0;
+  std::size_t mNumModels = 0;
+  std::size_t mNumCameraPositions = 0;
+
+  /** Number of terrain tiles, extra terrain tiles and blocks per block def */
+  std::vector<uint32_t> mBlockDefUsage;
+
+  /** Number of terrain and block faces per texture def
+   *
+   * Models use the WAD's texture defs, and are not included.
+   */
+  std::vector<uint32_t> mTextureDefUsage;
+
+  std::size_t mNumTerrainTriangles = 0;
+  std::size_t mNumExtraTerrainTriangles = 0;
+  std::size_t mNumBlockTriangles = 0;
+  std::size_t mNumBlockInteriorTriangles = 0;
+  std::size_t mNumModelTriangles = 0;
+
+  std::size_t mNumAtlasPages = 0;
+  std::size_t mNumWorldAtlasTexels = 0;
+
+  // Texture defs may overlap, so this can exceed the number of texels
+  std::size_t mNumUsedAtlasTexels = 0;
+
+  /** See LevelData::estimatedMemoryUsage() */
+  std::size_t mMemoryUsage = 0;
+};
+
+
+struct NamedLevelStatistics
+{
+  std::string mName;
+  const LevelStatistics* mpStatistics;
+};
+
+
+/** Panel comparing the statistics of all loaded levels
+ *
+ * Selecting a level shows details, like which definitions are used most.
+ */
+class LevelStatisticsPanel
+{
+public:
+  void updateAndRender(
+    bool* pIsOpen,
+    const std::vector<NamedLevelStatistics>& levels);
+
+private:
+  std::string mSelectedLevel;
+};
+
+} // namespace saucer
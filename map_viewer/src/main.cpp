@@ -14,7 +14,9 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include "level_hashes.hpp"
 #include "map_viewer_app.hpp"
+#include "render_check.hpp"
 
 #include <rigel/base/warnings.hpp>
 #include <rigel/bootstrap.hpp>
@@ -31,12 +33,48 @@ RIGEL_RESTORE_WARNINGS
 int main(int argc, char** argv)
 {
   std::string mapFile;
+  std::string hashesMapDirectory;
+  std::string goldenHashesFile;
+  bool testLevelHash = false;
+  std::string renderCheckMapDirectory;
+  std::string goldenImageDirectory;
+  bool updateGoldenImages = false;
 
   const auto maybeErrorCode = rigel::parseArgs(
     argc,
     argv,
-    [&mapFile](lyra::cli& argsParser) {
+    [&](lyra::cli& argsParser) {
       argsParser |= lyra::arg(mapFile, "map file to load");
+      argsParser |= lyra::opt(hashesMapDirectory, "map directory")
+                      .name("--level-hashes")
+                      .help(
+                        "Print hashes of the level data built for all maps "
+                        "in the given directory, then exit");
+      argsParser |= lyra::opt(testLevelHash)
+                      .name("--test-level-hash")
+                      .help(
+                        "Print the hash of the level data built for a "
+                        "generated test level, then exit");
+      argsParser |= lyra::opt(goldenHashesFile, "golden file")
+                      .name("--verify-against")
+                      .help(
+                        "Together with --level-hashes or --test-level-hash: "
+                        "Compare against the hashes in the given file instead "
+                        "of printing them");
+      argsParser |= lyra::opt(renderCheckMapDirectory, "map directory")
+                      .name("--render-check")
+                      .help(
+                        "Render fixed views of all maps in the given "
+                        "directory, compare them to golden images, then exit");
+      argsParser |= lyra::opt(goldenImageDirectory, "directory")
+                      .name("--golden-images")
+                      .help(
+                        "Directory holding golden images for --render-check");
+      argsParser |= lyra::opt(updateGoldenImages)
+                      .name("--update-golden")
+                      .help(
+                        "Together with --render-check: Save missing or "
+                        "mismatching golden images instead of failing");
     },
     []() { return true; });
 
@@ -45,6 +83,28 @@ int main(int argc, char** argv)
     return *maybeErrorCode;
   }
 
+  // Runs without creating a window, so that it also works on build servers
+  if (!hashesMapDirectory.empty())
+  {
+    return goldenHashesFile.empty()
+      ? saucer::printLevelHashes(hashesMapDirectory)
+      : saucer::verifyLevelHashes(hashesMapDirectory, goldenHashesFile);
+  }
+
+  if (testLevelHash)
+  {
+    return goldenHashesFile.empty()
+      ? saucer::printTestLevelHash()
+      : saucer::verifyTestLevelHash(goldenHashesFile);
+  }
+
+
+  if (!renderCheckMapDirectory.empty() && goldenImageDirectory.empty())
+  {
+    std::fprintf(stderr, "--render-check requires --golden-images\n");
+    return 1;
+  }
+
 
   rigel::WindowConfig windowConfig;
   windowConfig.windowTitle = saucer::BASE_WINDOW_TITLE;
@@ -54,10 +114,18 @@ int main(int argc, char** argv)
   windowConfig.depthBufferBits = 24;
 
   std::optional<saucer::MapViewerApp> oMapViewer;
+  std::optional<int> oRenderCheckResult;
 
-  return rigel::runApp(
+  const auto result = rigel::runApp(
     windowConfig,
     [&](SDL_Window* pWindow) {
+      if (!renderCheckMapDirectory.empty())
+      {
+        oRenderCheckResult = saucer::runRenderCheck(
+          renderCheckMapDirectory, goldenImageDirectory, updateGoldenImages);
+        return;
+      }
+
       SDL_EnableScreenSaver();
       SDL_ShowCursor(SDL_ENABLE);
 
@@ -68,5 +136,14 @@ int main(int argc, char** argv)
         oMapViewer->loadMap(mapFile);
       }
     },
-    [&](SDL_Window*) { return oMapViewer->runOneFrame(); });
+    [&](SDL_Window*) {
+      if (oRenderCheckResult)
+      {
+        return false;
+      }
+
+      return oMapViewer->runOneFrame();
+    });
+
+  return oRenderCheckResult ? *oRenderCheckResult : result;
 }
@@ -16,8 +16,12 @@
 
 #include "map_file.hpp"
 
+#include "file_format_records.hpp"
+
 #include <rigel/base/binary_io.hpp>
+#include <rigel/base/string_utils.hpp>
 
+#include <algorithm>
 #include <fstream>
 #include <string_view>
 
@@ -40,29 +44,28 @@ std::optional<MapData>
   }
 
 
+  const auto header = readRecord<MapHeaderRecord>(f);
+
   {
-    char signature[4];
-    f.read(signature, sizeof(signature));
+    const auto signature = header.get<MapHeaderRecord::Signature>();
 
-    if (std::string_view(signature, sizeof(signature)) != "SUCK")
+    if (std::string_view(signature.data(), signature.size()) != "SUCK")
     {
       return {};
     }
 
-    const auto version = read<uint32_t>(f);
-
-    if (version != 40)
+    if (header.get<MapHeaderRecord::Version>() != 40)
     {
       return {};
     }
   }
 
-  const auto numTextureDefs = read<uint32_t>(f);
-  const auto numBlockDefs = read<uint32_t>(f);
-  const auto numUnknown = read<uint32_t>(f);
-  const auto numMapItems = read<uint32_t>(f);
-  const auto numTextureAnimations = read<uint32_t>(f);
-  skipBytes(f, sizeof(uint32_t) + 2 * sizeof(uint16_t));
+  const auto numTextureDefs = header.get<MapHeaderRecord::NumTextureDefs>();
+  const auto numBlockDefs = header.get<MapHeaderRecord::NumBlockDefs>();
+  const auto numUnknown = header.get<MapHeaderRecord::NumUnknown>();
+  const auto numMapItems = header.get<MapHeaderRecord::NumMapItems>();
+  const auto numTextureAnimations =
+    header.get<MapHeaderRecord::NumTextureAnimations>();
 
 
   // Skip imported texture page name list. The game has some code to
@@ -87,20 +90,23 @@ std::optional<MapData>
 
   for (auto& def : map.mBlockDefs)
   {
-    def.texturesInside.front = read<uint16_t>(f);
-    def.texturesInside.top = read<uint16_t>(f);
-    def.texturesInside.left = read<uint16_t>(f);
-    def.texturesInside.back = read<uint16_t>(f);
-    def.texturesInside.right = read<uint16_t>(f);
-    def.texturesInside.bottom = read<uint16_t>(f);
-    def.texturesOutside.back = read<uint16_t>(f);
-    def.texturesOutside.top = read<uint16_t>(f);
-    def.texturesOutside.left = read<uint16_t>(f);
-    def.texturesOutside.front = read<uint16_t>(f);
-    def.texturesOutside.right = read<uint16_t>(f);
-    def.texturesOutside.bottom = read<uint16_t>(f);
-    readArray(f, def.vertexCoordinatesY.data(), 8);
-    skipBytes(f, 20);
+    using Def = BlockDefRecord;
+
+    const auto record = readRecord<BlockDefRecord>(f);
+
+    def.texturesInside.front = record.get<Def::InsideFront>();
+    def.texturesInside.top = record.get<Def::InsideTop>();
+    def.texturesInside.left = record.get<Def::InsideLeft>();
+    def.texturesInside.back = record.get<Def::InsideBack>();
+    def.texturesInside.right = record.get<Def::InsideRight>();
+    def.texturesInside.bottom = record.get<Def::InsideBottom>();
+    def.texturesOutside.back = record.get<Def::OutsideBack>();
+    def.texturesOutside.top = record.get<Def::OutsideTop>();
+    def.texturesOutside.left = record.get<Def::OutsideLeft>();
+    def.texturesOutside.front = record.get<Def::OutsideFront>();
+    def.texturesOutside.right = record.get<Def::OutsideRight>();
+    def.texturesOutside.bottom = record.get<Def::OutsideBottom>();
+    def.vertexCoordinatesY = record.get<Def::VertexCoordinatesY>();
   }
 
 
@@ -162,9 +168,10 @@ std::optional<MapData>
 
   for (auto i = 0u; i < numMapItems; ++i)
   {
-    const auto x = read<uint32_t>(f) & 0xFFFF;
-    const auto y = read<uint32_t>(f) & 0xFFFF;
-    const auto typeFlags = read<uint32_t>(f);
+    const auto itemHeader = readRecord<MapItemHeaderRecord>(f);
+    const auto x = itemHeader.get<MapItemHeaderRecord::X>() & 0xFFFF;
+    const auto y = itemHeader.get<MapItemHeaderRecord::Y>() & 0xFFFF;
+    const auto typeFlags = itemHeader.get<MapItemHeaderRecord::TypeFlags>();
 
     const auto type = (typeFlags & 0x1BFC0000) >> 16;
 
@@ -172,14 +179,15 @@ std::optional<MapData>
     {
       case 0x4:
         {
+          using Tile = TerrainTileRecord;
+
           auto& tile = (*map.mpTerrain)[numTerrainTilesRead];
+          const auto record = readRecord<Tile>(f);
 
-          skipBytes(f, sizeof(uint32_t));
-          tile.blockDefIndex = read<uint32_t>(f);
-          tile.flags = read<uint8_t>(f);
-          skipBytes(f, 5);
-          tile.verticalOffset = read<int16_t>(f);
-          skipBytes(f, 4);
+          tile.blockDefIndex = record.get<Tile::BlockDefIndex>();
+          tile.flags = record.get<Tile::Flags>();
+          tile.brightnessAdjustment = record.get<Tile::BrightnessAdjustment>();
+          tile.verticalOffset = record.get<Tile::VerticalOffset>();
 
           ++numTerrainTilesRead;
         }
@@ -187,72 +195,87 @@ std::optional<MapData>
 
       case 0x8:
         {
+          using Tile = ExtraTerrainTileRecord;
+
+          const auto record = readRecord<Tile>(f);
+
           ExtraTerrainTile tile;
           tile.x = x;
           tile.y = y;
-
-          skipBytes(f, sizeof(uint32_t));
-          tile.blockDefIndex = read<uint32_t>(f);
-          tile.flags = read<uint8_t>(f);
-          skipBytes(f, 5);
-          readArray(f, tile.vertexCoordinatesY.data(), 4);
-          skipBytes(f, 2);
+          tile.blockDefIndex = record.get<Tile::BlockDefIndex>();
+          tile.flags = record.get<Tile::Flags>();
+          tile.brightnessAdjustment = record.get<Tile::BrightnessAdjustment>();
+          tile.vertexCoordinatesY = record.get<Tile::VertexCoordinatesY>();
 
           map.mItems.push_back(tile);
         }
         break;
 
       case 0x10:
-        skipBytes(f, 12);
+        skipBytes(f, BillboardRecord::Layout::SIZE);
         break;
 
       case 0x20:
-        skipBytes(f, 8);
+        skipBytes(f, UnknownItem0x20Record::Layout::SIZE);
         break;
 
       case 0x40:
         {
+          using Block = BlockInstanceRecord;
+
+          const auto record = readRecord<Block>(f);
+
           BlockInstance block;
           block.x = x;
           block.y = y;
-
-          skipBytes(f, sizeof(uint32_t));
-          block.blockDefIndex = read<uint32_t>(f);
-          block.flags = read<uint8_t>(f);
-          skipBytes(f, 5);
-          block.verticalOffset = read<int16_t>(f);
-          readArray(f, block.vertexOffsetsY.data(), 8);
+          block.blockDefIndex = record.get<Block::BlockDefIndex>();
+          block.flags = record.get<Block::Flags>();
+          block.brightnessAdjustment =
+            record.get<Block::BrightnessAdjustment>();
+          block.verticalOffset = record.get<Block::VerticalOffset>();
+          block.vertexOffsetsY = record.get<Block::VertexOffsetsY>();
 
           map.mItems.push_back(block);
         }
         break;
 
       case 0x100:
-        skipBytes(f, 8);
+        skipBytes(f, UnknownItem0x100Record::Layout::SIZE);
         break;
 
       case 0x200:
-        skipBytes(f, 32);
+        skipBytes(f, EntityRecord::Layout::SIZE);
         break;
 
       case 0x800:
-        skipBytes(f, 24);
+        {
+          skipBytes(f, CameraPositionRecord::Layout::SIZE);
+
+          CameraPosition camera;
+          camera.x = x;
+          camera.y = y;
+          map.mCameraPositions.push_back(camera);
+        }
         break;
 
       case 0x1000:
         {
+          using Model = ModelInstanceRecord;
+
+          const auto record = readRecord<Model>(f);
+
           ModelInstance model;
           model.x = x;
           model.y = y;
-
-          model.xOffset = read<uint8_t>(f);
-          model.yOffset = read<uint8_t>(f);
-          model.verticalOffset = read<int16_t>(f);
-          model.rotationX = read<uint16_t>(f);
-          model.rotationY = read<uint16_t>(f);
-          model.rotationZ = read<uint16_t>(f);
-          model.modelName = modelNameTable.at(read<uint32_t>(f));
-          model.scale = read<uint16_t>(f);
+          model.xOffset = record.get<Model::XOffset>();
+          model.yOffset = record.get<Model::YOffset>();
+          model.verticalOffset = record.get<Model::VerticalOffset>();
+          model.rotationX = record.get<Model::RotationX>();
+          model.rotationY = record.get<Model::RotationY>();
+          model.rotationZ = record.get<Model::RotationZ>();
+          model.modelName =
+            modelNameTable.at(record.get<Model::ModelIndex>());
+          model.scale = record.get<Model::Scale>();
 
           if (wad.mModels.count(model.modelName))
           {
@@ -269,4 +292,42 @@ std::optional<MapData>
   return map;
 }
 
+
+std::filesystem::path wadFileForMap(const std::filesystem::path& mapFile)
+{
+  const auto mapName = mapFile.stem().u8string();
+  const auto correspondingWadFilename = rigel::strings::toLowercase(mapName);
+
+  return mapFile.parent_path().parent_path() / "LEVELS" /
+    (correspondingWadFilename + ".wad");
+}
+
+
+std::vector<std::filesystem::path>
+  findMapFiles(const std::filesystem::path& directory)
+{
+  std::vector<std::filesystem::path> mapFiles;
+
+  std::error_code error;
+  for (const auto& entry :
+       std::filesystem::directory_iterator(directory, error))
+  {
+    const auto extension =
+      rigel::strings::toLowercase(entry.path().extension().u8string());
+
+    if (entry.is_regular_file() && extension == ".map")
+    {
+      mapFiles.push_back(entry.path());
+    }
+  }
+
+  if (error)
+  {
+    return {};
+  }
+
+  std::sort(mapFiles.begin(), mapFiles.end());
+  return mapFiles;
+}
+
 } // namespace saucer
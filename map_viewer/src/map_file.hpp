@@ -83,6 +83,7 @@ struct TerrainTile : MapItemCommon
 {
   uint32_t blockDefIndex;
   Flags flags;
+  int16_t brightnessAdjustment;
   int16_t verticalOffset;
 };
 
@@ -91,6 +92,7 @@ struct ExtraTerrainTile : MapItemCommon
 {
   uint32_t blockDefIndex;
   Flags flags;
+  int16_t brightnessAdjustment;
   std::array<int16_t, 4> vertexCoordinatesY;
 };
 
@@ -99,6 +101,7 @@ struct BlockInstance : MapItemCommon
 {
   uint32_t blockDefIndex;
   Flags flags;
+  int16_t brightnessAdjustment;
   int16_t verticalOffset;
   std::array<int8_t, 8> vertexOffsetsY;
 };
@@ -117,6 +120,16 @@ struct ModelInstance : MapItemCommon
 };
 
 
+/** Believed to be a predefined camera position
+ *
+ * Only the grid position is used, the meaning of the record's contents is
+ * still unknown.
+ */
+struct CameraPosition : MapItemCommon
+{
+};
+
+
 using TerrainGrid = std::array<TerrainTile, MAP_SIZE * MAP_SIZE>;
 using MapItem = std::variant<ExtraTerrainTile, BlockInstance, ModelInstance>;
 
@@ -127,6 +140,7 @@ struct MapData
   std::vector<BlockDef> mBlockDefs;
   std::unique_ptr<TerrainGrid> mpTerrain = std::make_unique<TerrainGrid>();
   std::vector<MapItem> mItems;
+  std::vector<CameraPosition> mCameraPositions;
 
   TerrainTile& terrainAt(int x, int y)
   {
@@ -143,4 +157,20 @@ struct MapData
 std::optional<MapData>
   loadMapfile(const std::filesystem::path& path, const WadData& wad);
 
+
+/** Returns the path of the WAD file belonging to the given map file
+ *
+ * Maps are stored in a MAPS directory, their WAD files in a LEVELS directory
+ * next to it.
+ */
+std::filesystem::path wadFileForMap(const std::filesystem::path& mapFile);
+
+
+/** Returns all map files in the given directory, sorted by path
+ *
+ * Returns an empty list if the directory can't be read.
+ */
+std::vector<std::filesystem::path>
+  findMapFiles(const std::filesystem::path& directory);
+
 } // namespace saucer
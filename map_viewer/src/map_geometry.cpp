@@ -0,0 +1,392 @@
+/* Copyright (C) 2024, Nikolai Wuttke. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "map_geometry.hpp"
+
+#include <algorithm>
+
+
+namespace saucer
+{
+
+namespace
+{
+
+MapVertex operator+(const MapVertex& lhs, const MapVertex& rhs)
+{
+  return {
+    lhs.x + rhs.x, lhs.y + rhs.y, lhs.verticalOffset + rhs.verticalOffset};
+}
+
+
+MapVertex operator*(const MapVertex& v, const int factor)
+{
+  return {v.x * factor, v.y * factor, v.verticalOffset * factor};
+}
+
+} // namespace
+
+
+Vertex makeVertex(
+  int x,
+  int y,
+  int verticalOffset,
+  const TexCoords& uv,
+  const TexRect& rect,
+  const VertexLighting& lighting)
+{
+  // The game uses grid coordinates alongside vertical offsets. We map
+  // grid X/Y coordinates to the X and Z axes in the OpenGL coordinate system,
+  // and the vertical dimension to OpenGL's Y axis.
+  // We also define a grid cell to be 1.0 in size, and the center of the map to
+  // be at the origin (0, 0, 0). In the game's coordinate system, a perfect
+  // cube is 256 units high, so we want to scale vertical values accordingly
+  // so that a perfect cube is 1.0 units high in OpenGL coordinates.
+  // We also need to invert the vertical axis, since OpenGL has positive Y
+  // pointing up.
+  const auto vX = float(x) - 32.0f;
+  const auto vY = float(verticalOffset) / -256.0f;
+  const auto vZ = float(y) - 32.0f;
+
+  return Vertex{vX, vY, vZ, uv, rect, lighting};
+}
+
+
+Vertex makeVertex(
+  const MapVertex& v,
+  const TexCoords& uv,
+  const TexRect& rect,
+  const VertexLighting& lighting)
+{
+  return makeVertex(v.x, v.y, v.verticalOffset, uv, rect, lighting);
+}
+
+
+bool QuadMerger::addQuad(
+  MeshBufferData<Vertex>& target,
+  const std::array<MapVertex, 4>& corners,
+  const std::array<TexCoords, 4>& texCoords,
+  const TexRect& texRect,
+  const VertexLighting& lighting)
+{
+  auto range = [&](auto member) {
+    const auto [iMin, iMax] = std::minmax_element(
+      corners.begin(),
+      corners.end(),
+      [&](const MapVertex& lhs, const MapVertex& rhs) {
+        return lhs.*member < rhs.*member;
+      });
+    return std::pair{(*iMin).*member, (*iMax).*member};
+  };
+
+  const auto [minX, maxX] = range(&MapVertex::x);
+  const auto [minY, maxY] = range(&MapVertex::y);
+  const auto [minH, maxH] = range(&MapVertex::verticalOffset);
+
+  Group group;
+  group.mpTarget = &target;
+  group.mTexCoords = texCoords;
+  group.mTexRect = texRect;
+  group.mLighting = lighting;
+
+  auto cell = Cell{};
+
+  // Vertical faces are only merged horizontally, so their lattice always
+  // spans exactly one unit along the vertical axis (B), going from the
+  // face's upper to its lower edge.
+  auto verticalOffsetB = [&](const MapVertex& v) {
+    return v.verticalOffset == minH ? 0 : 1;
+  };
+
+  if (minH == maxH)
+  {
+    if (maxX - minX != 1 || maxY - minY != 1)
+    {
+      return false;
+    }
+
+    group.mOrigin = {0, 0, minH};
+    group.mAxisA = {1, 0, 0};
+    group.mAxisB = {0, 1, 0};
+    cell.mA = minX;
+    cell.mB = minY;
+
+    for (auto i = 0u; i < corners.size(); ++i)
+    {
+      group.mCornerOffsetsA[i] = corners[i].x - minX;
+      group.mCornerOffsetsB[i] = corners[i].y - minY;
+    }
+  }
+  else if (minX == maxX && maxY - minY == 1)
+  {
+    group.mOrigin = {minX, 0, minH};
+    group.mAxisA = {0, 1, 0};
+    group.mAxisB = {0, 0, maxH - minH};
+    cell.mA = minY;
+
+    for (auto i = 0u; i < corners.size(); ++i)
+    {
+      group.mCornerOffsetsA[i] = corners[i].y - minY;
+      group.mCornerOffsetsB[i] = verticalOffsetB(corners[i]);
+    }
+  }
+  else if (minY == maxY && maxX - minX == 1)
+  {
+    group.mOrigin = {0, minY, minH};
+    group.mAxisA = {1, 0, 0};
+    group.mAxisB = {0, 0, maxH - minH};
+    cell.mA = minX;
+
+    for (auto i = 0u; i < corners.size(); ++i)
+    {
+      group.mCornerOffsetsA[i] = corners[i].x - minX;
+      group.mCornerOffsetsB[i] = verticalOffsetB(corners[i]);
+    }
+  }
+  else
+  {
+    return false;
+  }
+
+
+  // Each corner of the lattice cell must be covered exactly once, otherwise
+  // the quad isn't a proper axis-aligned rectangle (e.g. a vertical face with
+  // a slanted top edge).
+  auto coveredCorners = 0;
+  std::array<int, 4> cornerIndexByOffset{};
+
+  for (auto i = 0u; i < corners.size(); ++i)
+  {
+    const auto offsetIndex =
+      group.mCornerOffsetsA[i] + group.mCornerOffsetsB[i] * 2;
+
+    if (
+      corners[i].verticalOffset != minH && corners[i].verticalOffset != maxH)
+    {
+      return false;
+    }
+
+    coveredCorners |= 1 << offsetIndex;
+    cornerIndexByOffset[offsetIndex] = int(i);
+  }
+
+  if (coveredCorners != 0xF)
+  {
+    return false;
+  }
+
+  // Repeating the texture is only possible if texture coordinates change
+  // linearly across the quad
+  {
+    const auto& uv00 = texCoords[cornerIndexByOffset[0]];
+    const auto& uv10 = texCoords[cornerIndexByOffset[1]];
+    const auto& uv01 = texCoords[cornerIndexByOffset[2]];
+    const auto& uv11 = texCoords[cornerIndexByOffset[3]];
+
+    if (
+      uv10.u + uv01.u - uv00.u != uv11.u || uv10.v + uv01.v - uv00.v != uv11.v)
+    {
+      return false;
+    }
+  }
+
+
+  auto key = GroupKey{};
+  std::get<0>(key) = &target;
+  std::get<1>(key) = {
+    group.mOrigin.x,
+    group.mOrigin.y,
+    group.mOrigin.verticalOffset,
+    group.mAxisA.x,
+    group.mAxisA.y,
+    group.mAxisA.verticalOffset,
+    group.mAxisB.x,
+    group.mAxisB.y,
+    group.mAxisB.verticalOffset,
+    group.mCornerOffsetsA[0] + group.mCornerOffsetsB[0] * 2,
+    group.mCornerOffsetsA[1] + group.mCornerOffsetsB[1] * 2,
+    group.mCornerOffsetsA[2] + group.mCornerOffsetsB[2] * 2,
+    group.mCornerOffsetsA[3] + group.mCornerOffsetsB[3] * 2};
+  std::get<2>(key) = {
+    texCoords[0].u,
+    texCoords[0].v,
+    texCoords[1].u,
+    texCoords[1].v,
+    texCoords[2].u,
+    texCoords[2].v,
+    texCoords[3].u,
+    texCoords[3].v,
+    texRect.u,
+    texRect.v,
+    texRect.width,
+    texRect.height,
+    lighting.ambientOcclusion,
+    lighting.brightness};
+
+  const auto [iGroup, inserted] =
+    mGroupIndices.insert({key, uint32_t(mGroups.size())});
+
+  if (inserted)
+  {
+    mGroups.push_back(group);
+  }
+
+  cell.mGroup = iGroup->second;
+  mCells.push_back(cell);
+
+  return true;
+}
+
+
+void QuadMerger::emitMergedQuads()
+{
+  std::sort(
+    mCells.begin(), mCells.end(), [](const Cell& lhs, const Cell& rhs) {
+      return std::tie(lhs.mGroup, lhs.mB, lhs.mA) <
+        std::tie(rhs.mGroup, rhs.mB, rhs.mA);
+    });
+
+  enum CellState : uint8_t
+  {
+    Empty,
+    Occupied,
+    Consumed
+  };
+
+  std::vector<CellState> cellStates;
+
+  auto iGroupStart = mCells.begin();
+
+  while (iGroupStart != mCells.end())
+  {
+    const auto& group = mGroups[iGroupStart->mGroup];
+    const auto iGroupEnd = std::find_if(
+      iGroupStart, mCells.end(), [&](const Cell& cell) {
+        return cell.mGroup != iGroupStart->mGroup;
+      });
+
+    const auto minB = iGroupStart->mB;
+    const auto maxB = std::prev(iGroupEnd)->mB;
+    const auto [iMinA, iMaxA] = std::minmax_element(
+      iGroupStart, iGroupEnd, [](const Cell& lhs, const Cell& rhs) {
+        return lhs.mA < rhs.mA;
+      });
+    const auto minA = iMinA->mA;
+    const auto width = iMaxA->mA - minA + 1;
+    const auto height = maxB - minB + 1;
+
+    cellStates.assign(size_t(width * height), Empty);
+
+    auto stateAt = [&](const int a, const int b) -> CellState& {
+      return cellStates[(a - minA) + (b - minB) * width];
+    };
+
+    for (auto iCell = iGroupStart; iCell != iGroupEnd; ++iCell)
+    {
+      stateAt(iCell->mA, iCell->mB) = Occupied;
+    }
+
+
+    // Texture coordinates are linear across the lattice, so we can determine
+    // them for any point based on the values at the unit cell's corners.
+    auto texCoordsAt = [&](const int offsetA, const int offsetB) {
+      TexCoords uv00{}, uv10{}, uv01{};
+
+      for (auto i = 0u; i < 4u; ++i)
+      {
+        const auto offsetIndex =
+          group.mCornerOffsetsA[i] + group.mCornerOffsetsB[i] * 2;
+
+        if (offsetIndex == 0)
+          uv00 = group.mTexCoords[i];
+        else if (offsetIndex == 1)
+          uv10 = group.mTexCoords[i];
+        else if (offsetIndex == 2)
+          uv01 = group.mTexCoords[i];
+      }
+
+      return TexCoords{
+        uv00.u + (uv10.u - uv00.u) * offsetA + (uv01.u - uv00.u) * offsetB,
+        uv00.v + (uv10.v - uv00.v) * offsetA + (uv01.v - uv00.v) * offsetB};
+    };
+
+    auto makeMergedVertex = [&](
+                              const int cornerIndex,
+                              const int a,
+                              const int b,
+                              const int sizeA,
+                              const int sizeB) {
+      const auto offsetA = group.mCornerOffsetsA[cornerIndex] * sizeA;
+      const auto offsetB = group.mCornerOffsetsB[cornerIndex] * sizeB;
+
+      const auto position = group.mOrigin + group.mAxisA * (a + offsetA) +
+        group.mAxisB * (b + offsetB);
+
+      return makeVertex(
+        position,
+        texCoordsAt(offsetA, offsetB),
+        group.mTexRect,
+        group.mLighting);
+    };
+
+
+    for (auto b = minB; b <= maxB; ++b)
+    {
+      for (auto a = minA; a < minA + width; ++a)
+      {
+        if (stateAt(a, b) != Occupied)
+        {
+          continue;
+        }
+
+        auto sizeA = 1;
+        while (a + sizeA < minA + width && stateAt(a + sizeA, b) == Occupied)
+        {
+          ++sizeA;
+        }
+
+        auto sizeB = 1;
+        while (b + sizeB <= maxB &&
+               std::all_of(
+                 &stateAt(a, b + sizeB),
+                 &stateAt(a, b + sizeB) + sizeA,
+                 [](const CellState state) { return state == Occupied; }))
+        {
+          ++sizeB;
+        }
+
+        for (auto consumedB = b; consumedB < b + sizeB; ++consumedB)
+        {
+          std::fill_n(&stateAt(a, consumedB), sizeA, Consumed);
+        }
+
+        group.mpTarget->addQuad(
+          makeMergedVertex(0, a, b, sizeA, sizeB),
+          makeMergedVertex(1, a, b, sizeA, sizeB),
+          makeMergedVertex(2, a, b, sizeA, sizeB),
+          makeMergedVertex(3, a, b, sizeA, sizeB));
+      }
+    }
+
+    iGroupStart = iGroupEnd;
+  }
+
+  mGroups.clear();
+  mGroupIndices.clear();
+  mCells.clear();
+}
+
+} // namespace saucer
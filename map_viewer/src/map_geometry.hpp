@@ -0,0 +1,184 @@
+/* Copyright (C) 2024, Nikolai Wuttke. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "mesh.hpp"
+
+#include <rigel/base/warnings.hpp>
+
+RIGEL_DISABLE_WARNINGS
+#include <glm/vec3.hpp>
+RIGEL_RESTORE_WARNINGS
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <tuple>
+#include <vector>
+
+
+namespace saucer
+{
+
+struct TexCoords
+{
+  float u, v;
+};
+
+
+/** Sub-rectangle of a texture atlas
+ *
+ * The fragment shader wraps texture coordinates into this rectangle, which
+ * allows repeating a texture across merged quads. Vertices that don't need
+ * wrapping use the whole atlas as their rectangle.
+ */
+struct TexRect
+{
+  float u = 0.0f;
+  float v = 0.0f;
+  float width = 1.0f;
+  float height = 1.0f;
+};
+
+
+/** Factors applied to a vertex' color, 1.0 leaves the texture unchanged
+ *
+ * The ambient occlusion term is the fraction of the hemisphere around the
+ * vertex that's not blocked by nearby geometry.
+ */
+struct VertexLighting
+{
+  float ambientOcclusion = 1.0f;
+  float brightness = 1.0f;
+};
+
+
+inline bool operator==(const VertexLighting& lhs, const VertexLighting& rhs)
+{
+  return lhs.ambientOcclusion == rhs.ambientOcclusion &&
+    lhs.brightness == rhs.brightness;
+}
+
+
+struct Vertex
+{
+  Vertex(
+    float x_,
+    float y_,
+    float z_,
+    TexCoords uv_,
+    TexRect rect_ = {},
+    VertexLighting lighting_ = {})
+    : x(x_)
+    , y(y_)
+    , z(z_)
+    , uv(uv_)
+    , rect(rect_)
+    , lighting(lighting_)
+  {
+  }
+
+  explicit Vertex(glm::vec3 vec, TexCoords uv_, TexRect rect_ = {})
+    : Vertex(vec.x, vec.y, vec.z, uv_, rect_)
+  {
+  }
+
+  float x, y, z;
+  TexCoords uv;
+  TexRect rect;
+  VertexLighting lighting;
+};
+
+
+struct MapVertex
+{
+  int x, y, verticalOffset;
+};
+
+
+Vertex makeVertex(
+  int x,
+  int y,
+  int verticalOffset,
+  const TexCoords& uv,
+  const TexRect& rect = {},
+  const VertexLighting& lighting = {});
+
+Vertex makeVertex(
+  const MapVertex& v,
+  const TexCoords& uv,
+  const TexRect& rect = {},
+  const VertexLighting& lighting = {});
+
+
+/** Merges adjacent coplanar quads into larger ones (greedy meshing)
+ *
+ * Quads are given in map coordinates, with texture coordinates relative to
+ * a texture rectangle (i.e., in the range 0..1 for a quad showing the full
+ * texture once). Quads that are axis-aligned and cover exactly one grid cell
+ * (or one cell's width, for vertical faces) are collected, all others are
+ * rejected and need to be added to a mesh directly by the caller.
+ *
+ * Quads with identical plane, corner order, texture rectangle, texture
+ * orientation and lighting are then merged into rectangles as large as
+ * possible by emitMergedQuads(), with texture coordinates extending past 1.0
+ * so that the texture repeats once per grid cell as before. Lighting is
+ * uniform across each quad, callers must only submit quads whose corners all
+ * have the same lighting.
+ */
+class QuadMerger
+{
+public:
+  bool addQuad(
+    MeshBufferData<Vertex>& target,
+    const std::array<MapVertex, 4>& corners,
+    const std::array<TexCoords, 4>& texCoords,
+    const TexRect& texRect,
+    const VertexLighting& lighting = {});
+
+  void emitMergedQuads();
+
+private:
+  struct Group
+  {
+    MeshBufferData<Vertex>* mpTarget;
+    MapVertex mOrigin;
+    MapVertex mAxisA;
+    MapVertex mAxisB;
+    std::array<int, 4> mCornerOffsetsA;
+    std::array<int, 4> mCornerOffsetsB;
+    std::array<TexCoords, 4> mTexCoords;
+    TexRect mTexRect;
+    VertexLighting mLighting;
+  };
+
+  struct Cell
+  {
+    uint32_t mGroup;
+    int mA;
+    int mB;
+  };
+
+  using GroupKey =
+    std::tuple<const void*, std::array<int, 13>, std::array<float, 14>>;
+
+  std::vector<Group> mGroups;
+  std::map<GroupKey, uint32_t> mGroupIndices;
+  std::vector<Cell> mCells;
+};
+
+} // namespace saucer
@@ -16,11 +16,19 @@
 
 #include "map_renderer.hpp"
 
+#include "ambient_occlusion.hpp"
+#include "bake_cache.hpp"
+#include "map_geometry.hpp"
+#include "mipmaps.hpp"
+#include "texture_compression.hpp"
+
 #include <rigel/base/image_loading.hpp>
 #include <rigel/base/match.hpp>
 #include <rigel/opengl/utils.hpp>
 
 RIGEL_DISABLE_WARNINGS
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/mat4x4.hpp>
 #include <imgui.h>
@@ -28,11 +36,23 @@ RIGEL_DISABLE_WARNINGS
 RIGEL_RESTORE_WARNINGS
 
 #include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <optional>
+#include <tuple>
+#include <unordered_set>
 
 
 using namespace rigel;
 
 
+// Not part of core OpenGL, so the loader might not define it
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT 0x83F1
+#endif
+
+
 namespace saucer
 {
 
@@ -42,24 +62,99 @@ namespace
 constexpr auto CAMERA_MOVEMENT_SPEED = 8.0f;
 constexpr auto CAMERA_ROTATION_SPEED = 2.0f;
 
+// World and model textures share an atlas if it's at most 4096 pixels wide,
+// which all GPUs we care about support
+constexpr auto MAX_SHARED_ATLAS_PAGES = std::size_t(16);
+
+// Mip levels per texture atlas, i.e. down to 16x16 texels per page. Beyond
+// that, the textures within a page would mostly blend together.
+constexpr auto ATLAS_MIP_LEVELS = 4;
+
 
 const char* FRAGMENT_SOURCE = R"shd(
 DEFAULT_PRECISION_DECLARATION
 OUTPUT_COLOR_DECLARATION
 
 IN HIGHP vec2 texCoordFrag;
+IN HIGHP vec4 texRectFrag;
+IN vec2 lightingFrag;
+uniform sampler2D textureData;
+uniform bool alphaTesting;
+uniform bool enableAmbientOcclusion;
+
+// Brightness of fully occluded surfaces. Zero would make corners
+// pitch-black, since there's no other light source in the scene.
+const float AMBIENT_OCCLUSION_MIN_BRIGHTNESS = 0.35;
+
+
+void main() {
+  // Wrap texture coordinates into the texture's sub-rectangle of the atlas,
+  // so that merged quads can repeat their texture.
+  vec2 texCoord = texRectFrag.xy + fract(texCoordFrag) * texRectFrag.zw;
+
+#ifdef GL_ES
+  // No textureGrad in GLSL ES 1.00, atlases don't have mip levels there
+  vec4 color = TEXTURE_LOOKUP(textureData, texCoord);
+#else
+  // Mip level selection uses the unwrapped coordinates, since the jumps
+  // caused by fract() would select the smallest level along the seams
+  vec2 unwrappedTexCoord = texCoordFrag * texRectFrag.zw;
+  vec4 color = textureGrad(
+    textureData,
+    texCoord,
+    dFdx(unwrappedTexCoord),
+    dFdy(unwrappedTexCoord));
+#endif
+
+  if (alphaTesting && color.a != 1.0f) {
+    discard;
+  }
+
+  float ambientOcclusion = enableAmbientOcclusion
+    ? mix(AMBIENT_OCCLUSION_MIN_BRIGHTNESS, 1.0, lightingFrag.x)
+    : 1.0;
+
+  OUTPUT_COLOR = vec4(color.rgb * ambientOcclusion * lightingFrag.y, color.a);
+}
+)shd";
+
+
+// Used for the debug visualizations. Either tints the texture with the given
+// color (using its alpha value as strength), or outputs the color directly.
+const char* DEBUG_FRAGMENT_SOURCE = R"shd(
+DEFAULT_PRECISION_DECLARATION
+OUTPUT_COLOR_DECLARATION
+
+IN HIGHP vec2 texCoordFrag;
+IN HIGHP vec4 texRectFrag;
 uniform sampler2D textureData;
 uniform bool alphaTesting;
+uniform bool tintTexture;
+uniform vec4 debugColor;
 
 
 void main() {
-  vec4 color = TEXTURE_LOOKUP(textureData, texCoordFrag);
+  vec2 texCoord = texRectFrag.xy + fract(texCoordFrag) * texRectFrag.zw;
+#ifdef GL_ES
+  vec4 color = TEXTURE_LOOKUP(textureData, texCoord);
+#else
+  vec2 unwrappedTexCoord = texCoordFrag * texRectFrag.zw;
+  vec4 color = textureGrad(
+    textureData,
+    texCoord,
+    dFdx(unwrappedTexCoord),
+    dFdy(unwrappedTexCoord));
+#endif
 
   if (alphaTesting && color.a != 1.0f) {
     discard;
   }
 
-  OUTPUT_COLOR = color;
+  if (tintTexture) {
+    OUTPUT_COLOR = vec4(mix(color.rgb, debugColor.rgb, debugColor.a), 1.0);
+  } else {
+    OUTPUT_COLOR = debugColor;
+  }
 }
 )shd";
 
@@ -67,8 +162,12 @@ void main() {
 const char* VERTEX_SOURCE = R"shd(
 ATTRIBUTE HIGHP vec3 position;
 ATTRIBUTE HIGHP vec2 texCoord;
+ATTRIBUTE HIGHP vec4 texRect;
+ATTRIBUTE vec2 lighting;
 
 OUT HIGHP vec2 texCoordFrag;
+OUT HIGHP vec4 texRectFrag;
+OUT vec2 lightingFrag;
 
 uniform mat4 transform;
 
@@ -76,15 +175,127 @@ uniform mat4 transform;
 void main() {
   gl_Position = transform * vec4(position, 1.0);
   texCoordFrag = texCoord;
+  texRectFrag = texRect;
+  lightingFrag = lighting;
+}
+)shd";
+
+
+// Terrain rendering without any vertex buffer. Every tile is made up of 6
+// vertices (two triangles), positions and texture coordinates are determined
+// from the vertex ID by looking up data for the corresponding tile.
+//
+// terrainData holds one texel per tile: vertical offset, texture definition
+// index, flags and brightness factor. textureDefData holds two texels per
+// texture definition, with the 4 texture coordinate pairs already converted
+// to atlas space.
+#ifndef RIGEL_USE_GL_ES
+const char* TERRAIN_VERTEX_SOURCE = R"shd(
+OUT HIGHP vec2 texCoordFrag;
+OUT HIGHP vec4 texRectFrag;
+OUT vec2 lightingFrag;
+
+uniform mat4 transform;
+uniform sampler2D terrainData;
+uniform sampler2D textureDefData;
+
+const int MAP_SIZE = 64;
+const int TEXTURE_DEFS_PER_ROW = 128;
+
+// Same order as used by MeshBufferData::addQuad()
+const int QUAD_INDICES[6] = int[6](0, 3, 1, 1, 3, 2);
+const ivec2 CORNER_OFFSETS[4] =
+  ivec2[4](ivec2(0, 0), ivec2(1, 0), ivec2(1, 1), ivec2(0, 1));
+
+
+float verticalOffsetAt(ivec2 tile, ivec2 cornerOffset) {
+  ivec2 position = tile + cornerOffset;
+
+  // Tiles at the right and bottom edges use their own height for corners
+  // that would be outside the map
+  if (position.x >= MAP_SIZE || position.y >= MAP_SIZE) {
+    position = tile;
+  }
+
+  return texelFetch(terrainData, position, 0).r;
+}
+
+
+// See terrainBrightnessAt() in map_renderer.cpp
+float brightnessAt(ivec2 corner) {
+  float sum = 0.0;
+  int count = 0;
+
+  for (int y = corner.y - 1; y <= corner.y; ++y) {
+    for (int x = corner.x - 1; x <= corner.x; ++x) {
+      if (x >= 0 && y >= 0 && x < MAP_SIZE && y < MAP_SIZE) {
+        sum += texelFetch(terrainData, ivec2(x, y), 0).a;
+        ++count;
+      }
+    }
+  }
+
+  return sum / float(count);
+}
+
+
+vec2 textureDefUv(int textureDef, int uvIndex) {
+  ivec2 texelPos = ivec2(
+    (textureDef % TEXTURE_DEFS_PER_ROW) * 2 + uvIndex / 2,
+    textureDef / TEXTURE_DEFS_PER_ROW);
+  vec4 texel = texelFetch(textureDefData, texelPos, 0);
+  return uvIndex % 2 == 0 ? texel.xy : texel.zw;
+}
+
+
+void main() {
+  int tileIndex = gl_VertexID / 6;
+  int corner = QUAD_INDICES[gl_VertexID % 6];
+  ivec2 tile = ivec2(tileIndex % MAP_SIZE, tileIndex / MAP_SIZE);
+
+  vec4 tileData = texelFetch(terrainData, tile, 0);
+  int textureDef = int(tileData.g);
+  int flags = int(tileData.b);
+
+  texRectFrag = vec4(0.0, 0.0, 1.0, 1.0);
+
+  if (textureDef == 0) {
+    // Collapse invisible tiles into degenerate triangles
+    gl_Position = vec4(0.0, 0.0, 0.0, 1.0);
+    texCoordFrag = vec2(0.0, 0.0);
+    lightingFrag = vec2(1.0, 1.0);
+    return;
+  }
+
+  int rotation = 4 - ((flags & 0x30) >> 4);
+  ivec2 cornerOffset = CORNER_OFFSETS[corner];
+
+  // No ambient occlusion here, it's only baked into the CPU-built meshes
+  lightingFrag = vec2(1.0, brightnessAt(tile + cornerOffset));
+
+  // See makeVertex() in map_geometry.cpp
+  vec3 position = vec3(
+    float(tile.x + cornerOffset.x) - 32.0,
+    verticalOffsetAt(tile, cornerOffset) / -256.0,
+    float(tile.y + cornerOffset.y) - 32.0);
+
+  gl_Position = transform * vec4(position, 1.0);
+  texCoordFrag = textureDefUv(textureDef, (corner + rotation) % 4);
 }
 )shd";
+#endif
+
+
+constexpr auto TEXTURE_DEFS_PER_ROW = 128;
 
 
 constexpr auto TEX_UNIT_NAMES = std::array{"textureData"};
 
-constexpr auto ATTRIBUTE_SPECS = std::array<opengl::AttributeSpec, 2>{{
+constexpr auto ATTRIBUTE_SPECS = std::array<opengl::AttributeSpec, 4>{{
   {"position", opengl::AttributeSpec::Size::vec3},
   {"texCoord", opengl::AttributeSpec::Size::vec2},
+  {"texRect", opengl::AttributeSpec::Size::vec4},
+  {"lighting", opengl::AttributeSpec::Size::vec2},
 }};
 
 
@@ -95,20 +306,328 @@ const opengl::ShaderSpec SHADER_SPEC{
   FRAGMENT_SOURCE};
 
 
-std::vector<int> determineWorldTexturePagesUsed(const MapData& map)
+const opengl::ShaderSpec DEBUG_SHADER_SPEC{
+  ATTRIBUTE_SPECS,
+  TEX_UNIT_NAMES,
+  VERTEX_SOURCE,
+  DEBUG_FRAGMENT_SOURCE};
+
+
+// With additive blending, each fragment adds this amount to the framebuffer.
+// Red saturates after 8 layers, green after 32, and blue after 128, giving
+// a black-red-yellow-white heat map.
+const auto OVERDRAW_INCREMENT =
+  glm::vec4(1.0f / 8.0f, 1.0f / 32.0f, 1.0f / 128.0f, 1.0f);
+
+const auto CULLED_TINT = glm::vec4(1.0f, 0.0f, 0.0f, 0.6f);
+const auto NO_TINT = glm::vec4(0.0f);
+
+
+/** Maps the given value in range 0..1 to a blue-green-yellow-red ramp */
+glm::vec4 heatColor(const float value)
+{
+  const auto t = std::clamp(value, 0.0f, 1.0f);
+
+  return glm::vec4(
+    std::clamp(t * 3.0f - 1.0f, 0.0f, 1.0f),
+    std::clamp(t < 0.67f ? t * 3.0f : (1.0f - t) * 3.0f, 0.0f, 1.0f),
+    std::clamp(1.0f - t * 3.0f, 0.0f, 1.0f),
+    0.75f);
+}
+
+
+glm::vec4 triangleDensityColor(const Meshlet& meshlet)
+{
+  // Triangles per square unit of the meshlet's bounding sphere cross
+  // section, on a logarithmic scale. 63 or more triangles per grid cell
+  // show as fully red.
+  const auto area = std::max(
+    glm::pi<float>() * meshlet.mRadius * meshlet.mRadius, 0.01f);
+  const auto density = float(meshlet.mNumIndices / 3) / area;
+
+  return heatColor(std::log2(1.0f + density) / 6.0f);
+}
+
+
+#ifndef RIGEL_USE_GL_ES
+constexpr auto TERRAIN_TEX_UNIT_NAMES =
+  std::array{"textureData", "terrainData", "textureDefData"};
+
+const opengl::ShaderSpec TERRAIN_SHADER_SPEC{
+  {},
+  TERRAIN_TEX_UNIT_NAMES,
+  TERRAIN_VERTEX_SOURCE,
+  FRAGMENT_SOURCE};
+#endif
+
+
+/** Converts a map item's brightness adjustment into a color multiplier
+ *
+ * The game's exact lighting formula isn't known. We treat the adjustment as
+ * a fraction of 256, so that -256 results in black and +256 doubles the
+ * brightness.
+ */
+float brightnessFactor(const int16_t adjustment)
 {
-  std::vector<int> pages;
+  return std::clamp(1.0f + float(adjustment) / 256.0f, 0.0f, 2.0f);
+}
 
-  for (const auto& textureDef : map.mTextureDefs)
+
+/** Average brightness of all terrain tiles sharing the given corner
+ *
+ * This makes brightness changes between tiles smooth, instead of having
+ * each tile stand out with its own flat brightness.
+ */
+float terrainBrightnessAt(const MapData& map, const int x, const int y)
+{
+  auto sum = 0.0f;
+  auto count = 0;
+
+  for (auto tileY = y - 1; tileY <= y; ++tileY)
+  {
+    for (auto tileX = x - 1; tileX <= x; ++tileX)
+    {
+      if (tileX >= 0 && tileY >= 0 && tileX < MAP_SIZE && tileY < MAP_SIZE)
+      {
+        sum +=
+          brightnessFactor(map.terrainAt(tileX, tileY).brightnessAdjustment);
+        ++count;
+      }
+    }
+  }
+
+  return sum / float(count);
+}
+
+
+/** Texture def shown on a terrain or extra terrain tile, 0 for none
+ *
+ * Out of range definitions are treated like untextured tiles, the same way
+ * as for block faces.
+ */
+uint16_t terrainTexture(const MapData& map, const uint32_t blockDefIndex)
+{
+  if (blockDefIndex >= map.mBlockDefs.size())
+  {
+    return 0;
+  }
+
+  const auto texture = map.mBlockDefs[blockDefIndex].texturesInside.bottom;
+  return texture < map.mTextureDefs.size() ? texture : uint16_t(0);
+}
+
+
+std::array<float, 4> terrainTileData(const MapData& map, int x, int y)
+{
+  const auto& tile = map.terrainAt(x, y);
+
+  return {
+    float(tile.verticalOffset),
+    float(terrainTexture(map, tile.blockDefIndex)),
+    float(tile.flags.raw),
+    brightnessFactor(tile.brightnessAdjustment)};
+}
+
+
+#ifndef RIGEL_USE_GL_ES
+rigel::opengl::Handle<rigel::opengl::tag::Texture>
+  createFloatTexture(int width, int height, const float* pData)
+{
+  auto texture = opengl::Handle<opengl::tag::Texture>::create();
+
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glTexImage2D(
+    GL_TEXTURE_2D,
+    0,
+    GL_RGBA32F,
+    width,
+    height,
+    0,
+    GL_RGBA,
+    GL_FLOAT,
+    pData);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+  return texture;
+}
+#endif
+
+
+#ifndef RIGEL_USE_GL_ES
+bool isExtensionSupported(const char* name)
+{
+  auto numExtensions = GLint(0);
+  glGetIntegerv(GL_NUM_EXTENSIONS, &numExtensions);
+
+  for (auto i = 0; i < numExtensions; ++i)
+  {
+    const auto pExtension =
+      reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, GLuint(i)));
+
+    if (pExtension && std::strcmp(pExtension, name) == 0)
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+
+rigel::opengl::Handle<rigel::opengl::tag::Texture>
+  createCompressedTexture(const TextureAtlas& atlas)
+{
+  auto texture = opengl::Handle<opengl::tag::Texture>::create();
+
+  glBindTexture(GL_TEXTURE_2D, texture);
+
+  auto level = 0;
+  for (const auto& data : atlas.mCompressedLevels)
+  {
+    glCompressedTexImage2D(
+      GL_TEXTURE_2D,
+      level,
+      GL_COMPRESSED_RGBA_S3TC_DXT1_EXT,
+      GLsizei(atlas.mImage.width() >> level),
+      GLsizei(atlas.mImage.height() >> level),
+      0,
+      GLsizei(data.size()),
+      data.data());
+    ++level;
+  }
+
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+  return texture;
+}
+#endif
+
+
+bool supportsBc1Textures()
+{
+#ifdef RIGEL_USE_GL_ES
+  // Compressed atlases come with all their mip levels, which OpenGL ES 2
+  // can't limit. The extension query used here is also desktop only.
+  return false;
+#else
+  return isExtensionSupported("GL_EXT_texture_compression_s3tc");
+#endif
+}
+
+
+rigel::opengl::Handle<rigel::opengl::tag::Texture>
+  createAtlasTexture(const TextureAtlas& atlas, const bool useCompressed)
+{
+#ifdef RIGEL_USE_GL_ES
+  // Never set, see supportsBc1Textures()
+  static_cast<void>(useCompressed);
+#else
+  if (useCompressed && !atlas.mCompressedLevels.empty())
+  {
+    auto texture = createCompressedTexture(atlas);
+
+    glTexParameteri(
+      GL_TEXTURE_2D,
+      GL_TEXTURE_MAX_LEVEL,
+      GLint(atlas.mCompressedLevels.size() - 1));
+    glTexParameteri(
+      GL_TEXTURE_2D,
+      GL_TEXTURE_MIN_FILTER,
+      atlas.mCompressedLevels.size() > 1 ? GL_NEAREST_MIPMAP_NEAREST
+                                         : GL_NEAREST);
+    return texture;
+  }
+#endif
+
+  auto texture = opengl::createTexture(atlas.mImage);
+
+#ifndef RIGEL_USE_GL_ES
+  // OpenGL ES 2 can't set the number of levels, and requires power of two
+  // sizes for mipmapping. Atlases are only used at full resolution there.
+  glBindTexture(GL_TEXTURE_2D, texture);
+
+  auto level = 1;
+  for (const auto& mipLevel : atlas.mMipLevels)
+  {
+    glTexImage2D(
+      GL_TEXTURE_2D,
+      level,
+      GL_RGBA,
+      GLsizei(mipLevel.width()),
+      GLsizei(mipLevel.height()),
+      0,
+      GL_RGBA,
+      GL_UNSIGNED_BYTE,
+      mipLevel.pixelData().data());
+    ++level;
+  }
+
+  // Nearest filtering within a level keeps the pixelated look of the
+  // original game, and is the cheapest option on software renderers
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level - 1);
+  glTexParameteri(
+    GL_TEXTURE_2D,
+    GL_TEXTURE_MIN_FILTER,
+    atlas.mMipLevels.empty() ? GL_NEAREST : GL_NEAREST_MIPMAP_NEAREST);
+#endif
+
+  return texture;
+}
+
+
+/** Adds BC1 encoded versions of the atlas and all its mip levels
+ *
+ * pages are the atlas' pages, as passed to the TextureAtlas constructor.
+ * alphaTestedPages is a sorted list of canonical pages, see
+ * determineAlphaTestedPages().
+ */
+void compressAtlas(
+  TextureAtlas& atlas,
+  rigel::base::ArrayView<int> pages,
+  const std::vector<int>& alphaTestedPages,
+  const bool useBakeCache)
+{
+  std::vector<bool> isAlphaTested;
+  isAlphaTested.reserve(pages.size());
+
+  for (const auto page : pages)
+  {
+    isAlphaTested.push_back(std::binary_search(
+      alphaTestedPages.begin(), alphaTestedPages.end(), page));
+  }
+
+  atlas.mCompressedLevels.push_back(
+    compressBc1(atlas.mImage, isAlphaTested, useBakeCache));
+
+  for (const auto& mipLevel : atlas.mMipLevels)
   {
-    pages.push_back(textureDef.bitmapIndex);
+    atlas.mCompressedLevels.push_back(
+      compressBc1(mipLevel, isAlphaTested, useBakeCache));
   }
+}
+
 
+void sortAndRemoveDuplicates(std::vector<int>& pages)
+{
   std::sort(pages.begin(), pages.end());
   const auto iNewEnd = std::unique(pages.begin(), pages.end());
 
   pages.erase(iNewEnd, pages.end());
+}
+
+
+std::vector<int>
+  determineWorldTexturePagesUsed(const MapData& map, const WadData& wad)
+{
+  std::vector<int> pages;
 
+  for (const auto& textureDef : map.mTextureDefs)
+  {
+    pages.push_back(int(wad.canonicalBitmap(textureDef.bitmapIndex)));
+  }
+
+  sortAndRemoveDuplicates(pages);
   return pages;
 }
 
@@ -145,77 +664,122 @@ std::vector<int> determineModelTexturePagesUsed(
   {
     for (const auto& face : model.faces)
     {
-      pages.push_back(wad.mTextureDefs.at(face.mTexture).bitmapIndex);
+      const auto bitmapIndex = wad.mTextureDefs.at(face.mTexture).bitmapIndex;
+      pages.push_back(int(wad.canonicalBitmap(bitmapIndex)));
     }
   }
 
-  std::sort(pages.begin(), pages.end());
-  const auto iNewEnd = std::unique(pages.begin(), pages.end());
-
-  pages.erase(iNewEnd, pages.end());
-
+  sortAndRemoveDuplicates(pages);
   return pages;
 }
 
 
-struct TexCoords
+/** Canonical pages holding textures that are drawn with alpha testing
+ *
+ * A page counts if any masked texture def refers to it, even if it's also
+ * used by solid ones.
+ */
+std::vector<int> determineAlphaTestedPages(
+  const MapData& map,
+  const std::unordered_map<std::string, ModelData>& models,
+  const WadData& wad)
 {
-  float u, v;
-};
-
+  std::vector<int> pages;
 
-struct Vertex
-{
-  Vertex(float x_, float y_, float z_, TexCoords uv_)
-    : x(x_)
-    , y(y_)
-    , z(z_)
-    , uv(uv_)
+  for (const auto& textureDef : map.mTextureDefs)
   {
+    if (textureDef.isMasked)
+    {
+      pages.push_back(int(wad.canonicalBitmap(textureDef.bitmapIndex)));
+    }
   }
 
-  explicit Vertex(glm::vec3 vec, TexCoords uv_)
-    : Vertex(vec.x, vec.y, vec.z, uv_)
+  for (const auto& [_, model] : models)
   {
+    for (const auto& face : model.faces)
+    {
+      const auto& textureDef = wad.mTextureDefs.at(face.mTexture);
+
+      if (textureDef.isMasked)
+      {
+        pages.push_back(int(wad.canonicalBitmap(textureDef.bitmapIndex)));
+      }
+    }
   }
 
-  float x, y, z;
-  TexCoords uv;
-};
+  sortAndRemoveDuplicates(pages);
+  return pages;
+}
 
 
-struct MapVertex
+struct RepeatableTexture
 {
-  int x, y, verticalOffset;
+  TexRect mRect;
+  std::array<TexCoords, 4> mTexCoords;
 };
 
 
-Vertex makeVertex(int x, int y, int verticalOffset, const TexCoords& uv)
+/** Describes the given texture in a form suitable for repeating it
+ *
+ * This is only possible for textures whose coordinates form a rectangle that's
+ * aligned to the texture's axes, which is the case for the vast majority of
+ * texture definitions. Rotated and mirrored variants are supported.
+ */
+std::optional<RepeatableTexture>
+  makeRepeatableTexture(const TextureDef& texDef, const TextureAtlas& atlas)
 {
-  // The game uses grid coordinates alongside vertical offsets. We map
-  // grid X/Y coordinates to the X and Z axes in the OpenGL coordinate system,
-  // and the vertical dimension to OpenGL's Y axis.
-  // We also define a grid cell to be 1.0 in size, and the center of the map to
-  // be at the origin (0, 0, 0). In the game's coordinate system, a perfect
-  // cube is 256 units high, so we want to scale vertical values accordingly
-  // so that a perfect cube is 1.0 units high in OpenGL coordinates.
-  // We also need to invert the vertical axis, since OpenGL has positive Y
-  // pointing up.
-  const auto vX = float(x) - 32.0f;
-  const auto vY = float(verticalOffset) / -256.0f;
-  const auto vZ = float(y) - 32.0f;
+  const auto& uvs = texDef.uvs;
 
-  return Vertex{vX, vY, vZ, uv};
-}
+  if (
+    uvs[0].u + uvs[2].u != uvs[1].u + uvs[3].u ||
+    uvs[0].v + uvs[2].v != uvs[1].v + uvs[3].v)
+  {
+    return {};
+  }
 
+  const auto [iMinU, iMaxU] = std::minmax_element(
+    uvs.begin(), uvs.end(), [](const UvPair& lhs, const UvPair& rhs) {
+      return lhs.u < rhs.u;
+    });
+  const auto [iMinV, iMaxV] = std::minmax_element(
+    uvs.begin(), uvs.end(), [](const UvPair& lhs, const UvPair& rhs) {
+      return lhs.v < rhs.v;
+    });
 
-Vertex makeVertex(const MapVertex& v, const TexCoords& uv)
-{
-  return makeVertex(v.x, v.y, v.verticalOffset, uv);
+  const auto minU = iMinU->u;
+  const auto maxU = iMaxU->u;
+  const auto minV = iMinV->v;
+  const auto maxV = iMaxV->v;
+
+  RepeatableTexture result;
+
+  for (auto i = 0u; i < uvs.size(); ++i)
+  {
+    const auto& uv = uvs[i];
+
+    if ((uv.u != minU && uv.u != maxU) || (uv.v != minV && uv.v != maxV))
+    {
+      return {};
+    }
+
+    result.mTexCoords[i] = TexCoords{
+      uv.u == minU ? 0.0f : 1.0f, uv.v == minV ? 0.0f : 1.0f};
+  }
+
+  // Same mapping as in getTexCoords()
+  result.mRect = TexRect{
+    (float(minU) + 0.5f) / atlas.mWidth + atlas.mUvOffsets[texDef.bitmapIndex],
+    (float(minV) + 0.5f) / float(TEXTURE_PAGE_SIZE),
+    float(maxU - minU) / atlas.mWidth,
+    float(maxV - minV) / float(TEXTURE_PAGE_SIZE)};
+
+  return result;
 }
 
 
-std::vector<float> buildAtlasUvOffsetTable(rigel::base::ArrayView<int> pages)
+std::vector<float> buildAtlasUvOffsetTable(
+  rigel::base::ArrayView<int> pages,
+  const WadData& wad)
 {
   std::vector<float> table;
   if (pages.empty())
@@ -223,7 +787,8 @@ std::vector<float> buildAtlasUvOffsetTable(rigel::base::ArrayView<int> pages)
     return table;
   }
 
-  table.assign(pages.back() + 1, 0.0f);
+  table.assign(
+    std::max(std::size_t(pages.back() + 1), wad.mBitmaps.size()), 0.0f);
 
   {
     auto i = 0;
@@ -234,6 +799,13 @@ std::vector<float> buildAtlasUvOffsetTable(rigel::base::ArrayView<int> pages)
     }
   }
 
+  // Duplicate bitmaps aren't part of the atlas, they use the slot of the
+  // bitmap with identical contents instead
+  for (auto bitmap = uint32_t(0); bitmap < wad.mBitmaps.size(); ++bitmap)
+  {
+    table[bitmap] = table[wad.canonicalBitmap(bitmap)];
+  }
+
   return table;
 }
 
@@ -270,194 +842,594 @@ glm::mat4 convertMatrix(const std::array<int16_t, 3 * 4>& matrix)
 }
 
 
-MaskedMesh createMaskedMesh(
+MaskedMeshData makeMaskedMeshData(
   MeshBufferData<Vertex>&& solidFaces,
+  std::vector<Meshlet>&& solidMeshlets,
   MeshBufferData<Vertex>&& maskedFaces,
-  const rigel::opengl::Shader& shader)
+  std::vector<Meshlet>&& maskedMeshlets)
 {
-  MaskedMesh mesh;
+  MaskedMeshData data;
+
+  data.mMeshlets = std::move(solidMeshlets);
+  data.mFirstMaskedMeshlet = data.mMeshlets.size();
 
   if (maskedFaces.hasData())
   {
-    mesh.mMaskedFacesStart = uint16_t(solidFaces.mIndexBuffer.size());
-    mesh.mMaskedFacesCount = uint16_t(maskedFaces.mIndexBuffer.size());
+    const auto indexOffset = uint32_t(solidFaces.mIndexBuffer.size());
+
+    for (auto meshlet : maskedMeshlets)
+    {
+      meshlet.mFirstIndex += indexOffset;
+      data.mMeshlets.push_back(meshlet);
+    }
+
     solidFaces.append(maskedFaces);
   }
 
-  mesh.mMesh = solidFaces.createMesh(shader.attributeSpecs());
+  data.mFaces = std::move(solidFaces);
 
-  return mesh;
+  return data;
 }
 
-} // namespace
 
+MaskedMeshData makeMaskedMeshData(
+  MeshBufferData<Vertex>&& solidFaces,
+  MeshBufferData<Vertex>&& maskedFaces)
+{
+  auto solidMeshlets = buildMeshlets(solidFaces);
+  auto maskedMeshlets = buildMeshlets(maskedFaces);
+
+  return makeMaskedMeshData(
+    std::move(solidFaces),
+    std::move(solidMeshlets),
+    std::move(maskedFaces),
+    std::move(maskedMeshlets));
+}
 
-TextureAtlas::TextureAtlas(
-  const rigel::base::Image& image,
-  rigel::base::ArrayView<int> pages)
-  : mTexture(opengl::createTexture(image))
-  , mWidth(float(image.width()))
-  , mUvOffsets(buildAtlasUvOffsetTable(pages))
+
+template <typename Vertex>
+std::size_t bufferSize(const MeshBufferData<Vertex>& data)
+{
+  return data.mVertexBuffer.size() * sizeof(Vertex) +
+    data.mIndexBuffer.size() * sizeof(uint16_t);
+}
+
+
+std::size_t imageSize(const rigel::base::Image& image)
 {
+  return image.width() * image.height() * 4;
 }
 
 
-void MaskedMesh::draw(rigel::opengl::Shader& shader)
+std::size_t atlasSize(const TextureAtlas& atlas)
 {
-  if (mMaskedFacesStart)
+  if (!atlas.mCompressedLevels.empty())
   {
-    mMesh.drawSubRange(0, mMaskedFacesStart);
+    auto size = std::size_t(0);
 
-    shader.setUniform("alphaTesting", true);
-    mMesh.drawSubRange(mMaskedFacesStart, mMaskedFacesCount);
-    shader.setUniform("alphaTesting", false);
+    for (const auto& data : atlas.mCompressedLevels)
+    {
+      size += data.size();
+    }
+
+    return size;
   }
-  else
+
+  auto size = imageSize(atlas.mImage);
+
+  for (const auto& mipLevel : atlas.mMipLevels)
   {
-    mMesh.draw();
+    size += imageSize(mipLevel);
   }
+
+  return size;
 }
 
 
-MapRenderer::MapRenderer(const MapData& map, const WadData& wad)
-  : mBackgroundColor(wad.lookupColorIndex(wad.mBackgroundColor))
-  , mShader(SHADER_SPEC)
+// Sizes are hashed along with the contents, so that moving data from one
+// buffer to the next changes the result. All hashed types consist of 4-byte
+// (or 4x1-byte) fields only, and thus have no padding.
+template <typename T>
+std::uint64_t hashVector(const std::vector<T>& data, std::uint64_t hash)
 {
-  glEnable(GL_DEPTH_TEST);
-  glEnable(GL_CULL_FACE);
-  glDisable(GL_BLEND);
+  const auto size = std::uint64_t(data.size());
+  hash = hashBytes(&size, sizeof(size), hash);
+  return hashBytes(data.data(), data.size() * sizeof(T), hash);
+}
 
-  glEnableVertexAttribArray(0);
-  glEnableVertexAttribArray(1);
 
+// The last bits of floating point results can differ between compilers and
+// build settings. Float data is therefore rounded to fixed point before
+// hashing, so that hashes are comparable between builds. This is still
+// precise enough to tell apart neighboring texels in the largest atlases.
+constexpr auto HASH_FIXED_POINT_SCALE = 16384.0f;
+
+
+/** Like hashVector, for types consisting of float fields only */
+template <typename T>
+std::uint64_t hashFloatVector(const std::vector<T>& data, std::uint64_t hash)
+{
+  static_assert(sizeof(T) % sizeof(float) == 0);
+  constexpr auto NUM_FIELDS = sizeof(T) / sizeof(float);
+
+  std::vector<std::int64_t> fixedPoint;
+  fixedPoint.reserve(data.size() * NUM_FIELDS);
+
+  for (const auto& item : data)
   {
-    auto guard = opengl::useTemporarily(mShader);
-    mShader.setUniform("textureData", 0);
-    mShader.setUniform("alphaTesting", false);
+    std::array<float, NUM_FIELDS> fields;
+    std::memcpy(fields.data(), &item, sizeof(T));
+
+    for (const auto value : fields)
+    {
+      fixedPoint.push_back(std::llround(value * HASH_FIXED_POINT_SCALE));
+    }
   }
 
+  return hashVector(fixedPoint, hash);
+}
+
+
+template <typename Vertex>
+std::uint64_t
+  hashMeshBuffer(const MeshBufferData<Vertex>& data, std::uint64_t hash)
+{
+  hash = hashFloatVector(data.mVertexBuffer, hash);
+  return hashVector(data.mIndexBuffer, hash);
+}
+
+
+std::uint64_t
+  hashMeshlets(const std::vector<Meshlet>& meshlets, std::uint64_t hash)
+{
+  std::vector<glm::vec4> bounds;
+  std::vector<std::uint32_t> ranges;
+
+  for (const auto& meshlet : meshlets)
   {
-    const auto pagesUsed = determineWorldTexturePagesUsed(map);
-    const auto textureAtlasImage = wad.buildTextureAtlas(pagesUsed);
-    mWorldTextures = TextureAtlas(textureAtlasImage, pagesUsed);
+    bounds.emplace_back(meshlet.mCenter, meshlet.mRadius);
+    bounds.emplace_back(meshlet.mConeAxis, meshlet.mConeCutoff);
+    ranges.push_back(meshlet.mFirstIndex);
+    ranges.push_back(meshlet.mNumIndices);
   }
 
-  const auto models = loadUsedModels(map, wad);
+  hash = hashFloatVector(bounds, hash);
+  return hashVector(ranges, hash);
+}
+
+
+std::uint64_t hashMaskedMesh(const MaskedMeshData& data, std::uint64_t hash)
+{
+  const auto firstMaskedMeshlet = std::uint64_t(data.mFirstMaskedMeshlet);
+
+  hash = hashMeshBuffer(data.mFaces, hash);
+  hash = hashMeshlets(data.mMeshlets, hash);
+  return hashBytes(&firstMaskedMeshlet, sizeof(firstMaskedMeshlet), hash);
+}
+
 
+std::uint64_t hashAtlas(const TextureAtlas& atlas, std::uint64_t hash)
+{
+  const auto size = std::array<std::uint64_t, 2>{
+    atlas.mImage.width(), atlas.mImage.height()};
+
+  hash = hashBytes(size.data(), sizeof(size), hash);
+  hash = hashVector(atlas.mImage.pixelData(), hash);
+
+  for (const auto& mipLevel : atlas.mMipLevels)
   {
-    const auto pagesUsed = determineModelTexturePagesUsed(models, wad);
-    const auto textureAtlasImage = wad.buildTextureAtlas(pagesUsed);
+    hash = hashVector(mipLevel.pixelData(), hash);
+  }
 
-    mModelTextures = TextureAtlas(textureAtlasImage, pagesUsed);
+  for (const auto& data : atlas.mCompressedLevels)
+  {
+    hash = hashVector(data, hash);
   }
 
-  buildMeshes(map, wad, models);
+  return hashFloatVector(atlas.mUvOffsets, hash);
 }
 
 
-MapRenderer::~MapRenderer() = default;
+bool isClosedBlock(
+  const BlockDef& blockDef,
+  const std::vector<TextureDef>& textureDefs)
+{
+  const auto& outside = blockDef.texturesOutside;
+  const auto textures = std::array{
+    outside.back,
+    outside.top,
+    outside.left,
+    outside.front,
+    outside.right,
+    outside.bottom};
+
+  return std::all_of(
+    textures.begin(),
+    textures.end(),
+    [&](const uint16_t texture) {
+      return texture != 0 && texture < textureDefs.size() &&
+        !textureDefs[texture].isMasked;
+    });
+}
 
+/** A quad of world geometry, i.e. terrain or a block face */
+struct WorldQuad
+{
+  MeshBufferData<Vertex>* mpTarget;
+  std::array<MapVertex, 4> mCorners;
+  uint16_t mTexture;
+  int mTextureRotation;
+  bool mMergeable;
+  std::array<float, 4> mBrightness;
+};
 
-void MapRenderer::handleEvent(const SDL_Event& event, double dt) { }
 
+/** Range of quads making up the inside faces of a closed block */
+struct PendingInterior
+{
+  size_t mFirstQuad;
+  size_t mEndQuad;
+  BlockInterior mBounds;
+};
 
-void MapRenderer::updateAndRender(
-  double dt,
-  const rigel::base::Size& windowSize)
+
+/** Removes quads which exactly duplicate an earlier quad
+ *
+ * Overlapping blocks or extra terrain tiles in the same cell produce
+ * identical faces, which cause z-fighting and waste triangles. Map vertices
+ * are integers, so positions can be compared exactly.
+ *
+ * Quads belonging to a pending interior are only compared against other
+ * quads of the same interior, since each interior is shown or hidden on its
+ * own. All other quads are compared against each other. Pending interiors
+ * are adjusted to the new quad indices. Returns the number of quads removed.
+ */
+size_t removeDuplicateQuads(
+  std::vector<WorldQuad>& quads,
+  std::vector<PendingInterior>& interiors)
 {
-  moveCamera(dt);
+  // 0 for quads outside of any interior, otherwise interior index + 1
+  std::vector<size_t> quadGroups(quads.size(), 0);
 
-  const auto view = glm::lookAt(
-    mCameraPosition,
-    mCameraPosition + mCameraDirection,
-    glm::vec3(0.0f, 1.0f, 0.0f));
+  for (auto i = size_t(0); i < interiors.size(); ++i)
+  {
+    std::fill(
+      quadGroups.begin() + interiors[i].mFirstQuad,
+      quadGroups.begin() + interiors[i].mEndQuad,
+      i + 1);
+  }
 
-  const auto windowAspectRatio =
-    float(windowSize.width) / float(windowSize.height);
-  auto matrix =
-    glm::perspective(glm::radians(90.0f), windowAspectRatio, 0.1f, 100.0f) *
-    view;
+  auto quadHash = [&](const size_t index) {
+    const auto& quad = quads[index];
 
-  mShader.use();
-  mShader.setUniform("transform", matrix);
+    auto hash = std::hash<const void*>{}(quad.mpTarget);
+    hash = hash * 31 + quadGroups[index];
 
-  if (mCullFaces)
+    for (const auto& corner : quad.mCorners)
+    {
+      for (const auto value : {corner.x, corner.y, corner.verticalOffset})
+      {
+        hash = hash * 31 + std::hash<int>{}(value);
+      }
+    }
+
+    return hash * 31 + quad.mTexture;
+  };
+
+  auto quadsEqual = [&](const size_t lhsIndex, const size_t rhsIndex) {
+    const auto& lhs = quads[lhsIndex];
+    const auto& rhs = quads[rhsIndex];
+
+    return quadGroups[lhsIndex] == quadGroups[rhsIndex] &&
+      lhs.mpTarget == rhs.mpTarget && lhs.mTexture == rhs.mTexture &&
+      lhs.mTextureRotation == rhs.mTextureRotation &&
+      lhs.mMergeable == rhs.mMergeable && lhs.mBrightness == rhs.mBrightness &&
+      std::equal(
+             lhs.mCorners.begin(),
+             lhs.mCorners.end(),
+             rhs.mCorners.begin(),
+             [](const MapVertex& a, const MapVertex& b) {
+               return a.x == b.x && a.y == b.y &&
+                 a.verticalOffset == b.verticalOffset;
+             });
+  };
+
+  std::unordered_set<size_t, decltype(quadHash), decltype(quadsEqual)>
+    uniqueQuads(quads.size(), quadHash, quadsEqual);
+
+  // Maps old quad indices to new ones, with one extra entry for the end
+  std::vector<size_t> newIndices(quads.size() + 1);
+  auto numKept = size_t(0);
+
+  for (auto i = size_t(0); i < quads.size(); ++i)
   {
-    glEnable(GL_CULL_FACE);
+    newIndices[i] = numKept;
+
+    if (uniqueQuads.insert(i).second)
+    {
+      // Quads are only moved once this loop is done, since the set
+      // accesses them by index
+      ++numKept;
+    }
   }
-  else
+
+  newIndices.back() = numKept;
+
+  if (numKept == quads.size())
   {
-    glDisable(GL_CULL_FACE);
+    return 0;
   }
 
+  auto nextSlot = size_t(0);
 
-  const auto clearColor = opengl::toGlColor(mBackgroundColor);
-  glClearColor(clearColor.r, clearColor.g, clearColor.b, clearColor.a);
-  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+  for (auto i = size_t(0); i < quads.size(); ++i)
+  {
+    if (newIndices[i + 1] != newIndices[i])
+    {
+      quads[nextSlot++] = quads[i];
+    }
+  }
 
-  glBindTexture(GL_TEXTURE_2D, mWorldTextures.mTexture);
+  const auto numRemoved = quads.size() - numKept;
+  quads.resize(numKept);
 
-  if (mShowTerrain)
+  for (auto& interior : interiors)
   {
-    mTerrainMesh.draw();
+    interior.mFirstQuad = newIndices[interior.mFirstQuad];
+    interior.mEndQuad = newIndices[interior.mEndQuad];
   }
 
-  if (mShowGeometry)
+  return numRemoved;
+}
+
+
+glm::vec3 toWorldSpace(const MapVertex& v)
+{
+  const auto vertex = makeVertex(v, {});
+  return glm::vec3(vertex.x, vertex.y, vertex.z);
+}
+
+
+/** Bakes ambient occlusion for all corners of the given quads
+ *
+ * Returns 4 entries per quad, in the same order as the quads' corners. All
+ * quads act as occluders.
+ */
+std::vector<VertexLighting> bakeQuadLighting(
+  const std::vector<WorldQuad>& quads,
+  const bool useBakeCache)
+{
+  std::vector<glm::vec3> triangles;
+  triangles.reserve(quads.size() * 6);
+
+  struct Corner
+  {
+    MapVertex mPosition;
+    glm::ivec3 mNormal;
+    glm::vec3 mExactNormal;
+    uint32_t mIndex;
+  };
+
+  std::vector<Corner> corners;
+  corners.reserve(quads.size() * 4);
+
+  for (const auto& quad : quads)
   {
-    mBlocksMesh.draw(mShader);
+    std::array<glm::vec3, 4> points;
+    std::transform(
+      quad.mCorners.begin(), quad.mCorners.end(), points.begin(), toWorldSpace);
+
+    // Same triangulation as MeshBufferData::addQuad()
+    for (const auto index : {0, 3, 1, 1, 3, 2})
+    {
+      triangles.push_back(points[index]);
+    }
+
+    // Using the diagonals also gives a sensible normal for quads that
+    // aren't quite planar
+    auto normal = glm::cross(points[3] - points[1], points[2] - points[0]);
+
+    if (glm::length(normal) > 0.0f)
+    {
+      normal = glm::normalize(normal);
+    }
+
+    for (const auto& corner : quad.mCorners)
+    {
+      corners.push_back(
+        {corner,
+         glm::ivec3(glm::round(normal * 1024.0f)),
+         normal,
+         uint32_t(corners.size())});
+    }
   }
 
-  if (mShowModels)
+
+  // Neighboring quads facing the same direction share corners, these only
+  // need to be computed once
+  auto cornerKey = [](const Corner& corner) {
+    return std::tie(
+      corner.mPosition.x,
+      corner.mPosition.y,
+      corner.mPosition.verticalOffset,
+      corner.mNormal.x,
+      corner.mNormal.y,
+      corner.mNormal.z);
+  };
+
+  std::sort(
+    corners.begin(), corners.end(), [&](const Corner& lhs, const Corner& rhs) {
+      return cornerKey(lhs) < cornerKey(rhs);
+    });
+
+  std::vector<OcclusionQuery> queries;
+  std::vector<uint32_t> queryIndices(corners.size());
+
+  for (auto i = 0u; i < corners.size(); ++i)
   {
-    glBindTexture(GL_TEXTURE_2D, mModelTextures.mTexture);
+    if (i == 0 || cornerKey(corners[i - 1]) != cornerKey(corners[i]))
+    {
+      queries.push_back(
+        {toWorldSpace(corners[i].mPosition), corners[i].mExactNormal});
+    }
+
+    queryIndices[corners[i].mIndex] = uint32_t(queries.size() - 1);
+  }
 
-    mModelsMesh.draw(mShader);
+  const auto occlusion =
+    bakeAmbientOcclusion(triangles, queries, useBakeCache);
+
+  std::vector<VertexLighting> result(queryIndices.size());
+
+  for (auto i = 0u; i < result.size(); ++i)
+  {
+    result[i].ambientOcclusion = occlusion[queryIndices[i]];
   }
+
+  return result;
 }
 
 
-void MapRenderer::buildMeshes(
-  const MapData& map,
+std::array<TexCoords, 4> getTexCoords(
+  const uint16_t textureDefIndex,
+  const TextureAtlas& atlas,
+  const rigel::base::ArrayView<TextureDef> textureDefs)
+{
+  std::array<TexCoords, 4> texCoords;
+
+  const auto& texDef = textureDefs[textureDefIndex];
+
+  // The game's texture coordinates are relative to their respective page,
+  // but we combine all pages into a single texture atlas. Adjust U
+  // coordinates accordingly.
+  const auto uOffset = atlas.mUvOffsets[texDef.bitmapIndex];
+
+  std::transform(
+    texDef.uvs.begin(),
+    texDef.uvs.end(),
+    texCoords.begin(),
+    [&](const UvPair& uv) {
+      return TexCoords{
+        (float(uv.u) + 0.5f) / atlas.mWidth + uOffset,
+        (float(uv.v) + 0.5f) / float(TEXTURE_PAGE_SIZE)};
+    });
+
+  return texCoords;
+}
+
+
+/** Adds the given model's faces to the buffers, placed by the transform
+ *
+ * The transform is applied on top of the model's own transformation matrix.
+ */
+void addModelFaces(
+  const ModelData& model,
+  const glm::mat4& instanceTransform,
   const WadData& wad,
-  const std::unordered_map<std::string, ModelData>& models)
+  const TextureAtlas& atlas,
+  MeshBufferData<Vertex>& solidFaces,
+  MeshBufferData<Vertex>& maskedFaces)
 {
-  auto getTexCoords = [](
-                        uint16_t textureDefIndex,
-                        const TextureAtlas& atlas,
-                        const rigel::base::ArrayView<TextureDef> textureDefs) {
-    std::array<TexCoords, 4> texCoords;
+  const auto transform =
+    instanceTransform * convertMatrix(model.transformationMatrix);
 
-    const auto& texDef = textureDefs[textureDefIndex];
+  auto makeModelVertex = [&](const uint16_t index, const TexCoords& uv) {
+    const auto& coords = model.vertices[index];
 
-    // The game's texture coordinates are relative to their respective page,
-    // but we combine all pages into a single texture atlas. Adjust U
-    // coordinates accordingly.
-    const auto uOffset = atlas.mUvOffsets[texDef.bitmapIndex];
+    const auto x = coords.x / -256.0f;
+    const auto y = coords.y / -256.0f;
+    const auto z = coords.z / 256.0f;
 
-    std::transform(
-      texDef.uvs.begin(),
-      texDef.uvs.end(),
-      texCoords.begin(),
-      [&](const UvPair& uv) {
-        return TexCoords{
-          (float(uv.u) + 0.5f) / atlas.mWidth + uOffset,
-          (float(uv.v) + 0.5f) / float(TEXTURE_PAGE_SIZE)};
-      });
+    const auto transformed = transform * glm::vec4(x, y, z, 1.0);
 
-    return texCoords;
+    return Vertex{glm::vec3(transformed), uv};
   };
 
 
+  for (const auto& face : model.faces)
+  {
+    const auto uvs = getTexCoords(face.mTexture, atlas, wad.mTextureDefs);
+    const auto indices = face.indices();
+
+    auto& buffer =
+      wad.mTextureDefs[face.mTexture].isMasked ? maskedFaces : solidFaces;
+
+    if (indices.size() == 3)
+    {
+      buffer.addTriangle(
+        makeModelVertex(indices[0], uvs[0]),
+        makeModelVertex(indices[1], uvs[1]),
+        makeModelVertex(indices[2], uvs[2]));
+    }
+    else
+    {
+      buffer.addQuad(
+        makeModelVertex(indices[0], uvs[0]),
+        makeModelVertex(indices[1], uvs[1]),
+        makeModelVertex(indices[2], uvs[2]),
+        makeModelVertex(indices[3], uvs[3]));
+    }
+  }
+}
+
+
+void buildMeshes(
+  const MapData& map,
+  const WadData& wad,
+  const std::unordered_map<std::string, ModelData>& models,
+  const LevelBuildOptions& options,
+  LevelData& level)
+{
   auto getWorldTexCoords = [&](uint16_t index) {
-    return getTexCoords(index, mWorldTextures, map.mTextureDefs);
+    return getTexCoords(index, level.mWorldTextures, map.mTextureDefs);
   };
 
 
-  auto getModelTexCoords = [&](uint16_t index) {
-    return getTexCoords(index, mModelTextures, wad.mTextureDefs);
+  std::vector<std::optional<RepeatableTexture>> repeatableWorldTextures;
+  repeatableWorldTextures.reserve(map.mTextureDefs.size());
+
+  for (const auto& texDef : map.mTextureDefs)
+  {
+    repeatableWorldTextures.push_back(
+      makeRepeatableTexture(texDef, level.mWorldTextures));
+  }
+
+
+  // Flat, axis-aligned quads are handed to the merger first. Only if that's
+  // not possible do we add them to their mesh directly.
+  QuadMerger quadMerger;
+
+  auto tryMergeQuad = [&](
+                        MeshBufferData<Vertex>& buffer,
+                        const std::array<MapVertex, 4>& corners,
+                        const uint16_t texture,
+                        const int textureRotation,
+                        const VertexLighting& lighting) {
+    const auto& oRepeatableTexture = repeatableWorldTextures[texture];
+
+    if (!oRepeatableTexture)
+    {
+      return false;
+    }
+
+    std::array<TexCoords, 4> texCoords;
+
+    for (auto i = 0u; i < texCoords.size(); ++i)
+    {
+      texCoords[i] =
+        oRepeatableTexture->mTexCoords[(i + textureRotation) % 4];
+    }
+
+    return quadMerger.addQuad(
+      buffer, corners, texCoords, oRepeatableTexture->mRect, lighting);
   };
 
 
+  // Terrain and block faces are collected first, so that ambient occlusion
+  // can be computed for all of them at once. Meshes are built afterwards.
+  std::vector<WorldQuad> worldQuads;
+  std::vector<PendingInterior> pendingInteriors;
+
   MeshBufferData<Vertex> terrainBuffer;
 
   for (auto y = 0; y < MAP_SIZE; ++y)
@@ -465,15 +1437,16 @@ void MapRenderer::buildMeshes(
     for (auto x = 0; x < MAP_SIZE; ++x)
     {
       const auto& tile = map.terrainAt(x, y);
-      const auto& blockDef = map.mBlockDefs[tile.blockDefIndex];
-      const auto texture = blockDef.texturesInside.bottom;
+      const auto texture = terrainTexture(map, tile.blockDefIndex);
 
       if (texture == 0)
       {
         continue;
       }
 
-      auto uvs = getWorldTexCoords(texture);
+      ++level.mStatistics.mNumTerrainTiles;
+      level.mStatistics.addBlockDefUse(tile.blockDefIndex);
+      level.mStatistics.addTextureDefUse(map, texture);
 
       const auto vertOffset0 = tile.verticalOffset;
       const auto vertOffset1 =
@@ -487,19 +1460,37 @@ void MapRenderer::buildMeshes(
       const auto rotation = 4 - tile.flags.rotation();
 
       // clang-format off
-      terrainBuffer.addQuad(
-        makeVertex(x,     y,     vertOffset0, uvs[(0 + rotation) % 4]),
-        makeVertex(x + 1, y,     vertOffset1, uvs[(1 + rotation) % 4]),
-        makeVertex(x + 1, y + 1, vertOffset3, uvs[(2 + rotation) % 4]),
-        makeVertex(x,     y + 1, vertOffset2, uvs[(3 + rotation) % 4]));
+      const auto corners = std::array<MapVertex, 4>{{
+        {x,     y,     vertOffset0},
+        {x + 1, y,     vertOffset1},
+        {x + 1, y + 1, vertOffset3},
+        {x,     y + 1, vertOffset2},
+      }};
       // clang-format on
+
+      const auto brightness = std::array{
+        terrainBrightnessAt(map, x, y),
+        terrainBrightnessAt(map, x + 1, y),
+        terrainBrightnessAt(map, x + 1, y + 1),
+        terrainBrightnessAt(map, x, y + 1)};
+
+      worldQuads.push_back(
+        {&terrainBuffer, corners, texture, rotation, true, brightness});
     }
   }
 
 
+  MeshBufferData<Vertex> extraTerrainBuffer;
+
   MeshBufferData<Vertex> blocksBuffer;
   MeshBufferData<Vertex> blocksBufferMasked;
 
+  MeshBufferData<Vertex> interiorsBuffer;
+  MeshBufferData<Vertex> interiorsBufferMasked;
+  std::vector<Meshlet> interiorRanges;
+  std::vector<Meshlet> interiorRangesMasked;
+  std::vector<BlockInterior> interiorsMasked;
+
   MeshBufferData<Vertex> modelsBuffer;
   MeshBufferData<Vertex> modelsBufferMasked;
 
@@ -508,15 +1499,16 @@ void MapRenderer::buildMeshes(
     base::match(
       item,
       [&](const ExtraTerrainTile& tile) {
-        const auto& blockDef = map.mBlockDefs[tile.blockDefIndex];
-        const auto texture = blockDef.texturesInside.bottom;
+        const auto texture = terrainTexture(map, tile.blockDefIndex);
 
         if (texture == 0)
         {
           return;
         }
 
-        auto uvs = getWorldTexCoords(texture);
+        ++level.mStatistics.mNumExtraTerrainTiles;
+        level.mStatistics.addBlockDefUse(tile.blockDefIndex);
+        level.mStatistics.addTextureDefUse(map, texture);
 
         const auto rotation = 4 - tile.flags.rotation();
 
@@ -525,12 +1517,23 @@ void MapRenderer::buildMeshes(
         const auto& verticalOffsets = tile.vertexCoordinatesY;
 
         // clang-format off
-        terrainBuffer.addQuad(
-          makeVertex(x,     y,     verticalOffsets[0], uvs[(0 + rotation) % 4]),
-          makeVertex(x + 1, y,     verticalOffsets[1], uvs[(1 + rotation) % 4]),
-          makeVertex(x + 1, y + 1, verticalOffsets[2], uvs[(2 + rotation) % 4]),
-          makeVertex(x,     y + 1, verticalOffsets[3], uvs[(3 + rotation) % 4]));
+        const auto corners = std::array<MapVertex, 4>{{
+          {x,     y,     verticalOffsets[0]},
+          {x + 1, y,     verticalOffsets[1]},
+          {x + 1, y + 1, verticalOffsets[2]},
+          {x,     y + 1, verticalOffsets[3]},
+        }};
         // clang-format on
+
+        const auto brightness = brightnessFactor(tile.brightnessAdjustment);
+
+        worldQuads.push_back(
+          {&extraTerrainBuffer,
+           corners,
+           texture,
+           rotation,
+           false,
+           {brightness, brightness, brightness, brightness}});
       },
 
       [&](const BlockInstance& block) {
@@ -539,6 +1542,10 @@ void MapRenderer::buildMeshes(
         const auto x = block.x;
         const auto y = block.y;
         const auto baseOffset = block.verticalOffset;
+        const auto brightness = brightnessFactor(block.brightnessAdjustment);
+
+        ++level.mStatistics.mNumBlocks;
+        level.mStatistics.addBlockDefUse(block.blockDefIndex);
 
         // clang-format off
         std::array<MapVertex, 8> vertices{{
@@ -564,6 +1571,15 @@ void MapRenderer::buildMeshes(
         }
 
 
+        // Inside faces of a block that's closed on all sides can only be
+        // seen from within the block. These are kept in a separate mesh,
+        // grouped by block, so that we can skip them unless the camera is
+        // inside. Merging isn't possible for these, since that would combine
+        // faces from multiple blocks.
+        auto pSolidBuffer = &blocksBuffer;
+        auto pMaskedBuffer = &blocksBufferMasked;
+        auto mergeFaces = true;
+
         auto addFace = [&](
                          auto texture,
                          int vi0,
@@ -576,38 +1592,26 @@ void MapRenderer::buildMeshes(
             return;
           }
 
-          const auto uvs = getWorldTexCoords(texture);
+          level.mStatistics.addTextureDefUse(map, texture);
 
           // Masked faces need to be kept separate, as we have to render them
           // with alpha-testing enabled.
-          auto pBuffer = map.mTextureDefs[texture].isMasked
-            ? &blocksBufferMasked
-            : &blocksBuffer;
-
-          pBuffer->addQuad(
-            makeVertex(vertices[vi0], uvs[(0 + textureRotation) % 4]),
-            makeVertex(vertices[vi1], uvs[(1 + textureRotation) % 4]),
-            makeVertex(vertices[vi2], uvs[(2 + textureRotation) % 4]),
-            makeVertex(vertices[vi3], uvs[(3 + textureRotation) % 4]));
+          auto pBuffer =
+            map.mTextureDefs[texture].isMasked ? pMaskedBuffer : pSolidBuffer;
+
+          const auto corners = std::array<MapVertex, 4>{
+            vertices[vi0], vertices[vi1], vertices[vi2], vertices[vi3]};
+
+          worldQuads.push_back(
+            {pBuffer,
+             corners,
+             texture,
+             textureRotation,
+             mergeFaces,
+             {brightness, brightness, brightness, brightness}});
         };
 
 
-        addFace(
-          blockDef.texturesOutside.top, 4, 5, 6, 7, block.flags.rotation());
-        addFace(
-          blockDef.texturesInside.top, 7, 6, 5, 4, block.flags.rotation());
-
-        // clang-format off
-        addFace(
-          blockDef.texturesOutside.bottom,
-          3, 2, 1, 0,
-          4 - block.flags.rotation());
-        addFace(
-          blockDef.texturesInside.bottom,
-          0, 1, 2, 3,
-          4 - block.flags.rotation());
-        // clang-format on
-
         const auto sides = std::array{
           blockDef.texturesOutside.left,
           blockDef.texturesOutside.front,
@@ -619,19 +1623,67 @@ void MapRenderer::buildMeshes(
           blockDef.texturesInside.back};
         const auto sidesRotation = 4 - block.flags.rotation();
 
+        // clang-format off
+        addFace(
+          blockDef.texturesOutside.top, 4, 5, 6, 7, block.flags.rotation());
+        addFace(
+          blockDef.texturesOutside.bottom,
+          3, 2, 1, 0,
+          4 - block.flags.rotation());
+        // clang-format on
         addFace(sides[(0 + sidesRotation) % 4], 4, 7, 3, 0);
         addFace(sides[(1 + sidesRotation) % 4], 7, 6, 2, 3);
         addFace(sides[(2 + sidesRotation) % 4], 6, 5, 1, 2);
         addFace(sides[(3 + sidesRotation) % 4], 5, 4, 0, 1);
+
+
+        const auto isClosed = isClosedBlock(blockDef, map.mTextureDefs);
+
+        if (isClosed)
+        {
+          pSolidBuffer = &interiorsBuffer;
+          pMaskedBuffer = &interiorsBufferMasked;
+          mergeFaces = false;
+        }
+
+        const auto firstInteriorQuad = worldQuads.size();
+
+        // clang-format off
+        addFace(
+          blockDef.texturesInside.top, 7, 6, 5, 4, block.flags.rotation());
+        addFace(
+          blockDef.texturesInside.bottom,
+          0, 1, 2, 3,
+          4 - block.flags.rotation());
+        // clang-format on
         addFace(sides[(0 + sidesRotation) % 4 + 4], 7, 4, 0, 3);
         addFace(sides[(1 + sidesRotation) % 4 + 4], 6, 7, 3, 2);
         addFace(sides[(2 + sidesRotation) % 4 + 4], 5, 6, 2, 1);
         addFace(sides[(3 + sidesRotation) % 4 + 4], 4, 5, 1, 0);
+
+        if (isClosed && worldQuads.size() > firstInteriorQuad)
+        {
+          auto bounds = BlockInterior{
+            glm::vec3(std::numeric_limits<float>::max()),
+            glm::vec3(std::numeric_limits<float>::lowest())};
+
+          for (const auto& vertex : vertices)
+          {
+            const auto point = toWorldSpace(vertex);
+            bounds.mMin = glm::min(bounds.mMin, point);
+            bounds.mMax = glm::max(bounds.mMax, point);
+          }
+
+          pendingInteriors.push_back(
+            {firstInteriorQuad, worldQuads.size(), bounds});
+        }
       },
 
       [&](const ModelInstance& model) {
         const auto& modelData = models.at(model.modelName);
 
+        ++level.mStatistics.mNumModels;
+
         const auto baseX = float(model.x) - 32.0f;
         const auto baseZ = float(model.y) - 32.0f;
 
@@ -657,56 +1709,1087 @@ void MapRenderer::buildMeshes(
           transform,
           glm::radians(convertRotation(model.rotationX)),
           glm::vec3(-1.0f, 0.0f, 0.0f));
-        transform *= convertMatrix(modelData.transformationMatrix);
-
 
-        auto makeModelVertex = [&](const uint16_t index, const TexCoords& uv) {
-          const auto& coords = modelData.vertices[index];
+        addModelFaces(
+          modelData,
+          transform,
+          wad,
+          level.modelTextures(),
+          modelsBuffer,
+          modelsBufferMasked);
+      });
+  }
 
-          const auto x = coords.x / -256.0f;
-          const auto y = coords.y / -256.0f;
-          const auto z = coords.z / 256.0f;
 
-          const auto transformed = transform * glm::vec4(x, y, z, 1.0);
+  level.mNumDuplicateFaces =
+    removeDuplicateQuads(worldQuads, pendingInteriors);
 
-          return Vertex{glm::vec3(transformed), uv};
-        };
+  const auto quadLighting = options.mAmbientOcclusion
+    ? bakeQuadLighting(worldQuads, options.mUseBakeCache)
+    : std::vector<VertexLighting>(worldQuads.size() * 4);
 
+  auto emitQuad = [&](const size_t index) {
+    const auto& quad = worldQuads[index];
+    const auto rotation = quad.mTextureRotation;
 
-        for (const auto& face : modelData.faces)
-        {
-          const auto uvs = getModelTexCoords(face.mTexture);
-          const auto indices = face.indices();
+    auto lighting = std::array<VertexLighting, 4>{};
 
-          auto& buffer = wad.mTextureDefs[face.mTexture].isMasked
-            ? modelsBufferMasked
-            : modelsBuffer;
+    for (auto i = 0u; i < lighting.size(); ++i)
+    {
+      lighting[i] = quadLighting[index * 4 + i];
+      lighting[i].brightness = quad.mBrightness[i];
+    }
 
-          if (indices.size() == 3)
-          {
-            buffer.addTriangle(
-              makeModelVertex(indices[0], uvs[0]),
-              makeModelVertex(indices[1], uvs[1]),
-              makeModelVertex(indices[2], uvs[2]));
-          }
-          else
-          {
-            buffer.addQuad(
-              makeModelVertex(indices[0], uvs[0]),
-              makeModelVertex(indices[1], uvs[1]),
-              makeModelVertex(indices[2], uvs[2]),
-              makeModelVertex(indices[3], uvs[3]));
-          }
-        }
+    // Merged quads only have lighting values at their outer corners, so we
+    // can only merge where lighting is uniform
+    const auto hasUniformLighting = std::all_of(
+      lighting.begin() + 1,
+      lighting.end(),
+      [&](const VertexLighting& cornerLighting) {
+        return cornerLighting == lighting[0];
       });
-  }
 
+    if (
+      quad.mMergeable && hasUniformLighting &&
+      tryMergeQuad(
+        *quad.mpTarget, quad.mCorners, quad.mTexture, rotation, lighting[0]))
+    {
+      return;
+    }
+
+    const auto uvs = getWorldTexCoords(quad.mTexture);
+
+    quad.mpTarget->addQuad(
+      makeVertex(quad.mCorners[0], uvs[(0 + rotation) % 4], {}, lighting[0]),
+      makeVertex(quad.mCorners[1], uvs[(1 + rotation) % 4], {}, lighting[1]),
+      makeVertex(quad.mCorners[2], uvs[(2 + rotation) % 4], {}, lighting[2]),
+      makeVertex(quad.mCorners[3], uvs[(3 + rotation) % 4], {}, lighting[3]));
+  };
+
+  auto nextQuad = size_t(0);
+
+  auto emitQuadsUntil = [&](const size_t end) {
+    for (; nextQuad < end; ++nextQuad)
+    {
+      emitQuad(nextQuad);
+    }
+  };
+
+  auto addInteriorRange = [&](
+                            const MeshBufferData<Vertex>& buffer,
+                            const uint32_t start,
+                            const BlockInterior& bounds,
+                            std::vector<Meshlet>& meshlets,
+                            std::vector<BlockInterior>& interiors) {
+    if (buffer.mIndexBuffer.size() > start)
+    {
+      auto range = Meshlet{};
+      range.mCenter = (bounds.mMin + bounds.mMax) * 0.5f;
+      range.mRadius = glm::distance(bounds.mMin, bounds.mMax) * 0.5f;
+      range.mFirstIndex = start;
+      range.mNumIndices = uint32_t(buffer.mIndexBuffer.size()) - start;
+      meshlets.push_back(range);
+      interiors.push_back(bounds);
+    }
+  };
+
+  for (const auto& interior : pendingInteriors)
+  {
+    emitQuadsUntil(interior.mFirstQuad);
+
+    const auto solidStart = uint32_t(interiorsBuffer.mIndexBuffer.size());
+    const auto maskedStart =
+      uint32_t(interiorsBufferMasked.mIndexBuffer.size());
+
+    emitQuadsUntil(interior.mEndQuad);
+
+    addInteriorRange(
+      interiorsBuffer,
+      solidStart,
+      interior.mBounds,
+      interiorRanges,
+      level.mBlockInteriorBounds);
+    addInteriorRange(
+      interiorsBufferMasked,
+      maskedStart,
+      interior.mBounds,
+      interiorRangesMasked,
+      interiorsMasked);
+  }
+
+  emitQuadsUntil(worldQuads.size());
+
+  quadMerger.emitMergedQuads();
+
+  level.mTerrain = std::move(terrainBuffer);
+  level.mExtraTerrain = std::move(extraTerrainBuffer);
+  level.mBlocks = makeMaskedMeshData(
+    std::move(blocksBuffer), std::move(blocksBufferMasked));
+
+  // Block interiors use one meshlet per block, which doesn't fit the usual
+  // size limit but lets us cull them as a whole
+  level.mBlockInteriorBounds.insert(
+    level.mBlockInteriorBounds.end(),
+    interiorsMasked.begin(),
+    interiorsMasked.end());
+  level.mBlockInteriors = makeMaskedMeshData(
+    std::move(interiorsBuffer),
+    std::move(interiorRanges),
+    std::move(interiorsBufferMasked),
+    std::move(interiorRangesMasked));
+
+  level.mModels = makeMaskedMeshData(
+    std::move(modelsBuffer), std::move(modelsBufferMasked));
+
+  auto& statistics = level.mStatistics;
+  statistics.mNumTerrainTriangles = level.mTerrain.mIndexBuffer.size() / 3;
+  statistics.mNumExtraTerrainTriangles =
+    level.mExtraTerrain.mIndexBuffer.size() / 3;
+  statistics.mNumBlockTriangles =
+    level.mBlocks.mFaces.mIndexBuffer.size() / 3;
+  statistics.mNumBlockInteriorTriangles =
+    level.mBlockInteriors.mFaces.mIndexBuffer.size() / 3;
+  statistics.mNumModelTriangles =
+    level.mModels.mFaces.mIndexBuffer.size() / 3;
+}
+
+
+void buildTerrainTextureData(const MapData& map, LevelData& level)
+{
+  level.mTerrainTileData.reserve(MAP_SIZE * MAP_SIZE * 4);
+
+  for (auto y = 0; y < MAP_SIZE; ++y)
+  {
+    for (auto x = 0; x < MAP_SIZE; ++x)
+    {
+      const auto texel = terrainTileData(map, x, y);
+      level.mTerrainTileData.insert(
+        level.mTerrainTileData.end(), texel.begin(), texel.end());
+    }
+  }
+
+  const auto numRows = int(
+    (map.mTextureDefs.size() + TEXTURE_DEFS_PER_ROW - 1) /
+    TEXTURE_DEFS_PER_ROW);
+
+  level.mNumTextureDefRows = std::max(numRows, 1);
+  level.mTextureDefData.assign(
+    size_t(level.mNumTextureDefRows * TEXTURE_DEFS_PER_ROW * 8), 0.0f);
+
+  const auto& atlas = level.mWorldTextures;
+
+  auto i = 0u;
+  for (const auto& texDef : map.mTextureDefs)
+  {
+    const auto uOffset = atlas.mUvOffsets[texDef.bitmapIndex];
+
+    for (const auto& uv : texDef.uvs)
+    {
+      // Same mapping as in getTexCoords()
+      level.mTextureDefData[i++] =
+        (float(uv.u) + 0.5f) / atlas.mWidth + uOffset;
+      level.mTextureDefData[i++] =
+        (float(uv.v) + 0.5f) / float(TEXTURE_PAGE_SIZE);
+    }
+  }
+}
+
+
+void computeBounds(LevelData& level)
+{
+  auto boundsMin = glm::vec3(std::numeric_limits<float>::max());
+  auto boundsMax = glm::vec3(std::numeric_limits<float>::lowest());
+
+  for (const auto* pBuffer :
+       {&level.mTerrain,
+        &level.mExtraTerrain,
+        &level.mBlocks.mFaces,
+        &level.mBlockInteriors.mFaces,
+        &level.mModels.mFaces})
+  {
+    for (const auto& vertex : pBuffer->mVertexBuffer)
+    {
+      const auto position = glm::vec3(vertex.x, vertex.y, vertex.z);
+      boundsMin = glm::min(boundsMin, position);
+      boundsMax = glm::max(boundsMax, position);
+    }
+  }
+
+  if (boundsMin.x <= boundsMax.x)
+  {
+    level.mBoundsMin = boundsMin;
+    level.mBoundsMax = boundsMax;
+  }
+}
+
+} // namespace
+
+
+TextureAtlas::TextureAtlas(
+  const WadData& wad,
+  rigel::base::ArrayView<int> pages)
+  : mImage(wad.buildTextureAtlas(pages))
+  , mWidth(float(mImage.width()))
+  , mUvOffsets(buildAtlasUvOffsetTable(pages, wad))
+{
+}
+
+
+std::size_t LevelData::estimatedMemoryUsage() const
+{
+  const auto modelTexturesSize =
+    moModelTextures ? atlasSize(*moModelTextures) : 0;
+
+  return atlasSize(mWorldTextures) + modelTexturesSize +
+    bufferSize(mTerrain) + bufferSize(mExtraTerrain) +
+    bufferSize(mBlocks.mFaces) + bufferSize(mBlockInteriors.mFaces) +
+    bufferSize(mModels.mFaces) +
+    (mTerrainTileData.size() + mTextureDefData.size()) * sizeof(float);
+}
+
+
+std::uint64_t LevelData::contentHash() const
+{
+  auto hash = hashBytes(
+    &mBackgroundColor, sizeof(mBackgroundColor), INITIAL_BAKE_HASH);
+
+  hash = hashAtlas(mWorldTextures, hash);
+  hash = hashAtlas(modelTextures(), hash);
+  hash = hashMeshBuffer(mTerrain, hash);
+  hash = hashMeshBuffer(mExtraTerrain, hash);
+  hash = hashMaskedMesh(mBlocks, hash);
+  hash = hashMaskedMesh(mBlockInteriors, hash);
+  hash = hashFloatVector(mBlockInteriorBounds, hash);
+  hash = hashMaskedMesh(mModels, hash);
+  hash = hashFloatVector(mTerrainTileData, hash);
+  hash = hashFloatVector(mTextureDefData, hash);
+
+  const auto numTextureDefRows = std::int32_t(mNumTextureDefRows);
+  return hashBytes(&numTextureDefRows, sizeof(numTextureDefRows), hash);
+}
+
+
+ModelPreviewData
+  buildModelPreviewData(const WadData& wad, const std::string& modelName)
+{
+  ModelPreviewData preview;
+
+  const auto models = std::unordered_map<std::string, ModelData>{
+    {modelName, wad.loadModel(modelName)}};
+  const auto& model = models.at(modelName);
+
+  {
+    const auto pagesUsed = determineModelTexturePagesUsed(models, wad);
+    preview.mTextures = TextureAtlas(wad, pagesUsed);
+  }
+
+  MeshBufferData<Vertex> solidFaces;
+  MeshBufferData<Vertex> maskedFaces;
+  addModelFaces(
+    model, glm::mat4(1.0f), wad, preview.mTextures, solidFaces, maskedFaces);
+
+  // Center the model at the origin, so that it can be rotated in place
+  auto boundsMin = glm::vec3(std::numeric_limits<float>::max());
+  auto boundsMax = glm::vec3(std::numeric_limits<float>::lowest());
+
+  for (const auto* pBuffer : {&solidFaces, &maskedFaces})
+  {
+    for (const auto& vertex : pBuffer->mVertexBuffer)
+    {
+      const auto position = glm::vec3(vertex.x, vertex.y, vertex.z);
+      boundsMin = glm::min(boundsMin, position);
+      boundsMax = glm::max(boundsMax, position);
+    }
+  }
+
+  if (boundsMin.x <= boundsMax.x)
+  {
+    const auto center = (boundsMin + boundsMax) * 0.5f;
+
+    for (auto* pBuffer : {&solidFaces, &maskedFaces})
+    {
+      for (auto& vertex : pBuffer->mVertexBuffer)
+      {
+        vertex.x -= center.x;
+        vertex.y -= center.y;
+        vertex.z -= center.z;
+      }
+    }
+
+    preview.mRadius = glm::distance(boundsMin, boundsMax) * 0.5f;
+  }
+
+  preview.mNumTriangles = uint32_t(
+    (solidFaces.mIndexBuffer.size() + maskedFaces.mIndexBuffer.size()) / 3);
+  preview.mMesh =
+    makeMaskedMeshData(std::move(solidFaces), std::move(maskedFaces));
+
+  return preview;
+}
+
+
+MaskedMesh
+  createMaskedMesh(MaskedMeshData&& data, const rigel::opengl::Shader& shader)
+{
+  MaskedMesh mesh;
+
+  mesh.mMeshlets = std::move(data.mMeshlets);
+  mesh.mFirstMaskedMeshlet = data.mFirstMaskedMeshlet;
+  mesh.mIndices = data.mFaces.mIndexBuffer;
+  mesh.mVisibleIndices.reserve(mesh.mIndices.size());
+  mesh.mMesh = data.mFaces.createMesh(shader.attributeSpecs());
+
+  return mesh;
+}
+
+
+const rigel::opengl::ShaderSpec& worldShaderSpec()
+{
+  return SHADER_SPEC;
+}
+
+
+LevelData buildLevelData(
+  const MapData& map,
+  const WadData& wad,
+  const LevelBuildOptions& options)
+{
+  LevelData level;
+  level.mBackgroundColor = wad.lookupColorIndex(wad.mBackgroundColor);
+  level.mStatistics.reset(map);
+
+  const auto models = loadUsedModels(map, wad);
+
+  {
+    const auto worldPages = determineWorldTexturePagesUsed(map, wad);
+    const auto modelPages = determineModelTexturePagesUsed(models, wad);
+
+    auto allPages = worldPages;
+    allPages.insert(allPages.end(), modelPages.begin(), modelPages.end());
+    sortAndRemoveDuplicates(allPages);
+
+    // A single atlas stores pages used by both world and models only once,
+    // and saves a texture switch when rendering
+    if (allPages.size() <= MAX_SHARED_ATLAS_PAGES)
+    {
+      level.mWorldTextures = TextureAtlas(wad, allPages);
+      level.mStatistics.mNumAtlasPages = allPages.size();
+    }
+    else
+    {
+      level.mWorldTextures = TextureAtlas(wad, worldPages);
+      level.moModelTextures = TextureAtlas(wad, modelPages);
+      level.mStatistics.mNumAtlasPages =
+        worldPages.size() + modelPages.size();
+    }
+
+    level.mStatistics.mNumWorldAtlasTexels =
+      worldPages.size() * TEXTURE_PAGE_SIZE * TEXTURE_PAGE_SIZE;
+
+    level.mWorldTextures.mMipLevels =
+      buildAtlasMipLevels(level.mWorldTextures.mImage, ATLAS_MIP_LEVELS);
+
+    if (level.moModelTextures)
+    {
+      level.moModelTextures->mMipLevels =
+        buildAtlasMipLevels(level.moModelTextures->mImage, ATLAS_MIP_LEVELS);
+    }
+
+    if (options.mCompressTextures)
+    {
+      const auto alphaTestedPages =
+        determineAlphaTestedPages(map, models, wad);
+
+      compressAtlas(
+        level.mWorldTextures,
+        level.moModelTextures ? worldPages : allPages,
+        alphaTestedPages,
+        options.mUseBakeCache);
+
+      if (level.moModelTextures)
+      {
+        compressAtlas(
+          *level.moModelTextures,
+          modelPages,
+          alphaTestedPages,
+          options.mUseBakeCache);
+      }
+    }
+  }
+
+  buildMeshes(map, wad, models, options, level);
+  buildTerrainTextureData(map, level);
+  computeBounds(level);
+
+  level.mStatistics.mMemoryUsage = level.estimatedMemoryUsage();
+
+  if (level.mNumDuplicateFaces > 0)
+  {
+    LOG_F(
+      INFO,
+      "Removed %zu duplicate faces from level geometry",
+      level.mNumDuplicateFaces);
+  }
+
+  return level;
+}
+
+
+std::optional<LevelData> loadLevelData(
+  const std::filesystem::path& mapFile,
+  const LevelBuildOptions& options)
+{
+  if (auto oWad = loadWadFile(wadFileForMap(mapFile)))
+  {
+    if (auto oMap = loadMapfile(mapFile, *oWad))
+    {
+      return buildLevelData(*oMap, *oWad, options);
+    }
+  }
+
+  LOG_F(ERROR, "Failed to load map '%s'", mapFile.u8string().c_str());
+  return {};
+}
+
+
+void MaskedMesh::drawPrepared(
+  rigel::opengl::Shader& shader,
+  DrawStats& stats,
+  const MeshletDrawOptions& options)
+{
+  const auto numSolidIndices = mNumVisibleSolidIndices;
+  const auto numMaskedIndices =
+    uint32_t(mVisibleIndices.size()) - numSolidIndices;
+
+  if (mVisibleIndices.empty())
+  {
+    return;
+  }
+
+  mMesh.uploadIndices(mVisibleIndices);
+
+  if (numSolidIndices)
+  {
+    mMesh.drawSubRange(0, numSolidIndices);
+    stats.addDrawCall(numSolidIndices);
+  }
+
+  if (numMaskedIndices && options.mDepthPrepass)
+  {
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    shader.setUniform("alphaTesting", true);
+    mMesh.drawSubRange(numSolidIndices, numMaskedIndices);
+    shader.setUniform("alphaTesting", false);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    stats.addDrawCall(numMaskedIndices);
+
+    glDepthFunc(GL_EQUAL);
+    glDepthMask(GL_FALSE);
+    mMesh.drawSubRange(numSolidIndices, numMaskedIndices);
+    glDepthMask(GL_TRUE);
+    glDepthFunc(GL_LESS);
+    stats.addDrawCall(numMaskedIndices);
+  }
+  else if (numMaskedIndices)
+  {
+    shader.setUniform("alphaTesting", true);
+    mMesh.drawSubRange(numSolidIndices, numMaskedIndices);
+    shader.setUniform("alphaTesting", false);
+    stats.addDrawCall(numMaskedIndices);
+  }
+}
+
+
+MapRenderer::MapRenderer()
+  : mShader(SHADER_SPEC)
+  , mDebugShader(DEBUG_SHADER_SPEC)
+  , mSupportsTextureCompression(supportsBc1Textures())
+{
+  glEnable(GL_DEPTH_TEST);
+  glEnable(GL_CULL_FACE);
+  glDisable(GL_BLEND);
+
+  glEnableVertexAttribArray(0);
+  glEnableVertexAttribArray(1);
+  glEnableVertexAttribArray(2);
+  glEnableVertexAttribArray(3);
+
+  {
+    auto guard = opengl::useTemporarily(mShader);
+    mShader.setUniform("textureData", 0);
+    mShader.setUniform("alphaTesting", false);
+  }
+
+  {
+    auto guard = opengl::useTemporarily(mDebugShader);
+    mDebugShader.setUniform("textureData", 0);
+    mDebugShader.setUniform("alphaTesting", false);
+  }
+
+#ifndef RIGEL_USE_GL_ES
+  // Vertex pulling needs gl_VertexID and texelFetch, which GLSL ES 1.00
+  // doesn't have. There, terrain is always drawn using its mesh.
+  moTerrainShader.emplace(TERRAIN_SHADER_SPEC);
+
+  {
+    auto guard = opengl::useTemporarily(*moTerrainShader);
+    moTerrainShader->setUniform("textureData", 0);
+    moTerrainShader->setUniform("terrainData", 1);
+    moTerrainShader->setUniform("textureDefData", 2);
+    moTerrainShader->setUniform("alphaTesting", false);
+  }
+#endif
+
+  mPrepareWorker = std::thread([this]() { runPrepareWorker(); });
+}
+
+
+MapRenderer::MapRenderer(
+  const MapData& map,
+  const WadData& wad,
+  const LevelBuildOptions& options)
+  : MapRenderer()
+{
+  auto supportedOptions = options;
+  supportedOptions.mCompressTextures &= mSupportsTextureCompression;
+
+  addLevel(buildLevelData(map, wad, supportedOptions), glm::vec3(0.0f));
+}
+
+
+MapRenderer::~MapRenderer()
+{
+  {
+    std::lock_guard<std::mutex> lock(mPrepareMutex);
+    mQuitPrepareWorker = true;
+  }
+
+  mPrepareStateChanged.notify_all();
+  mPrepareWorker.join();
+}
+
+
+void MapRenderer::handleEvent(const SDL_Event& event, double dt) { }
+
+
+LevelId MapRenderer::addLevel(LevelData&& data, const glm::vec3& offset)
+{
+  Level level;
+  level.mId = mNextLevelId++;
+  level.mOffset = offset;
+  level.mBoundsMin = data.mBoundsMin;
+  level.mBoundsMax = data.mBoundsMax;
+  level.mBackgroundColor = data.mBackgroundColor;
+
+  level.mWorldTextures =
+    createAtlasTexture(data.mWorldTextures, mSupportsTextureCompression);
+
+  if (data.moModelTextures)
+  {
+    level.moModelTextures =
+      createAtlasTexture(*data.moModelTextures, mSupportsTextureCompression);
+  }
+
+  level.mTerrainMesh = data.mTerrain.createMesh(mShader.attributeSpecs());
+  level.mExtraTerrainMesh =
+    data.mExtraTerrain.createMesh(mShader.attributeSpecs());
+
+#ifndef RIGEL_USE_GL_ES
+  level.mTerrainDataTexture =
+    createFloatTexture(MAP_SIZE, MAP_SIZE, data.mTerrainTileData.data());
+  level.mTextureDefsTexture = createFloatTexture(
+    TEXTURE_DEFS_PER_ROW * 2,
+    data.mNumTextureDefRows,
+    data.mTextureDefData.data());
+  glBindTexture(GL_TEXTURE_2D, 0);
+#endif
+
+  level.mBlocksMesh = createMaskedMesh(std::move(data.mBlocks), mShader);
+  level.mBlockInteriorsMesh =
+    createMaskedMesh(std::move(data.mBlockInteriors), mShader);
+  level.mBlockInteriors = std::move(data.mBlockInteriorBounds);
+  level.mModelsMesh = createMaskedMesh(std::move(data.mModels), mShader);
+  level.mStatistics = std::move(data.mStatistics);
+
+  mLevels.push_back(std::move(level));
+  return mLevels.back().mId;
+}
+
+
+void MapRenderer::removeLevel(const LevelId id)
+{
+  mLevels.erase(
+    std::remove_if(
+      mLevels.begin(),
+      mLevels.end(),
+      [&](const Level& level) { return level.mId == id; }),
+    mLevels.end());
+}
+
+
+std::vector<LevelId> MapRenderer::levelIds() const
+{
+  std::vector<LevelId> ids;
+  ids.reserve(mLevels.size());
+
+  for (const auto& level : mLevels)
+  {
+    ids.push_back(level.mId);
+  }
+
+  return ids;
+}
+
+
+const LevelStatistics* MapRenderer::levelStatistics(const LevelId id) const
+{
+  const auto iLevel = std::find_if(
+    mLevels.begin(), mLevels.end(), [&](const Level& level) {
+      return level.mId == id;
+    });
+
+  return iLevel != mLevels.end() ? &iLevel->mStatistics : nullptr;
+}
+
+
+void MapRenderer::updateAndRender(
+  double dt,
+  const rigel::base::Size& windowSize)
+{
+  moveCamera(dt);
+
+  const auto view = glm::lookAt(
+    mCameraPosition,
+    mCameraPosition + mCameraDirection,
+    glm::vec3(0.0f, 1.0f, 0.0f));
+
+  const auto windowAspectRatio =
+    float(windowSize.width) / float(windowSize.height);
+  auto matrix = glm::perspective(
+                  glm::radians(90.0f),
+                  windowAspectRatio,
+                  NEAR_PLANE_DISTANCE,
+                  MAX_VIEW_DISTANCE) *
+    view;
+
+  mShader.use();
+  mShader.setUniform("enableAmbientOcclusion", mAmbientOcclusion);
+
+  if (mCullFaces)
+  {
+    glEnable(GL_CULL_FACE);
+  }
+  else
+  {
+    glDisable(GL_CULL_FACE);
+  }
+
+
+  mFrameStats = {};
+
+  const auto clearColor = opengl::toGlColor(backgroundColor());
+  glClearColor(clearColor.r, clearColor.g, clearColor.b, clearColor.a);
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+
+  const auto isDebugView = mRenderMode != RenderMode::Textured;
+  const auto isOverdrawMode = mRenderMode == RenderMode::Overdraw;
+
+  if (isDebugView)
+  {
+    mDebugShader.use();
+    mDebugShader.setUniform("tintTexture", !isOverdrawMode);
+  }
+
+  if (isOverdrawMode)
+  {
+    // Count all fragments that are rasterized, including hidden ones
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+    glDisable(GL_DEPTH_TEST);
+  }
+
+  buildDrawCommands(matrix);
+
+  if (isDebugView)
+  {
+    for (const auto& command : mDrawCommands)
+    {
+      renderLevelDebugView(*command.mpLevel, command.mMatrix, command.mCuller);
+    }
+  }
+  else
+  {
+    // Meshlet culling and sorting happen on the worker, while terrain is
+    // submitted here
+    startPrepare();
+
+    for (const auto& command : mDrawCommands)
+    {
+      renderLevelTerrain(*command.mpLevel, command.mMatrix);
+    }
+
+    waitForPrepare();
+
+    for (const auto& command : mDrawCommands)
+    {
+      renderLevelMeshes(
+        *command.mpLevel, command.mMatrix, command.mDrawOptions);
+    }
+  }
+
+  if (isOverdrawMode)
+  {
+    glDisable(GL_BLEND);
+    glEnable(GL_DEPTH_TEST);
+  }
+
+  mShader.use();
+}
+
+
+void MapRenderer::buildDrawCommands(const glm::mat4& viewProjection)
+{
+  mDrawCommands.clear();
+
+  for (auto& level : mLevels)
+  {
+    // Meshes are in level-local coordinates. Instead of transforming all
+    // culling data into world space, we move the camera into the level's
+    // space.
+    const auto levelMatrix = glm::translate(viewProjection, level.mOffset);
+    const auto culler = MeshletCuller{
+      Frustum{levelMatrix},
+      mCameraPosition - level.mOffset,
+      mCullFaces,
+      mCullMeshlets};
+
+    const auto levelCenter = (level.mBoundsMin + level.mBoundsMax) * 0.5f;
+    const auto levelRadius =
+      glm::distance(level.mBoundsMin, level.mBoundsMax) * 0.5f;
+
+    if (
+      mCullMeshlets &&
+      !culler.mFrustum.intersectsSphere(levelCenter, levelRadius))
+    {
+      continue;
+    }
+
+    auto drawOptions = MeshletDrawOptions{};
+    drawOptions.mDepthPrepass = mDepthPrepass;
+
+    if (mSortFrontToBack)
+    {
+      drawOptions.moViewPosition = culler.mCameraPosition;
+    }
+
+    mDrawCommands.push_back({&level, levelMatrix, culler, drawOptions});
+  }
+
+  // Nearer levels first, so that they can occlude further ones
+  if (mSortFrontToBack)
+  {
+    auto distanceToCamera = [&](const LevelDrawCommand& command) {
+      const auto& level = *command.mpLevel;
+      const auto center = (level.mBoundsMin + level.mBoundsMax) * 0.5f;
+      return glm::distance(center + level.mOffset, mCameraPosition);
+    };
+
+    std::sort(
+      mDrawCommands.begin(),
+      mDrawCommands.end(),
+      [&](const LevelDrawCommand& lhs, const LevelDrawCommand& rhs) {
+        return distanceToCamera(lhs) < distanceToCamera(rhs);
+      });
+  }
+}
+
+
+void MapRenderer::prepareDrawCommands()
+{
+  for (const auto& command : mDrawCommands)
+  {
+    auto& level = *command.mpLevel;
+    const auto& culler = command.mCuller;
+
+    auto cullMeshlets = [&](const MaskedMesh& mesh) {
+      return [&culler, &meshlets = mesh.mMeshlets](const size_t index) {
+        return culler.isVisible(meshlets[index]);
+      };
+    };
+
+    if (mShowGeometry)
+    {
+      level.mBlocksMesh.prepare(
+        cullMeshlets(level.mBlocksMesh), command.mDrawOptions);
+      level.mBlockInteriorsMesh.prepare(
+        [&](const size_t index) {
+          return !mCullBlockInteriors ||
+            level.mBlockInteriors[index].contains(culler.mCameraPosition);
+        },
+        command.mDrawOptions);
+    }
+
+    if (mShowModels)
+    {
+      level.mModelsMesh.prepare(
+        cullMeshlets(level.mModelsMesh), command.mDrawOptions);
+    }
+  }
+}
+
+
+void MapRenderer::startPrepare()
+{
+  {
+    std::lock_guard<std::mutex> lock(mPrepareMutex);
+    mPrepareRequested = true;
+  }
+
+  mPrepareStateChanged.notify_all();
+}
+
+
+void MapRenderer::waitForPrepare()
+{
+  std::unique_lock<std::mutex> lock(mPrepareMutex);
+  mPrepareStateChanged.wait(lock, [this]() { return !mPrepareRequested; });
+}
+
+
+void MapRenderer::runPrepareWorker()
+{
+  std::unique_lock<std::mutex> lock(mPrepareMutex);
+
+  for (;;)
+  {
+    mPrepareStateChanged.wait(
+      lock, [this]() { return mPrepareRequested || mQuitPrepareWorker; });
+
+    if (mQuitPrepareWorker)
+    {
+      return;
+    }
+
+    lock.unlock();
+    prepareDrawCommands();
+    lock.lock();
+
+    mPrepareRequested = false;
+    mPrepareStateChanged.notify_all();
+  }
+}
+
+
+void MapRenderer::renderLevelTerrain(Level& level, const glm::mat4& matrix)
+{
+  if (!mShowTerrain)
+  {
+    return;
+  }
+
+  mShader.setUniform("transform", matrix);
+
+  glBindTexture(GL_TEXTURE_2D, level.mWorldTextures);
+
+  if (mGpuTerrain && moTerrainShader)
+  {
+    moTerrainShader->use();
+    moTerrainShader->setUniform("transform", matrix);
+
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, level.mTerrainDataTexture);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, level.mTextureDefsTexture);
+    glActiveTexture(GL_TEXTURE0);
+
+    // The terrain shader has no vertex attributes. The arrays enabled for
+    // all other drawing still point at the last mesh's vertex buffer, which
+    // is much smaller than the number of vertices pulled here.
+    for (auto i = 0; i < 4; ++i)
+    {
+      glDisableVertexAttribArray(i);
+    }
+
+    glDrawArrays(GL_TRIANGLES, 0, MAP_SIZE * MAP_SIZE * 6);
+    mFrameStats.addDrawCall(MAP_SIZE * MAP_SIZE * 6);
+
+    for (auto i = 0; i < 4; ++i)
+    {
+      glEnableVertexAttribArray(i);
+    }
+
+    mShader.use();
+  }
+  else
+  {
+    level.mTerrainMesh.draw();
+    mFrameStats.addDrawCall(level.mTerrainMesh.mNumIndices);
+  }
+
+  level.mExtraTerrainMesh.draw();
+  mFrameStats.addDrawCall(level.mExtraTerrainMesh.mNumIndices);
+}
+
+
+void MapRenderer::renderLevelMeshes(
+  Level& level,
+  const glm::mat4& matrix,
+  const MeshletDrawOptions& drawOptions)
+{
+  mShader.setUniform("transform", matrix);
+
+  glBindTexture(GL_TEXTURE_2D, level.mWorldTextures);
+
+  if (mShowGeometry)
+  {
+    level.mBlocksMesh.drawPrepared(mShader, mFrameStats, drawOptions);
+    level.mBlockInteriorsMesh.drawPrepared(mShader, mFrameStats, drawOptions);
+  }
+
+  if (mShowModels)
+  {
+    if (level.moModelTextures)
+    {
+      glBindTexture(GL_TEXTURE_2D, *level.moModelTextures);
+    }
+
+    level.mModelsMesh.drawPrepared(mShader, mFrameStats, drawOptions);
+  }
+}
+
+
+void MapRenderer::renderLevelDebugView(
+  Level& level,
+  const glm::mat4& matrix,
+  const MeshletCuller& culler)
+{
+  const auto isOverdrawMode = mRenderMode == RenderMode::Overdraw;
+
+  // The culling view shows culled meshlets tinted. The other views only
+  // show what normal rendering draws, so that they reflect its actual cost.
+  const auto drawsCulled = mRenderMode == RenderMode::Culling;
+
+  mDebugShader.setUniform("transform", matrix);
+
+  auto meshletColor = [&](const Meshlet& meshlet, const bool isVisible) {
+    switch (mRenderMode)
+    {
+      case RenderMode::TriangleDensity:
+        return triangleDensityColor(meshlet);
+
+      case RenderMode::Culling:
+        return isVisible ? NO_TINT : CULLED_TINT;
+
+      default:
+        return OVERDRAW_INCREMENT;
+    }
+  };
+
+  glBindTexture(GL_TEXTURE_2D, level.mWorldTextures);
+
+  if (mShowTerrain)
+  {
+    // Terrain isn't culled, and always uses the CPU-built mesh here
+    mDebugShader.setUniform(
+      "debugColor", isOverdrawMode ? OVERDRAW_INCREMENT : NO_TINT);
+    level.mTerrainMesh.draw();
+    mFrameStats.addDrawCall(level.mTerrainMesh.mNumIndices);
+    level.mExtraTerrainMesh.draw();
+    mFrameStats.addDrawCall(level.mExtraTerrainMesh.mNumIndices);
+  }
+
+  if (mShowGeometry)
+  {
+    auto isBlockVisible = [&](const size_t index) {
+      return culler.isVisible(level.mBlocksMesh.mMeshlets[index]);
+    };
+    auto isInteriorVisible = [&](const size_t index) {
+      return !mCullBlockInteriors ||
+        level.mBlockInteriors[index].contains(culler.mCameraPosition);
+    };
+
+    level.mBlocksMesh.drawDebug(
+      mDebugShader,
+      [&](const size_t index) {
+        return drawsCulled || isBlockVisible(index);
+      },
+      [&](const size_t index) {
+        return meshletColor(
+          level.mBlocksMesh.mMeshlets[index], isBlockVisible(index));
+      },
+      mFrameStats);
+    level.mBlockInteriorsMesh.drawDebug(
+      mDebugShader,
+      [&](const size_t index) {
+        return drawsCulled || isInteriorVisible(index);
+      },
+      [&](const size_t index) {
+        return meshletColor(
+          level.mBlockInteriorsMesh.mMeshlets[index],
+          isInteriorVisible(index));
+      },
+      mFrameStats);
+  }
+
+  if (mShowModels)
+  {
+    if (level.moModelTextures)
+    {
+      glBindTexture(GL_TEXTURE_2D, *level.moModelTextures);
+    }
+
+    auto isModelVisible = [&](const size_t index) {
+      return culler.isVisible(level.mModelsMesh.mMeshlets[index]);
+    };
+
+    level.mModelsMesh.drawDebug(
+      mDebugShader,
+      [&](const size_t index) {
+        return drawsCulled || isModelVisible(index);
+      },
+      [&](const size_t index) {
+        return meshletColor(
+          level.mModelsMesh.mMeshlets[index], isModelVisible(index));
+      },
+      mFrameStats);
+  }
+}
+
+
+rigel::base::Color MapRenderer::backgroundColor() const
+{
+  if (mLevels.empty())
+  {
+    return rigel::base::Color{0, 0, 0, 255};
+  }
+
+  // Use the color of the level the camera is above, falling back to the
+  // first level when in between levels
+  const auto iLevel =
+    std::find_if(mLevels.begin(), mLevels.end(), [&](const Level& level) {
+      const auto position = mCameraPosition - level.mOffset;
+      return position.x >= level.mBoundsMin.x &&
+        position.x <= level.mBoundsMax.x && position.z >= level.mBoundsMin.z &&
+        position.z <= level.mBoundsMax.z;
+    });
+
+  return iLevel != mLevels.end() ? iLevel->mBackgroundColor
+                                 : mLevels.front().mBackgroundColor;
+}
+
+
+void MapRenderer::focusCamera(const glm::vec3& target)
+{
+  constexpr auto FOCUS_DISTANCE = 3.0f;
+  constexpr auto FOCUS_HEIGHT = 1.5f;
+
+  const auto heading = glm::normalize(
+    glm::vec3(mCameraDirection.x, 0.0f, mCameraDirection.z));
 
-  mTerrainMesh = terrainBuffer.createMesh(mShader.attributeSpecs());
-  mBlocksMesh = createMaskedMesh(
-    std::move(blocksBuffer), std::move(blocksBufferMasked), mShader);
-  mModelsMesh = createMaskedMesh(
-    std::move(modelsBuffer), std::move(modelsBufferMasked), mShader);
+  mCameraPosition = target - heading * FOCUS_DISTANCE +
+    glm::vec3(0.0f, FOCUS_HEIGHT, 0.0f);
 }
 
 
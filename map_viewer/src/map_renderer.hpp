@@ -16,11 +16,15 @@
 
 #pragma once
 
+#include "level_statistics.hpp"
 #include "map_file.hpp"
+#include "map_geometry.hpp"
 #include "mesh.hpp"
+#include "meshlets.hpp"
 #include "wad_file.hpp"
 
 #include <rigel/base/color.hpp>
+#include <rigel/base/image.hpp>
 #include <rigel/base/spatial_types.hpp>
 #include <rigel/base/warnings.hpp>
 #include <rigel/opengl/handle.hpp>
@@ -30,74 +34,521 @@
 
 RIGEL_DISABLE_WARNINGS
 #include <SDL.h>
+#include <glm/mat4x4.hpp>
 #include <glm/vec3.hpp>
 RIGEL_RESTORE_WARNINGS
 
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
 #include <type_traits>
+#include <vector>
 
 
 namespace saucer
 {
 
+/** Camera distance beyond which nothing is drawn */
+constexpr auto MAX_VIEW_DISTANCE = 100.0f;
+
+/** Camera distance of the projection's near plane */
+constexpr auto NEAR_PLANE_DISTANCE = 0.1f;
+
+
 struct TextureAtlas
 {
   TextureAtlas() = default;
-  TextureAtlas(
-    const rigel::base::Image& image,
-    rigel::base::ArrayView<int> pages);
 
-  rigel::opengl::Handle<rigel::opengl::tag::Texture> mTexture;
+  /** Builds an atlas containing the given pages, side by side
+   *
+   * Pages must be canonical bitmap indices (see WadData::canonicalBitmap()),
+   * in ascending order. The UV offset table covers all bitmaps, so that
+   * duplicates of pages in the atlas can be looked up as well.
+   */
+  TextureAtlas(const WadData& wad, rigel::base::ArrayView<int> pages);
+
+  rigel::base::Image mImage{0, 0};
   float mWidth = 0.0f;
   std::vector<float> mUvOffsets;
+
+  // Mip levels 1 and up, see buildAtlasMipLevels(). Empty unless built
+  // explicitly.
+  std::vector<rigel::base::Image> mMipLevels;
+
+  // BC1 encoded base and mip levels, empty unless compression was requested
+  std::vector<std::vector<std::uint8_t>> mCompressedLevels;
+};
+
+
+/** Solid and masked faces of a MaskedMesh, prior to uploading
+ *
+ * Masked faces come after the solid ones, starting at mFirstMaskedMeshlet.
+ */
+struct MaskedMeshData
+{
+  MeshBufferData<Vertex> mFaces;
+  std::vector<Meshlet> mMeshlets;
+  size_t mFirstMaskedMeshlet = 0;
+};
+
+
+/** Options for drawing the visible parts of a MaskedMesh */
+struct MeshletDrawOptions
+{
+  /** If set, meshlets are drawn front to back as seen from this position */
+  std::optional<glm::vec3> moViewPosition;
+
+  /** Draws masked meshlets twice: First only depth with alpha testing, then
+   * shading without alpha testing, limited to the fragments which passed.
+   * Since the second pass doesn't discard fragments, hidden ones can be
+   * rejected before shading.
+   */
+  bool mDepthPrepass = false;
 };
 
 
 struct MaskedMesh
 {
   Mesh mMesh;
-  uint16_t mMaskedFacesStart = 0;
-  uint16_t mMaskedFacesCount = 0;
+  std::vector<Meshlet> mMeshlets;
+  std::vector<uint16_t> mIndices;
+  std::vector<uint16_t> mVisibleIndices;
+  std::vector<uint32_t> mVisibleMeshlets;
+  MeshletSortBuffers mSortBuffers;
+  size_t mFirstMaskedMeshlet = 0;
+  uint32_t mNumVisibleSolidIndices = 0;
+
+  /** Collects the indices of meshlets for which the predicate returns true
+   *
+   * The predicate is invoked with the index of each meshlet. Doesn't use
+   * OpenGL, so this can run on a worker thread, as long as the mesh isn't
+   * used elsewhere in the meantime. The result is drawn by drawPrepared().
+   */
+  template <typename Predicate>
+  void prepare(Predicate isVisible, const MeshletDrawOptions& options);
+
+  void drawPrepared(
+    rigel::opengl::Shader& shader,
+    DrawStats& stats,
+    const MeshletDrawOptions& options);
+
+  /** Draws all meshlets for which the given predicate returns true */
+  template <typename Predicate>
+  void drawIf(
+    rigel::opengl::Shader& shader,
+    Predicate isVisible,
+    DrawStats& stats,
+    const MeshletDrawOptions& options = {})
+  {
+    prepare(isVisible, options);
+    drawPrepared(shader, stats, options);
+  }
+
+  /** Draws meshlets individually, using the given debug shader
+   *
+   * Only meshlets for which the predicate returns true are drawn.
+   * colorForMeshlet is invoked with the index of each drawn meshlet, and
+   * must return the value for the shader's debugColor uniform. Meant for
+   * visualization only, as it issues one draw call per meshlet.
+   */
+  template <typename Predicate, typename ColorFunc>
+  void drawDebug(
+    rigel::opengl::Shader& debugShader,
+    Predicate isDrawn,
+    ColorFunc colorForMeshlet,
+    DrawStats& stats);
+};
+
+
+/** Bounding box of a block whose inside faces are kept separately */
+struct BlockInterior
+{
+  glm::vec3 mMin;
+  glm::vec3 mMax;
+
+  /** Tests if the point is inside the block, or close enough to it that
+   * the near plane could cut into a wall
+   *
+   * The farthest corner of the near plane is about 3.3 times the near plane
+   * distance away from the camera, at a 90 degree field of view and an
+   * aspect ratio of 3:1. The margin leaves some room beyond that.
+   */
+  bool contains(const glm::vec3& point) const
+  {
+    constexpr auto MARGIN = NEAR_PLANE_DISTANCE * 4.0f;
+
+    return point.x >= mMin.x - MARGIN && point.y >= mMin.y - MARGIN &&
+      point.z >= mMin.z - MARGIN && point.x <= mMax.x + MARGIN &&
+      point.y <= mMax.y + MARGIN && point.z <= mMax.z + MARGIN;
+  }
+};
+
+
+/** CPU-side data needed for rendering a level
+ *
+ * Building this is the expensive part of loading a level (texture atlases,
+ * meshes, ambient occlusion), and doesn't need an OpenGL context. It can
+ * therefore be done on a background thread, leaving only the upload to the
+ * render thread.
+ */
+struct LevelData
+{
+  rigel::base::Color mBackgroundColor;
+  glm::vec3 mBoundsMin{0.0f};
+  glm::vec3 mBoundsMax{0.0f};
+
+  TextureAtlas mWorldTextures;
+
+  // Empty if models use the world texture atlas
+  std::optional<TextureAtlas> moModelTextures;
+
+  MeshBufferData<Vertex> mTerrain;
+  MeshBufferData<Vertex> mExtraTerrain;
+  MaskedMeshData mBlocks;
+  MaskedMeshData mBlockInteriors;
+  std::vector<BlockInterior> mBlockInteriorBounds;
+  MaskedMeshData mModels;
+
+  std::vector<float> mTerrainTileData;
+  std::vector<float> mTextureDefData;
+  int mNumTextureDefRows = 0;
+
+  /** Faces left out because they exactly duplicate another face */
+  std::size_t mNumDuplicateFaces = 0;
+
+  LevelStatistics mStatistics;
+
+  const TextureAtlas& modelTextures() const
+  {
+    return moModelTextures ? *moModelTextures : mWorldTextures;
+  }
+
+  /** Estimate of the video memory needed once uploaded, in bytes */
+  std::size_t estimatedMemoryUsage() const;
+
+  /** Hash over all contained data, in a fixed order
+   *
+   * Meant for detecting whether changes to the build process alter its
+   * output. Floating point data is rounded to fixed point first, so that
+   * results don't depend on the compiler or its settings.
+   */
+  std::uint64_t contentHash() const;
+};
+
+
+struct LevelBuildOptions
+{
+  /** Additionally encode texture atlases in BC1 format
+   *
+   * Only request this if the renderer supports it.
+   */
+  bool mCompressTextures = false;
+
+  /** Bake ambient occlusion into the vertex lighting */
+  bool mAmbientOcclusion = true;
+
+  /** Look up and store baked AO and BC1 data in the on-disk bake cache
+   *
+   * Turned off for level hashing, so that stale or corrupt cache entries
+   * can't hide changes to the bakers' output.
+   */
+  bool mUseBakeCache = true;
+};
+
+
+/** Builds all data needed for rendering the given map */
+LevelData buildLevelData(
+  const MapData& map,
+  const WadData& wad,
+  const LevelBuildOptions& options = {});
+
+/** Loads the given map file and its WAD file, and builds its level data
+ *
+ * Returns an empty optional if either file can't be loaded.
+ */
+std::optional<LevelData> loadLevelData(
+  const std::filesystem::path& mapFile,
+  const LevelBuildOptions& options = {});
+
 
-  void draw(rigel::opengl::Shader& shader);
+/** Mesh and texture atlas for showing a single model on its own
+ *
+ * The model is centered at the origin, with the given bounding radius.
+ * Like LevelData, building this doesn't need an OpenGL context.
+ */
+struct ModelPreviewData
+{
+  TextureAtlas mTextures;
+  MaskedMeshData mMesh;
+  float mRadius = 0.0f;
+  uint32_t mNumTriangles = 0;
+};
+
+
+ModelPreviewData
+  buildModelPreviewData(const WadData& wad, const std::string& modelName);
+
+
+MaskedMesh
+  createMaskedMesh(MaskedMeshData&& data, const rigel::opengl::Shader& shader);
+
+
+/** Shader for textured geometry, with attributes matching Vertex
+ *
+ * Uniforms: transform, textureData, alphaTesting, enableAmbientOcclusion.
+ */
+const rigel::opengl::ShaderSpec& worldShaderSpec();
+
+
+enum class RenderMode
+{
+  Textured,
+  Overdraw,
+  TriangleDensity,
+  Culling
 };
 
 
+using LevelId = int;
+
+
+/** Renders one or more levels from a single camera
+ *
+ * Each level is placed at its own offset in world space and has its own
+ * meshes and texture atlases. Shaders, camera and render settings are shared.
+ */
 class MapRenderer
 {
 public:
-  MapRenderer(const MapData& map, const WadData& wad);
+  MapRenderer();
+  MapRenderer(
+    const MapData& map,
+    const WadData& wad,
+    const LevelBuildOptions& options = {});
   ~MapRenderer();
 
   void handleEvent(const SDL_Event& event, double dt);
   void updateAndRender(double dt, const rigel::base::Size& windowSize);
 
+  /** Uploads the given level's data and adds it to the scene
+   *
+   * Must be called on the render thread.
+   */
+  LevelId addLevel(LevelData&& data, const glm::vec3& offset);
+  void removeLevel(LevelId id);
+  std::size_t numLevels() const { return mLevels.size(); }
+  std::vector<LevelId> levelIds() const;
+
+  /** Returns nullptr if there's no level with the given id */
+  const LevelStatistics* levelStatistics(LevelId id) const;
+
   bool mShowTerrain = true;
   bool mShowGeometry = true;
   bool mShowModels = true;
   bool mCullFaces = true;
+  bool mCullMeshlets = true;
+  bool mCullBlockInteriors = true;
+  bool mGpuTerrain = false;
+  bool mAmbientOcclusion = true;
+  bool mSortFrontToBack = true;
+  bool mDepthPrepass = false;
+  RenderMode mRenderMode = RenderMode::Textured;
 
   const glm::vec3& cameraPosition() const { return mCameraPosition; }
+  const glm::vec3& cameraDirection() const { return mCameraDirection; }
+
+  /** Whether the GPU terrain mode is available, see mGpuTerrain
+   *
+   * It needs features that OpenGL ES 2 lacks.
+   */
+  bool supportsGpuTerrain() const { return moTerrainShader.has_value(); }
+
+  /** Whether levels built with compressed textures can be displayed
+   *
+   * Always false on OpenGL ES.
+   */
+  bool supportsTextureCompression() const
+  {
+    return mSupportsTextureCompression;
+  }
+
+  /** Places the camera in front of and above the given point
+   *
+   * The camera keeps its current heading.
+   */
+  void focusCamera(const glm::vec3& target);
+
+  /** Direction must be normalized */
+  void setCamera(const glm::vec3& position, const glm::vec3& direction)
+  {
+    mCameraPosition = position;
+    mCameraDirection = direction;
+  }
+
+  const DrawStats& frameStats() const { return mFrameStats; }
 
 private:
-  void buildMeshes(
-    const MapData& map,
-    const WadData& wad,
-    const std::unordered_map<std::string, ModelData>& models);
-  void moveCamera(double dt);
+  struct Level
+  {
+    LevelId mId;
+    glm::vec3 mOffset;
+    glm::vec3 mBoundsMin;
+    glm::vec3 mBoundsMax;
+    rigel::base::Color mBackgroundColor;
 
-  rigel::base::Color mBackgroundColor;
+    rigel::opengl::Handle<rigel::opengl::tag::Texture> mWorldTextures;
+    std::optional<rigel::opengl::Handle<rigel::opengl::tag::Texture>>
+      moModelTextures;
+
+    Mesh mTerrainMesh;
+    Mesh mExtraTerrainMesh;
+    rigel::opengl::Handle<rigel::opengl::tag::Texture> mTerrainDataTexture;
+    rigel::opengl::Handle<rigel::opengl::tag::Texture> mTextureDefsTexture;
+    MaskedMesh mBlocksMesh;
+    MaskedMesh mBlockInteriorsMesh;
+    std::vector<BlockInterior> mBlockInteriors;
+    MaskedMesh mModelsMesh;
+
+    LevelStatistics mStatistics;
+  };
+
+  /** Output of the CPU-side prepare stage for one visible level
+   *
+   * Visible meshlets are collected into the level's meshes, see
+   * MaskedMesh::prepare().
+   */
+  struct LevelDrawCommand
+  {
+    Level* mpLevel;
+    glm::mat4 mMatrix;
+    MeshletCuller mCuller;
+    MeshletDrawOptions mDrawOptions;
+  };
+
+  void buildDrawCommands(const glm::mat4& viewProjection);
+  void prepareDrawCommands();
+  void startPrepare();
+  void waitForPrepare();
+  void runPrepareWorker();
+
+  void renderLevelTerrain(Level& level, const glm::mat4& matrix);
+  void renderLevelMeshes(
+    Level& level,
+    const glm::mat4& matrix,
+    const MeshletDrawOptions& drawOptions);
+  void renderLevelDebugView(
+    Level& level,
+    const glm::mat4& matrix,
+    const MeshletCuller& culler);
+  rigel::base::Color backgroundColor() const;
+  void moveCamera(double dt);
 
   rigel::opengl::DummyVao mDummyVao;
-  TextureAtlas mWorldTextures;
-  TextureAtlas mModelTextures;
   rigel::opengl::Shader mShader;
+  std::optional<rigel::opengl::Shader> moTerrainShader;
+  rigel::opengl::Shader mDebugShader;
+  bool mSupportsTextureCompression;
 
   glm::vec3 mCameraPosition{0.0f, 1.5f, 0.0f};
   glm::vec3 mCameraDirection{0.0f, 0.0f, -1.0f};
 
-  Mesh mTerrainMesh;
-  MaskedMesh mBlocksMesh;
-  MaskedMesh mModelsMesh;
+  std::vector<Level> mLevels;
+  std::vector<LevelDrawCommand> mDrawCommands;
+  LevelId mNextLevelId = 0;
+
+  DrawStats mFrameStats;
+
+  // The prepare worker only runs between startPrepare() and
+  // waitForPrepare(), both called within updateAndRender(). At other times,
+  // levels can be modified freely.
+  std::mutex mPrepareMutex;
+  std::condition_variable mPrepareStateChanged;
+  bool mPrepareRequested = false;
+  bool mQuitPrepareWorker = false;
+  std::thread mPrepareWorker;
 };
 
+
+template <typename Predicate>
+void MaskedMesh::prepare(
+  Predicate isVisible,
+  const MeshletDrawOptions& options)
+{
+  mVisibleIndices.clear();
+
+  // Solid and masked meshlets are sorted separately, since they are drawn
+  // with different settings
+  auto collectVisibleMeshlets = [&](const size_t first, const size_t last) {
+    mVisibleMeshlets.clear();
+
+    for (auto i = first; i < last; ++i)
+    {
+      if (isVisible(i))
+      {
+        mVisibleMeshlets.push_back(uint32_t(i));
+      }
+    }
+
+    if (options.moViewPosition)
+    {
+      sortFrontToBack(
+        mMeshlets,
+        mVisibleMeshlets,
+        *options.moViewPosition,
+        MAX_VIEW_DISTANCE,
+        mSortBuffers);
+    }
+
+    for (const auto index : mVisibleMeshlets)
+    {
+      const auto& meshlet = mMeshlets[index];
+      const auto iStart = mIndices.begin() + meshlet.mFirstIndex;
+      mVisibleIndices.insert(
+        mVisibleIndices.end(), iStart, iStart + meshlet.mNumIndices);
+    }
+  };
+
+  collectVisibleMeshlets(0, mFirstMaskedMeshlet);
+  mNumVisibleSolidIndices = uint32_t(mVisibleIndices.size());
+  collectVisibleMeshlets(mFirstMaskedMeshlet, mMeshlets.size());
+}
+
+
+template <typename Predicate, typename ColorFunc>
+void MaskedMesh::drawDebug(
+  rigel::opengl::Shader& debugShader,
+  Predicate isDrawn,
+  ColorFunc colorForMeshlet,
+  DrawStats& stats)
+{
+  if (mIndices.empty())
+  {
+    return;
+  }
+
+  mMesh.uploadIndices(mIndices);
+
+  for (auto i = size_t(0); i < mMeshlets.size(); ++i)
+  {
+    if (!isDrawn(i))
+    {
+      continue;
+    }
+
+    const auto& meshlet = mMeshlets[i];
+
+    debugShader.setUniform("alphaTesting", i >= mFirstMaskedMeshlet);
+    debugShader.setUniform("debugColor", colorForMeshlet(i));
+    mMesh.drawSubRange(meshlet.mFirstIndex, meshlet.mNumIndices);
+    stats.addDrawCall(meshlet.mNumIndices);
+  }
+
+  debugShader.setUniform("alphaTesting", false);
+}
+
 } // namespace saucer
@@ -19,9 +19,9 @@
 #include "map_file.hpp"
 #include "map_renderer.hpp"
 #include "wad_file.hpp"
+#include "world_streamer.hpp"
 
 #include <rigel/base/defer.hpp>
-#include <rigel/base/string_utils.hpp>
 #include <rigel/opengl/opengl.hpp>
 #include <rigel/opengl/utils.hpp>
 #include <rigel/ui/imgui_integration.hpp>
@@ -31,6 +31,8 @@
 #include <imgui_internal.h>
 
 #include <cstdio>
+#include <system_error>
+#include <vector>
 
 
 namespace saucer
@@ -41,9 +43,12 @@ MapViewerApp::MapViewerApp(SDL_Window* pWindow)
   , mFpsDisplay(
       {ImGui::GetStyle().WindowPadding.x, ImGui::GetStyle().WindowPadding.y})
   , mMapFileBrowser(ImGuiFileBrowserFlags_CloseOnEsc)
+  , mWorldDirectoryBrowser(
+      ImGuiFileBrowserFlags_CloseOnEsc | ImGuiFileBrowserFlags_SelectDirectory)
 {
   mMapFileBrowser.SetTitle("Choose map file");
   mMapFileBrowser.SetTypeFilters({".map"});
+  mWorldDirectoryBrowser.SetTitle("Choose directory containing map files");
 }
 
 
@@ -100,17 +105,27 @@ bool MapViewerApp::runOneFrame()
 
 bool MapViewerApp::loadMap(const std::filesystem::path& mapFile)
 {
-  const auto mapName = mapFile.stem().u8string();
-  const auto correspondingWadFilename = rigel::strings::toLowercase(mapName);
-  const auto wadFile = mapFile.parent_path().parent_path() / "LEVELS" /
-    (correspondingWadFilename + ".wad");
-
-  if (auto oWad = loadWadFile(wadFile))
+  if (auto oWad = loadWadFile(wadFileForMap(mapFile)))
   {
     if (auto oMap = loadMapfile(mapFile, *oWad))
     {
       mMapFileBrowser.SetPwd(mapFile.parent_path());
-      mpMapRenderer = std::make_unique<MapRenderer>(*oMap, *oWad);
+      mpWorldStreamer.reset();
+      mpMapRenderer =
+        std::make_unique<MapRenderer>(*oMap, *oWad, mBuildOptions);
+
+      mSoundPreview.stop();
+      mTextureBrowser.setWad(nullptr);
+      mModelBrowser.setWad(nullptr);
+      mSelectedSound = 0;
+      mpWad = std::make_unique<WadData>(std::move(*oWad));
+      mTextureBrowser.setWad(mpWad.get());
+      mModelBrowser.setWad(mpWad.get());
+      mItemInspector.setMap(nullptr);
+      mpMap = std::make_unique<MapData>(std::move(*oMap));
+      mItemInspector.setMap(mpMap.get());
+      mBookmarkPanel.setMap(mpMap.get(), mapFile);
+      mMapName = mapFile.stem().u8string();
 
       const auto windowTitle =
         std::string(BASE_WINDOW_TITLE) + " - " + mapFile.filename().u8string();
@@ -123,8 +138,50 @@ bool MapViewerApp::loadMap(const std::filesystem::path& mapFile)
 }
 
 
+bool MapViewerApp::loadWorld(const std::filesystem::path& mapDirectory)
+{
+  const auto mapFiles = findMapFiles(mapDirectory);
+
+  if (mapFiles.empty())
+  {
+    return false;
+  }
+
+  mWorldDirectoryBrowser.SetPwd(mapDirectory);
+  mSoundPreview.stop();
+  mTextureBrowser.setWad(nullptr);
+  mModelBrowser.setWad(nullptr);
+  mItemInspector.setMap(nullptr);
+  mBookmarkPanel.setMap(nullptr, {});
+  mpWad.reset();
+  mpMap.reset();
+  mMapName.clear();
+  mpWorldStreamer.reset();
+  mpMapRenderer = std::make_unique<MapRenderer>();
+  mpWorldStreamer = std::make_unique<WorldStreamer>(
+    *mpMapRenderer,
+    mapFiles,
+    DEFAULT_WORLD_MEMORY_BUDGET,
+    mBuildOptions);
+
+  const auto windowTitle = std::string(BASE_WINDOW_TITLE) + " - " +
+    mapDirectory.filename().u8string() + " (" +
+    std::to_string(mapFiles.size()) + " maps)";
+  SDL_SetWindowTitle(mpWindow, windowTitle.c_str());
+  return true;
+}
+
+
 void MapViewerApp::handleEvent(const SDL_Event& event, double dt)
 {
+  if (
+    event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_F12 &&
+    !event.key.repeat)
+  {
+    mFrameCapture.requestScreenshot();
+    return;
+  }
+
   if (mpMapRenderer)
   {
     mpMapRenderer->handleEvent(event, dt);
@@ -171,11 +228,62 @@ void MapViewerApp::updateAndRender(
     }
   }
 
+  mWorldDirectoryBrowser.Display();
+
+  if (mWorldDirectoryBrowser.HasSelected())
+  {
+    const auto directory = mWorldDirectoryBrowser.GetSelected();
+    mWorldDirectoryBrowser.Close();
+
+    if (!loadWorld(directory))
+    {
+      const auto errorMsg =
+        "No map files found in '" + directory.u8string() + "'!";
+      SDL_ShowSimpleMessageBox(
+        SDL_MESSAGEBOX_ERROR, "Error", errorMsg.c_str(), nullptr);
+    }
+  }
+
   if (ImGui::Button("Load map"))
   {
     mMapFileBrowser.Open();
   }
 
+  ImGui::SameLine();
+
+  if (ImGui::Button("Load all maps"))
+  {
+    mWorldDirectoryBrowser.Open();
+  }
+
+  ImGui::SameLine();
+  ImGui::Checkbox("Sounds", &mShowSoundPanel);
+  ImGui::SameLine();
+  ImGui::Checkbox("Textures", &mShowTextureBrowser);
+  ImGui::SameLine();
+  ImGui::Checkbox("Models", &mShowModelBrowser);
+  ImGui::SameLine();
+  ImGui::Checkbox("Items", &mShowItemInspector);
+  ImGui::SameLine();
+  ImGui::Checkbox("Bookmarks", &mShowBookmarks);
+  ImGui::SameLine();
+  ImGui::Checkbox("Stats", &mShowStatistics);
+  ImGui::SameLine();
+  ImGui::Checkbox("Compress textures", &mBuildOptions.mCompressTextures);
+
+  if (ImGui::IsItemHovered())
+  {
+    ImGui::SetTooltip("Applies to maps loaded afterwards");
+  }
+
+  ImGui::SameLine();
+  ImGui::Checkbox("Bake AO", &mBuildOptions.mAmbientOcclusion);
+
+  if (ImGui::IsItemHovered())
+  {
+    ImGui::SetTooltip("Applies to maps loaded afterwards");
+  }
+
   ImGui::SameLine();
   ImGui::SeparatorEx(ImGuiSeparatorFlags_Vertical, 1.0f);
 
@@ -183,12 +291,77 @@ void MapViewerApp::updateAndRender(
   {
     ImGui::SameLine();
     ImGui::Checkbox("Terrain", &mpMapRenderer->mShowTerrain);
+
+    if (mpMapRenderer->supportsGpuTerrain())
+    {
+      ImGui::SameLine();
+      ImGui::Checkbox("GPU terrain", &mpMapRenderer->mGpuTerrain);
+    }
+
     ImGui::SameLine();
     ImGui::Checkbox("Geometry", &mpMapRenderer->mShowGeometry);
     ImGui::SameLine();
     ImGui::Checkbox("3D Models", &mpMapRenderer->mShowModels);
     ImGui::SameLine();
     ImGui::Checkbox("Backface culling", &mpMapRenderer->mCullFaces);
+    ImGui::SameLine();
+    ImGui::Checkbox("Meshlet culling", &mpMapRenderer->mCullMeshlets);
+    ImGui::SameLine();
+    ImGui::Checkbox("Interior culling", &mpMapRenderer->mCullBlockInteriors);
+    ImGui::SameLine();
+    ImGui::Checkbox("AO", &mpMapRenderer->mAmbientOcclusion);
+    ImGui::SameLine();
+    ImGui::Checkbox("Front to back", &mpMapRenderer->mSortFrontToBack);
+    ImGui::SameLine();
+    ImGui::Checkbox("Depth pre-pass", &mpMapRenderer->mDepthPrepass);
+
+    if (ImGui::IsItemHovered())
+    {
+      ImGui::SetTooltip("Applies to alpha-tested geometry");
+    }
+
+    ImGui::SameLine();
+    ImGui::SeparatorEx(ImGuiSeparatorFlags_Vertical, 1.0f);
+    ImGui::SameLine();
+
+    auto renderMode = int(mpMapRenderer->mRenderMode);
+    ImGui::SetNextItemWidth(ImGui::GetFontSize() * 10.0f);
+    if (ImGui::Combo(
+          "View",
+          &renderMode,
+          "Textured\0Overdraw\0Triangle density\0Culling\0"))
+    {
+      mpMapRenderer->mRenderMode = static_cast<RenderMode>(renderMode);
+    }
+
+    ImGui::SameLine();
+    ImGui::SeparatorEx(ImGuiSeparatorFlags_Vertical, 1.0f);
+    ImGui::SameLine();
+
+    if (ImGui::Button("Screenshot"))
+    {
+      mFrameCapture.requestScreenshot();
+    }
+
+    ImGui::SameLine();
+
+    if (mFrameCapture.isRecordingSequence())
+    {
+      if (ImGui::Button("Stop recording"))
+      {
+        mFrameCapture.stopSequence();
+      }
+    }
+    else if (ImGui::Button("Record frames"))
+    {
+      mFrameCapture.startSequence();
+    }
+
+    if (const auto numPending = mFrameCapture.numPendingFrames())
+    {
+      ImGui::SameLine();
+      ImGui::Text("Saving %zu", numPending);
+    }
 
     ImGui::SameLine();
     ImGui::SeparatorEx(ImGuiSeparatorFlags_Vertical, 1.0f);
@@ -199,6 +372,28 @@ void MapViewerApp::updateAndRender(
       mpMapRenderer->cameraPosition().x,
       mpMapRenderer->cameraPosition().y,
       mpMapRenderer->cameraPosition().z);
+
+    const auto& stats = mpMapRenderer->frameStats();
+    ImGui::SameLine();
+    ImGui::Text(
+      "Draw calls: %u  Triangles: %u  Vertices: %u",
+      stats.mDrawCalls,
+      stats.mTriangles,
+      stats.mVertices);
+
+    if (mpWorldStreamer)
+    {
+      constexpr auto BYTES_PER_MB = 1024.0 * 1024.0;
+
+      ImGui::SameLine();
+      ImGui::Text(
+        "Levels: %zu/%zu (%zu loading)  Memory: %.0f/%.0f MB",
+        mpWorldStreamer->numResidentLevels(),
+        mpWorldStreamer->numLevels(),
+        mpWorldStreamer->numLoadingLevels(),
+        double(mpWorldStreamer->memoryUsage()) / BYTES_PER_MB,
+        double(mpWorldStreamer->mMemoryBudget) / BYTES_PER_MB);
+    }
   }
   else
   {
@@ -208,6 +403,50 @@ void MapViewerApp::updateAndRender(
 
   ImGui::End();
 
+  if (mShowSoundPanel)
+  {
+    showSoundPanel();
+  }
+
+  if (mShowTextureBrowser)
+  {
+    mTextureBrowser.updateAndRender(&mShowTextureBrowser);
+  }
+
+  if (mShowModelBrowser)
+  {
+    mModelBrowser.updateAndRender(dt, &mShowModelBrowser);
+  }
+
+  if (mShowItemInspector)
+  {
+    const auto oFocusPosition =
+      mItemInspector.updateAndRender(&mShowItemInspector);
+
+    if (oFocusPosition && mpMapRenderer)
+    {
+      mpMapRenderer->focusCamera(*oFocusPosition);
+    }
+  }
+
+  if (mShowBookmarks && mpMapRenderer)
+  {
+    const auto oBookmark = mBookmarkPanel.updateAndRender(
+      &mShowBookmarks,
+      mpMapRenderer->cameraPosition(),
+      mpMapRenderer->cameraDirection());
+
+    if (oBookmark)
+    {
+      mpMapRenderer->setCamera(oBookmark->mPosition, oBookmark->mDirection);
+    }
+  }
+
+  if (mShowStatistics)
+  {
+    showStatisticsPanel();
+  }
+
 
   // Clear toolbar portion of the window
   glViewport(
@@ -216,12 +455,128 @@ void MapViewerApp::updateAndRender(
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 
 
+  if (mpWorldStreamer)
+  {
+    mpWorldStreamer->update();
+  }
+
   if (mpMapRenderer)
   {
+    const auto isBrowserOpen =
+      mMapFileBrowser.IsOpened() || mWorldDirectoryBrowser.IsOpened();
+
     glViewport(0, 0, windowSize.width, windowSize.height - toolbarHeight);
-    mpMapRenderer->updateAndRender(
-      mMapFileBrowser.IsOpened() ? 0.0 : dt, windowSize);
+    mpMapRenderer->updateAndRender(isBrowserOpen ? 0.0 : dt, windowSize);
   }
+
+  // The UI is drawn later on, so captured frames only show the map view
+  mFrameCapture.update(
+    base::Size{windowSize.width, windowSize.height - toolbarHeight});
+}
+
+
+void MapViewerApp::showSoundPanel()
+{
+  const auto fontSize = ImGui::GetFontSize();
+  ImGui::SetNextWindowSize(
+    {fontSize * 24.0f, fontSize * 30.0f}, ImGuiCond_FirstUseEver);
+
+  if (!ImGui::Begin("Sounds", &mShowSoundPanel))
+  {
+    ImGui::End();
+    return;
+  }
+
+  if (!mpWad || mpWad->mSounds.empty())
+  {
+    ImGui::TextDisabled(mpWad ? "No sounds in WAD file" : "No map loaded");
+    ImGui::End();
+    return;
+  }
+
+  if (ImGui::Button("Stop"))
+  {
+    mSoundPreview.stop();
+  }
+
+  ImGui::SameLine();
+  ImGui::Text(
+    "%zu sounds%s",
+    mpWad->mSounds.size(),
+    mSoundPreview.isPlaying() ? " - playing" : "");
+
+  ImGui::BeginChild("SoundList");
+
+  // Only the visible rows are submitted. Names and sample views refer to the
+  // WAD data directly, so browsing doesn't allocate anything per sound.
+  ImGuiListClipper clipper;
+  clipper.Begin(int(mpWad->mSounds.size()));
+
+  while (clipper.Step())
+  {
+    for (auto i = clipper.DisplayStart; i < clipper.DisplayEnd; ++i)
+    {
+      const auto index = std::size_t(i);
+      const auto oSound = mpWad->soundData(index);
+
+      ImGui::PushID(i);
+
+      if (ImGui::Selectable(
+            mpWad->mSounds[index].name.c_str(), index == mSelectedSound))
+      {
+        mSelectedSound = index;
+
+        if (oSound)
+        {
+          mSoundPreview.play(*oSound);
+        }
+      }
+
+      ImGui::SameLine(fontSize * 10.0f);
+
+      if (oSound)
+      {
+        const auto bytesPerSecond = double(oSound->sampleRate) *
+          oSound->numChannels * (oSound->bitsPerSample / 8);
+
+        ImGui::TextDisabled(
+          "%u Hz, %u bit, %s, %.2f s",
+          unsigned(oSound->sampleRate),
+          unsigned(oSound->bitsPerSample),
+          oSound->numChannels == 1 ? "mono" : "stereo",
+          double(oSound->samples.size()) / bytesPerSecond);
+      }
+      else
+      {
+        ImGui::TextDisabled("unsupported format");
+      }
+
+      ImGui::PopID();
+    }
+  }
+
+  ImGui::EndChild();
+  ImGui::End();
+}
+
+
+void MapViewerApp::showStatisticsPanel()
+{
+  std::vector<NamedLevelStatistics> levels;
+
+  if (mpWorldStreamer)
+  {
+    levels = mpWorldStreamer->residentLevelStatistics();
+  }
+  else if (mpMapRenderer)
+  {
+    for (const auto id : mpMapRenderer->levelIds())
+    {
+      levels.push_back({mMapName, mpMapRenderer->levelStatistics(id)});
+    }
+  }
+
+  mStatisticsPanel.updateAndRender(&mShowStatistics, levels);
 }
 
 } // namespace saucer
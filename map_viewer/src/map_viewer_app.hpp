@@ -16,6 +16,15 @@
 
 #pragma once
 
+#include "camera_bookmarks.hpp"
+#include "frame_capture.hpp"
+#include "item_inspector.hpp"
+#include "level_statistics.hpp"
+#include "map_renderer.hpp"
+#include "model_browser.hpp"
+#include "sound_preview.hpp"
+#include "texture_browser.hpp"
+
 #include <rigel/base/clock.hpp>
 #include <rigel/base/spatial_types.hpp>
 #include <rigel/ui/fps_display.hpp>
@@ -23,18 +32,22 @@
 #include <SDL_events.h>
 #include <imfilebrowser.h>
 
+#include <cstddef>
 #include <filesystem>
 #include <memory>
+#include <string>
 
 
 namespace saucer
 {
 
-class MapRenderer;
+class WorldStreamer;
 
 
 constexpr const auto BASE_WINDOW_TITLE = "Attack of the Saucerman Map Viewer";
 
+constexpr auto DEFAULT_WORLD_MEMORY_BUDGET = std::size_t(512) * 1024 * 1024;
+
 
 class MapViewerApp
 {
@@ -46,16 +59,46 @@ public:
 
   bool loadMap(const std::filesystem::path& mapFile);
 
+  /** Shows all maps found in the given directory side by side */
+  bool loadWorld(const std::filesystem::path& mapDirectory);
+
 private:
   void handleEvent(const SDL_Event& event, double dt);
   void updateAndRender(double dt, const rigel::base::Size& windowSize);
+  void showSoundPanel();
+  void showStatisticsPanel();
 
   SDL_Window* mpWindow;
   rigel::ui::FpsDisplay mFpsDisplay;
   rigel::base::Clock::time_point mLastTime{};
 
+  std::unique_ptr<WadData> mpWad;
+  std::unique_ptr<MapData> mpMap;
+  std::string mMapName;
   std::unique_ptr<MapRenderer> mpMapRenderer;
+  std::unique_ptr<WorldStreamer> mpWorldStreamer;
   ImGui::FileBrowser mMapFileBrowser;
+  ImGui::FileBrowser mWorldDirectoryBrowser;
+  FrameCapture mFrameCapture;
+
+  // Applies to maps loaded afterwards
+  LevelBuildOptions mBuildOptions;
+
+  // Declared after mpWad, so that playback and background work on
+  // previews stop before the WAD data goes away
+  SoundPreview mSoundPreview;
+  bool mShowSoundPanel = false;
+  std::size_t mSelectedSound = 0;
+  TextureBrowser mTextureBrowser;
+  bool mShowTextureBrowser = false;
+  ModelBrowser mModelBrowser;
+  bool mShowModelBrowser = false;
+  ItemInspector mItemInspector;
+  bool mShowItemInspector = false;
+  BookmarkPanel mBookmarkPanel;
+  bool mShowBookmarks = false;
+  LevelStatisticsPanel mStatisticsPanel;
+  bool mShowStatistics = false;
 };
 
 } // namespace saucer
@@ -29,7 +29,7 @@ void Mesh::draw()
 }
 
 
-void Mesh::drawSubRange(uint16_t start, uint16_t count)
+void Mesh::drawSubRange(uint32_t start, uint32_t count)
 {
   glBindBuffer(GL_ARRAY_BUFFER, mVbo);
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mEbo);
@@ -41,4 +41,17 @@ void Mesh::drawSubRange(uint16_t start, uint16_t count)
     rigel::opengl::toVoidPtr(start * sizeof(uint16_t)));
 }
 
+
+void Mesh::uploadIndices(rigel::base::ArrayView<uint16_t> indices)
+{
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mEbo);
+  glBufferData(
+    GL_ELEMENT_ARRAY_BUFFER,
+    sizeof(GLushort) * indices.size(),
+    indices.data(),
+    GL_STREAM_DRAW);
+
+  mNumIndices = uint32_t(indices.size());
+}
+
 } // namespace saucer
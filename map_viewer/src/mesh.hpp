@@ -30,15 +30,36 @@
 namespace saucer
 {
 
+/** Counters for the draw calls issued during a frame
+ *
+ * Vertices are counted as submitted, i.e. shared vertices count once per
+ * triangle using them.
+ */
+struct DrawStats
+{
+  uint32_t mDrawCalls = 0;
+  uint32_t mTriangles = 0;
+  uint32_t mVertices = 0;
+
+  void addDrawCall(const uint32_t numVertices)
+  {
+    ++mDrawCalls;
+    mTriangles += numVertices / 3;
+    mVertices += numVertices;
+  }
+};
+
+
 struct Mesh
 {
   rigel::base::ArrayView<rigel::opengl::AttributeSpec> mAttributeSpecs;
   rigel::opengl::Handle<rigel::opengl::tag::Buffer> mVbo;
   rigel::opengl::Handle<rigel::opengl::tag::Buffer> mEbo;
-  uint16_t mNumIndices = 0;
+  uint32_t mNumIndices = 0;
 
   void draw();
-  void drawSubRange(uint16_t start, uint16_t count);
+  void drawSubRange(uint32_t start, uint32_t count);
+  void uploadIndices(rigel::base::ArrayView<uint16_t> indices);
 };
 
 
@@ -116,7 +137,7 @@ Mesh MeshBufferData<Vertex>::createMesh(
   mesh.mAttributeSpecs = attributeSpecs;
   mesh.mVbo = Handle<tag::Buffer>::create();
   mesh.mEbo = Handle<tag::Buffer>::create();
-  mesh.mNumIndices = uint16_t(mIndexBuffer.size());
+  mesh.mNumIndices = uint32_t(mIndexBuffer.size());
 
   glBindBuffer(GL_ARRAY_BUFFER, mesh.mVbo);
   glBufferData(
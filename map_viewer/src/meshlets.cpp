@@ -0,0 +1,346 @@
+/* Copyright (C) 2024, Nikolai Wuttke. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "meshlets.hpp"
+
+#include "map_file.hpp"
+
+RIGEL_DISABLE_WARNINGS
+#include <glm/glm.hpp>
+RIGEL_RESTORE_WARNINGS
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+
+namespace saucer
+{
+
+namespace
+{
+
+// Size of the square map regions used for grouping triangles, in grid cells
+constexpr auto MESHLET_REGION_SIZE = 8;
+constexpr auto NUM_MESHLET_REGIONS_PER_ROW = MAP_SIZE / MESHLET_REGION_SIZE;
+
+// Cones with a smaller spread than this (as cosine of the angle between axis
+// and the most divergent normal) aren't worth testing.
+constexpr auto MIN_CONE_SPREAD = 0.1f;
+
+
+int facingDirection(const glm::vec3& normal)
+{
+  const auto absNormal = glm::abs(normal);
+
+  if (absNormal.x == 0.0f && absNormal.y == 0.0f && absNormal.z == 0.0f)
+  {
+    return 6;
+  }
+
+  if (absNormal.x >= absNormal.y && absNormal.x >= absNormal.z)
+  {
+    return normal.x > 0.0f ? 0 : 1;
+  }
+
+  if (absNormal.y >= absNormal.z)
+  {
+    return normal.y > 0.0f ? 2 : 3;
+  }
+
+  return normal.z > 0.0f ? 4 : 5;
+}
+
+
+int regionIndex(const glm::vec3& point)
+{
+  // World space places the center of the map at the origin, see makeVertex()
+  // in map_renderer.cpp
+  auto toRegion = [](const float coordinate) {
+    return std::clamp(
+      int(std::floor(
+        (coordinate + MAP_SIZE / 2.0f) / MESHLET_REGION_SIZE)),
+      0,
+      NUM_MESHLET_REGIONS_PER_ROW - 1);
+  };
+
+  return toRegion(point.x) + toRegion(point.z) * NUM_MESHLET_REGIONS_PER_ROW;
+}
+
+
+Meshlet computeBounds(
+  rigel::base::ArrayView<glm::vec3> positions,
+  rigel::base::ArrayView<uint16_t> indices,
+  rigel::base::ArrayView<glm::vec3> normals)
+{
+  Meshlet meshlet;
+
+  auto min = positions[indices[0]];
+  auto max = min;
+
+  for (const auto index : indices)
+  {
+    min = glm::min(min, positions[index]);
+    max = glm::max(max, positions[index]);
+  }
+
+  meshlet.mCenter = (min + max) * 0.5f;
+
+  for (const auto index : indices)
+  {
+    meshlet.mRadius = std::max(
+      meshlet.mRadius, glm::distance(meshlet.mCenter, positions[index]));
+  }
+
+
+  auto normalSum = glm::vec3(0.0f);
+
+  for (const auto& normal : normals)
+  {
+    normalSum += normal;
+  }
+
+  if (glm::length(normalSum) == 0.0f)
+  {
+    return meshlet;
+  }
+
+  meshlet.mConeAxis = glm::normalize(normalSum);
+
+  auto minDot = 1.0f;
+
+  for (const auto& normal : normals)
+  {
+    minDot = std::min(minDot, glm::dot(meshlet.mConeAxis, normal));
+  }
+
+  if (minDot > MIN_CONE_SPREAD)
+  {
+    // The cutoff is the sine of the cone's half-angle: For all normals within
+    // the cone to face away from the viewer, the view direction must not
+    // deviate by more than 90° minus that angle from the axis.
+    meshlet.mConeCutoff = std::sqrt(1.0f - minDot * minDot);
+  }
+
+  return meshlet;
+}
+
+} // namespace
+
+
+Frustum::Frustum(const glm::mat4& m)
+{
+  auto row = [&](const int i) {
+    return glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+  };
+
+  mPlanes = {
+    row(3) + row(0),
+    row(3) - row(0),
+    row(3) + row(1),
+    row(3) - row(1),
+    row(3) + row(2),
+    row(3) - row(2)};
+
+  for (auto& plane : mPlanes)
+  {
+    plane = plane * (1.0f / glm::length(glm::vec3(plane)));
+  }
+}
+
+
+bool Frustum::intersectsSphere(const glm::vec3& center, float radius) const
+{
+  return std::all_of(
+    mPlanes.begin(), mPlanes.end(), [&](const glm::vec4& plane) {
+      return glm::dot(glm::vec3(plane), center) + plane.w >= -radius;
+    });
+}
+
+
+bool MeshletCuller::isVisible(const Meshlet& meshlet) const
+{
+  if (!mEnabled)
+  {
+    return true;
+  }
+
+  if (mCullBackFaces)
+  {
+    const auto toCenter = meshlet.mCenter - mCameraPosition;
+
+    if (
+      glm::dot(toCenter, meshlet.mConeAxis) >=
+      meshlet.mConeCutoff * glm::length(toCenter) + meshlet.mRadius)
+    {
+      return false;
+    }
+  }
+
+  return mFrustum.intersectsSphere(meshlet.mCenter, meshlet.mRadius);
+}
+
+
+void sortFrontToBack(
+  rigel::base::ArrayView<Meshlet> meshlets,
+  std::vector<uint32_t>& meshletIndices,
+  const glm::vec3& viewPosition,
+  const float maxDistance,
+  MeshletSortBuffers& buffers)
+{
+  constexpr auto KEY_SHIFT = 32;
+  constexpr auto MAX_KEY = 0xFFFF;
+  constexpr auto RADIX_BITS = 8;
+  constexpr auto NUM_BUCKETS = 1 << RADIX_BITS;
+
+  auto& entries = buffers.mEntries;
+  auto& scratch = buffers.mScratch;
+
+  // Each entry holds the quantized distance in the upper, and the meshlet
+  // index in the lower half, so only the key bits need to be sorted on
+  entries.clear();
+  scratch.resize(meshletIndices.size());
+
+  const auto keyScale = MAX_KEY / maxDistance;
+
+  for (const auto index : meshletIndices)
+  {
+    const auto& meshlet = meshlets[index];
+    const auto distance = std::max(
+      glm::distance(meshlet.mCenter, viewPosition) - meshlet.mRadius, 0.0f);
+    const auto key = uint64_t(std::min(distance * keyScale, float(MAX_KEY)));
+
+    entries.push_back((key << KEY_SHIFT) | index);
+  }
+
+  for (auto shift = KEY_SHIFT; shift < KEY_SHIFT + 16; shift += RADIX_BITS)
+  {
+    std::array<uint32_t, NUM_BUCKETS + 1> offsets{};
+
+    for (const auto entry : entries)
+    {
+      ++offsets[((entry >> shift) & (NUM_BUCKETS - 1)) + 1];
+    }
+
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+    for (const auto entry : entries)
+    {
+      scratch[offsets[(entry >> shift) & (NUM_BUCKETS - 1)]++] = entry;
+    }
+
+    std::swap(entries, scratch);
+  }
+
+  for (auto i = std::size_t(0); i < entries.size(); ++i)
+  {
+    meshletIndices[i] = uint32_t(entries[i]);
+  }
+}
+
+
+std::vector<Meshlet> buildMeshlets(
+  rigel::base::ArrayView<glm::vec3> positions,
+  std::vector<uint16_t>& indices)
+{
+  const auto numTriangles = indices.size() / 3;
+
+  std::vector<glm::vec3> normals;
+  std::vector<int> groups;
+  normals.reserve(numTriangles);
+  groups.reserve(numTriangles);
+
+  for (auto i = 0u; i < numTriangles; ++i)
+  {
+    const auto& p0 = positions[indices[i * 3]];
+    const auto& p1 = positions[indices[i * 3 + 1]];
+    const auto& p2 = positions[indices[i * 3 + 2]];
+
+    auto normal = glm::cross(p1 - p0, p2 - p0);
+
+    if (glm::length(normal) > 0.0f)
+    {
+      normal = glm::normalize(normal);
+    }
+
+    normals.push_back(normal);
+    groups.push_back(
+      regionIndex((p0 + p1 + p2) * (1.0f / 3.0f)) * 7 +
+      facingDirection(normal));
+  }
+
+  // A stable sort keeps the two triangles making up a quad next to each
+  // other, and preserves the original submission order within each group.
+  std::vector<uint32_t> order(numTriangles);
+  std::iota(order.begin(), order.end(), 0u);
+  std::stable_sort(
+    order.begin(), order.end(), [&](const uint32_t lhs, const uint32_t rhs) {
+      return groups[lhs] < groups[rhs];
+    });
+
+
+  std::vector<Meshlet> meshlets;
+  std::vector<uint16_t> newIndices;
+  std::vector<glm::vec3> meshletNormals;
+  newIndices.reserve(indices.size());
+  meshletNormals.reserve(MAX_MESHLET_TRIANGLES);
+
+  auto finishMeshlet = [&]() {
+    if (meshletNormals.empty())
+    {
+      return;
+    }
+
+    const auto numIndices = uint32_t(meshletNormals.size() * 3);
+    const auto firstIndex = uint32_t(newIndices.size() - numIndices);
+
+    auto meshlet = computeBounds(
+      positions,
+      rigel::base::ArrayView<uint16_t>(
+        newIndices.data() + firstIndex, numIndices),
+      meshletNormals);
+    meshlet.mFirstIndex = firstIndex;
+    meshlet.mNumIndices = numIndices;
+    meshlets.push_back(meshlet);
+
+    meshletNormals.clear();
+  };
+
+  for (auto i = 0u; i < numTriangles; ++i)
+  {
+    const auto triangle = order[i];
+
+    if (
+      meshletNormals.size() == MAX_MESHLET_TRIANGLES ||
+      (i > 0 && groups[order[i - 1]] != groups[triangle]))
+    {
+      finishMeshlet();
+    }
+
+    newIndices.push_back(indices[triangle * 3]);
+    newIndices.push_back(indices[triangle * 3 + 1]);
+    newIndices.push_back(indices[triangle * 3 + 2]);
+    meshletNormals.push_back(normals[triangle]);
+  }
+
+  finishMeshlet();
+
+  indices = std::move(newIndices);
+
+  return meshlets;
+}
+
+} // namespace saucer
@@ -0,0 +1,128 @@
+/* Copyright (C) 2024, Nikolai Wuttke. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "mesh.hpp"
+
+#include <rigel/base/array_view.hpp>
+#include <rigel/base/warnings.hpp>
+
+RIGEL_DISABLE_WARNINGS
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+RIGEL_RESTORE_WARNINGS
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+
+namespace saucer
+{
+
+constexpr auto MAX_MESHLET_TRIANGLES = 64;
+
+
+/** A small cluster of triangles with precomputed culling data
+ *
+ * The bounding sphere is used for frustum culling, the normal cone for
+ * rejecting clusters where all triangles are facing away from the camera.
+ * A cone cutoff of 1.0 means that the cone is too wide to be useful, and the
+ * meshlet is never considered back-facing.
+ */
+struct Meshlet
+{
+  glm::vec3 mCenter{0.0f};
+  float mRadius = 0.0f;
+  glm::vec3 mConeAxis{0.0f};
+  float mConeCutoff = 1.0f;
+  uint32_t mFirstIndex = 0;
+  uint32_t mNumIndices = 0;
+};
+
+
+struct Frustum
+{
+  explicit Frustum(const glm::mat4& viewProjection);
+
+  bool intersectsSphere(const glm::vec3& center, float radius) const;
+
+  std::array<glm::vec4, 6> mPlanes;
+};
+
+
+/** Reusable buffers for sortFrontToBack(), to avoid allocating per frame */
+struct MeshletSortBuffers
+{
+  std::vector<uint64_t> mEntries;
+  std::vector<uint64_t> mScratch;
+};
+
+
+/** Sorts the given meshlet indices by distance to the viewer, nearest first
+ *
+ * Distance is measured to each meshlet's bounding sphere, and quantized to
+ * 16 bits over the range [0, maxDistance] for a two pass radix sort. The
+ * order is therefore only approximate for meshlets at similar distances,
+ * which doesn't matter for reducing overdraw. Ties keep their input order.
+ */
+void sortFrontToBack(
+  rigel::base::ArrayView<Meshlet> meshlets,
+  std::vector<uint32_t>& meshletIndices,
+  const glm::vec3& viewPosition,
+  float maxDistance,
+  MeshletSortBuffers& buffers);
+
+
+struct MeshletCuller
+{
+  bool isVisible(const Meshlet& meshlet) const;
+
+  Frustum mFrustum;
+  glm::vec3 mCameraPosition;
+  bool mCullBackFaces = true;
+  bool mEnabled = true;
+};
+
+
+/** Partitions the given triangle list into meshlets
+ *
+ * Reorders the index list so that each meshlet's triangles are stored
+ * contiguously. Triangles are grouped by map region and by facing direction
+ * before partitioning, which keeps the normal cones narrow.
+ */
+std::vector<Meshlet> buildMeshlets(
+  rigel::base::ArrayView<glm::vec3> positions,
+  std::vector<uint16_t>& indices);
+
+
+template <typename Vertex>
+std::vector<Meshlet> buildMeshlets(MeshBufferData<Vertex>& data)
+{
+  std::vector<glm::vec3> positions;
+  positions.reserve(data.mVertexBuffer.size());
+
+  for (const auto& vertex : data.mVertexBuffer)
+  {
+    positions.emplace_back(vertex.x, vertex.y, vertex.z);
+  }
+
+  return buildMeshlets(positions, data.mIndexBuffer);
+}
+
+} // namespace saucer
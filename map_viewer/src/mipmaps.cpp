@@ -0,0 +1,149 @@
+/* Copyright (C) 2024, Nikolai Wuttke. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "mipmaps.hpp"
+
+#include "worker_pool.hpp"
+
+#include <array>
+#include <cstdint>
+
+
+namespace saucer
+{
+
+using rigel::base::Color;
+using rigel::base::Image;
+using rigel::base::PixelBuffer;
+
+
+namespace
+{
+
+/** Halves one page of source, writing it into the destination level
+ *
+ * Written without branches in the inner loop, so that compilers can
+ * vectorize it.
+ */
+void downscalePage(
+  const PixelBuffer& source,
+  const std::size_t sourceWidth,
+  PixelBuffer& destination,
+  const std::size_t destinationWidth,
+  const std::size_t page,
+  const std::size_t destinationPageSize)
+{
+  const auto firstColumn = page * destinationPageSize;
+
+  for (auto y = std::size_t(0); y < destinationPageSize; ++y)
+  {
+    const auto* pRow0 = source.data() + y * 2 * sourceWidth + firstColumn * 2;
+    const auto* pRow1 = pRow0 + sourceWidth;
+    auto* pDestination =
+      destination.data() + y * destinationWidth + firstColumn;
+
+    for (auto x = std::size_t(0); x < destinationPageSize; ++x)
+    {
+      const Color texels[] = {
+        pRow0[x * 2], pRow0[x * 2 + 1], pRow1[x * 2], pRow1[x * 2 + 1]};
+
+      auto numOpaque = 0u;
+      auto opaqueSum = std::array<uint32_t, 3>{};
+      auto totalSum = std::array<uint32_t, 3>{};
+
+      for (const auto& texel : texels)
+      {
+        // Palette colors are either fully opaque or fully transparent
+        const auto weight = uint32_t(texel.a >> 7);
+
+        numOpaque += weight;
+        opaqueSum[0] += texel.r * weight;
+        opaqueSum[1] += texel.g * weight;
+        opaqueSum[2] += texel.b * weight;
+        totalSum[0] += texel.r;
+        totalSum[1] += texel.g;
+        totalSum[2] += texel.b;
+      }
+
+      // Fully transparent areas keep their average color, since solid
+      // textures are drawn without alpha testing
+      const auto& sum = numOpaque > 0 ? opaqueSum : totalSum;
+      const auto count = numOpaque > 0 ? numOpaque : 4u;
+
+      pDestination[x] = Color{
+        uint8_t((sum[0] + count / 2) / count),
+        uint8_t((sum[1] + count / 2) / count),
+        uint8_t((sum[2] + count / 2) / count),
+        uint8_t(numOpaque >= 2 ? 255 : 0)};
+    }
+  }
+}
+
+} // namespace
+
+
+std::vector<Image> buildAtlasMipLevels(const Image& atlas, const int numLevels)
+{
+  const auto pageSize = atlas.height();
+  const auto numPages = pageSize > 0 ? atlas.width() / pageSize : 0;
+
+  if (numPages == 0 || numLevels <= 0)
+  {
+    return {};
+  }
+
+  std::vector<PixelBuffer> levelPixels;
+
+  for (auto level = 1; level <= numLevels; ++level)
+  {
+    const auto levelPageSize = pageSize >> level;
+    levelPixels.emplace_back(levelPageSize * levelPageSize * numPages);
+  }
+
+  // Pages are independent of each other, so each task builds all levels
+  // for one page
+  parallelFor(numPages, [&](const std::size_t page) {
+    const auto* pSource = &atlas.pixelData();
+    auto sourceWidth = atlas.width();
+
+    for (auto& pixels : levelPixels)
+    {
+      const auto levelPageSize = sourceWidth / numPages / 2;
+      const auto levelWidth = levelPageSize * numPages;
+
+      downscalePage(
+        *pSource, sourceWidth, pixels, levelWidth, page, levelPageSize);
+
+      pSource = &pixels;
+      sourceWidth = levelWidth;
+    }
+  });
+
+  std::vector<Image> levels;
+  levels.reserve(levelPixels.size());
+
+  for (auto& pixels : levelPixels)
+  {
+    const auto levelPageSize = pageSize >> (levels.size() + 1);
+    levels.emplace_back(
+      std::move(pixels), levelPageSize * numPages, levelPageSize);
+  }
+
+  return levels;
+}
+
+} // namespace saucer
@@ -0,0 +1,42 @@
+/* Copyright (C) 2024, Nikolai Wuttke. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <rigel/base/image.hpp>
+
+#include <vector>
+
+
+namespace saucer
+{
+
+/** Builds mip levels 1 to numLevels for a horizontal strip of square pages
+ *
+ * Each page is downscaled on its own, so that no level mixes texels of
+ * neighboring pages. Transparent texels don't contribute to the color of
+ * partially transparent areas, and a downscaled texel is opaque if at least
+ * half of its source texels are. This keeps alpha binary, which is what
+ * alpha testing of masked textures expects, without dark fringes.
+ *
+ * The atlas height must be the page size, which must be a power of two
+ * larger than or equal to 2^numLevels.
+ */
+std::vector<rigel::base::Image>
+  buildAtlasMipLevels(const rigel::base::Image& atlas, int numLevels);
+
+} // namespace saucer
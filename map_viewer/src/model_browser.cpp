@@ -0,0 +1,304 @@
+/* Copyright (C) 2024, Nikolai Wuttke. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "model_browser.hpp"
+
+#include <rigel/base/warnings.hpp>
+
+RIGEL_DISABLE_WARNINGS
+#include <glm/gtc/constants.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <imgui.h>
+#include <loguru.hpp>
+RIGEL_RESTORE_WARNINGS
+
+#include <algorithm>
+#include <cmath>
+#include <exception>
+
+
+namespace saucer
+{
+
+using namespace rigel;
+
+
+namespace
+{
+
+constexpr auto PREVIEW_SIZE = 96;
+
+// Tiles in the shared render target. Visible list entries beyond this
+// number show no preview, but that would require a very tall window.
+constexpr auto NUM_TILE_COLUMNS = 8;
+constexpr auto NUM_TILE_ROWS = 4;
+constexpr auto NUM_TILES = NUM_TILE_COLUMNS * NUM_TILE_ROWS;
+constexpr auto TARGET_WIDTH = NUM_TILE_COLUMNS * PREVIEW_SIZE;
+constexpr auto TARGET_HEIGHT = NUM_TILE_ROWS * PREVIEW_SIZE;
+
+// Each preview has its own texture atlas, which makes these quite a bit
+// larger than the texture browser's thumbnails.
+constexpr auto MAX_CACHED_PREVIEWS = std::size_t(64);
+
+constexpr auto MAX_CONCURRENT_BUILDS = std::size_t(2);
+
+constexpr auto ROTATION_SPEED = 1.0f; // radians per second
+const auto FIELD_OF_VIEW = glm::radians(45.0f);
+
+} // namespace
+
+
+ModelBrowser::ModelBrowser()
+  : mShader(worldShaderSpec())
+  , mTargetTexture(opengl::Handle<opengl::tag::Texture>::create())
+  , mTargetDepthBuffer(opengl::Handle<opengl::tag::Renderbuffer>::create())
+  , mTarget(opengl::Handle<opengl::tag::Framebuffer>::create())
+  , mPreviews(
+      MAX_CACHED_PREVIEWS,
+      MAX_CONCURRENT_BUILDS,
+      [this](const std::size_t modelIndex) -> std::optional<ModelPreviewData> {
+        // The WadData and model names remain valid while a model is in
+        // progress, since setWad() waits for all of them to be finished.
+        const auto& name = mModelNames[modelIndex];
+
+        try
+        {
+          return buildModelPreviewData(*mpWad, name);
+        }
+        catch (const std::exception& error)
+        {
+          // Out of range offsets or texture indices in the model data
+          LOG_F(
+            ERROR,
+            "Failed to build model '%s': %s",
+            name.c_str(),
+            error.what());
+          return {};
+        }
+      },
+      [this](ModelPreviewData&& data) {
+        return Preview{
+          opengl::createTexture(data.mTextures.mImage),
+          createMaskedMesh(std::move(data.mMesh), mShader),
+          data.mRadius,
+          data.mNumTriangles};
+      })
+{
+  {
+    auto guard = opengl::useTemporarily(mShader);
+    mShader.setUniform("textureData", 0);
+    mShader.setUniform("alphaTesting", false);
+    mShader.setUniform("enableAmbientOcclusion", false);
+  }
+
+  glBindTexture(GL_TEXTURE_2D, mTargetTexture);
+  glTexImage2D(
+    GL_TEXTURE_2D,
+    0,
+    GL_RGBA8,
+    TARGET_WIDTH,
+    TARGET_HEIGHT,
+    0,
+    GL_RGBA,
+    GL_UNSIGNED_BYTE,
+    nullptr);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  glBindRenderbuffer(GL_RENDERBUFFER, mTargetDepthBuffer);
+  glRenderbufferStorage(
+    GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, TARGET_WIDTH, TARGET_HEIGHT);
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+  GLint previousFramebuffer = 0;
+  glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, mTarget);
+  glFramebufferTexture2D(
+    GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mTargetTexture, 0);
+  glFramebufferRenderbuffer(
+    GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, mTargetDepthBuffer);
+
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+  {
+    LOG_F(ERROR, "Model preview render target is incomplete");
+  }
+
+  glBindFramebuffer(GL_FRAMEBUFFER, GLuint(previousFramebuffer));
+}
+
+
+void ModelBrowser::setWad(const WadData* pWad)
+{
+  mPreviews.clear();
+  mModelNames.clear();
+
+  mpWad = pWad;
+
+  if (pWad)
+  {
+    for (const auto& [name, _] : pWad->mModels)
+    {
+      mModelNames.push_back(name);
+    }
+
+    std::sort(mModelNames.begin(), mModelNames.end());
+  }
+}
+
+
+void ModelBrowser::updateAndRender(const double dt, bool* pIsOpen)
+{
+  mPreviews.update();
+
+  mRotation = std::fmod(
+    mRotation + float(dt) * ROTATION_SPEED, glm::two_pi<float>());
+
+  const auto fontSize = ImGui::GetFontSize();
+  ImGui::SetNextWindowSize(
+    {fontSize * 24.0f, fontSize * 30.0f}, ImGuiCond_FirstUseEver);
+
+  if (!ImGui::Begin("Models", pIsOpen))
+  {
+    ImGui::End();
+    return;
+  }
+
+  if (!mpWad || mModelNames.empty())
+  {
+    ImGui::TextDisabled(mpWad ? "No models in WAD file" : "No map loaded");
+    ImGui::End();
+    return;
+  }
+
+  ImGui::Text(
+    "%zu models, %zu previews cached", mModelNames.size(), mPreviews.size());
+
+  ImGui::BeginChild("ModelList");
+
+  GLint previousFramebuffer = 0;
+  GLint previousViewport[4] = {};
+  glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+  glGetIntegerv(GL_VIEWPORT, previousViewport);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, mTarget);
+  glViewport(0, 0, TARGET_WIDTH, TARGET_HEIGHT);
+  glClearColor(0.15f, 0.15f, 0.15f, 1.0f);
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  glEnable(GL_DEPTH_TEST);
+  glEnable(GL_CULL_FACE);
+  mShader.use();
+
+  const auto previewSize = ImVec2{float(PREVIEW_SIZE), float(PREVIEW_SIZE)};
+  auto nextTile = 0;
+
+  // Only list entries that are actually visible are submitted, and only
+  // those request previews
+  ImGuiListClipper clipper;
+  clipper.Begin(
+    int(mModelNames.size()), previewSize.y + ImGui::GetStyle().ItemSpacing.y);
+
+  while (clipper.Step())
+  {
+    for (auto i = clipper.DisplayStart; i < clipper.DisplayEnd; ++i)
+    {
+      const auto index = std::size_t(i);
+      const auto& name = mModelNames[index];
+      const auto pPreview = mPreviews.find(index);
+
+      if (pPreview && nextTile < NUM_TILES)
+      {
+        const auto tileX = float(nextTile % NUM_TILE_COLUMNS * PREVIEW_SIZE);
+        const auto tileY = float(nextTile / NUM_TILE_COLUMNS * PREVIEW_SIZE);
+
+        glViewport(int(tileX), int(tileY), PREVIEW_SIZE, PREVIEW_SIZE);
+        renderPreview(*pPreview);
+        ++nextTile;
+
+        // Flipped vertically, since OpenGL's origin is at the bottom
+        ImGui::Image(
+          toImTextureId(mTargetTexture),
+          previewSize,
+          {tileX / TARGET_WIDTH, (tileY + previewSize.y) / TARGET_HEIGHT},
+          {(tileX + previewSize.x) / TARGET_WIDTH, tileY / TARGET_HEIGHT});
+      }
+      else
+      {
+        ImGui::Dummy(previewSize);
+
+        if (!pPreview)
+        {
+          mPreviews.request(index);
+        }
+      }
+
+      ImGui::SameLine();
+
+      if (pPreview)
+      {
+        ImGui::Text(
+          "%s\n%u triangles", name.c_str(), unsigned(pPreview->mNumTriangles));
+      }
+      else
+      {
+        ImGui::Text(
+          "%s\n%s",
+          name.c_str(),
+          mPreviews.hasFailed(index) ? "failed to load" : "loading...");
+      }
+    }
+  }
+
+  glBindFramebuffer(GL_FRAMEBUFFER, GLuint(previousFramebuffer));
+  glViewport(
+    previousViewport[0],
+    previousViewport[1],
+    previousViewport[2],
+    previousViewport[3]);
+
+  ImGui::EndChild();
+  ImGui::End();
+
+  mPreviews.submitRequests();
+}
+
+
+void ModelBrowser::renderPreview(Preview& preview)
+{
+  // Place the camera so that the model's bounding sphere fills the view,
+  // looking slightly down onto it
+  const auto radius = std::max(preview.mRadius, 0.01f);
+  const auto distance = radius / std::sin(FIELD_OF_VIEW / 2.0f);
+
+  const auto projection = glm::perspective(
+    FIELD_OF_VIEW, 1.0f, distance * 0.05f, distance * 2.0f);
+  const auto view = glm::lookAt(
+    glm::vec3(0.0f, distance * 0.3f, distance),
+    glm::vec3(0.0f),
+    glm::vec3(0.0f, 1.0f, 0.0f));
+  const auto model =
+    glm::rotate(glm::mat4(1.0f), mRotation, glm::vec3(0.0f, 1.0f, 0.0f));
+
+  mShader.setUniform("transform", projection * view * model);
+  glBindTexture(GL_TEXTURE_2D, preview.mTextures);
+
+  DrawStats stats;
+  preview.mMesh.drawIf(
+    mShader, [](std::size_t) { return true; }, stats);
+}
+
+} // namespace saucer
@@ -0,0 +1,85 @@
+/* Copyright (C) 2024, Nikolai Wuttke. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "map_renderer.hpp"
+#include "preview_cache.hpp"
+
+#include <rigel/opengl/handle.hpp>
+#include <rigel/opengl/shader.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+namespace saucer
+{
+
+/** Panel listing all models in a WAD file, with rotating 3D previews
+ *
+ * A model's mesh and texture atlas are only built once it scrolls into
+ * view. That happens on the shared worker pool, the main thread only
+ * uploads the results. Uploaded previews are kept in an LRU cache of
+ * bounded size.
+ *
+ * All visible previews are rendered into tiles of a single offscreen
+ * render target, which the list then displays.
+ */
+class ModelBrowser
+{
+public:
+  ModelBrowser();
+
+  ModelBrowser(const ModelBrowser&) = delete;
+  ModelBrowser& operator=(const ModelBrowser&) = delete;
+
+  /** Switches to another WAD file, or none if nullptr
+   *
+   * Must be called before the currently set WadData is destroyed. Waits for
+   * models which are currently being built.
+   */
+  void setWad(const WadData* pWad);
+
+  void updateAndRender(double dt, bool* pIsOpen);
+
+private:
+  struct Preview
+  {
+    rigel::opengl::Handle<rigel::opengl::tag::Texture> mTextures;
+    MaskedMesh mMesh;
+    float mRadius;
+    uint32_t mNumTriangles;
+  };
+
+  void renderPreview(Preview& preview);
+
+  rigel::opengl::Shader mShader;
+  rigel::opengl::Handle<rigel::opengl::tag::Texture> mTargetTexture;
+  rigel::opengl::Handle<rigel::opengl::tag::Renderbuffer> mTargetDepthBuffer;
+  rigel::opengl::Handle<rigel::opengl::tag::Framebuffer> mTarget;
+  float mRotation = 0.0f;
+
+  const WadData* mpWad = nullptr;
+  std::vector<std::string> mModelNames;
+
+  // Declared last, so that it's destroyed first. Its destructor waits for
+  // models in progress, which use the WAD and model names.
+  PreviewCache<ModelPreviewData, Preview> mPreviews;
+};
+
+} // namespace saucer
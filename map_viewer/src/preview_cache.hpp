@@ -0,0 +1,318 @@
+/* Copyright (C) 2024, Nikolai Wuttke. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "worker_pool.hpp"
+
+#include <rigel/base/warnings.hpp>
+#include <rigel/opengl/handle.hpp>
+
+RIGEL_DISABLE_WARNINGS
+#include <imgui.h>
+RIGEL_RESTORE_WARNINGS
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+
+namespace saucer
+{
+
+/** For showing a preview texture with ImGui::Image() */
+inline ImTextureID toImTextureId(
+  const rigel::opengl::Handle<rigel::opengl::tag::Texture>& texture)
+{
+  return reinterpret_cast<ImTextureID>(std::uintptr_t(GLuint(texture)));
+}
+
+
+/** LRU cache of previews which are built lazily on the shared worker pool
+ *
+ * Meant for panels listing many items, of which only the visible ones need
+ * a preview. Each frame, the panel calls update(), then looks up the
+ * previews it shows with find(), requests the missing ones with request(),
+ * and finally calls submitRequests(). Requests which aren't renewed in the
+ * next frame are dropped, so that items scrolled out of view in the
+ * meantime aren't built anymore.
+ *
+ * Building the Data for an item runs on the pool, see runAsync(). Only the
+ * upload, which turns Data into an Item and may create OpenGL objects,
+ * happens on the main thread. A build returning nothing marks the item as
+ * failed, it is not requested again until clear() is called.
+ */
+template <typename Data, typename Item>
+class PreviewCache
+{
+public:
+  using BuildFunc = std::function<std::optional<Data>(std::size_t)>;
+  using UploadFunc = std::function<Item(Data&&)>;
+
+  PreviewCache(
+    std::size_t maxItems,
+    std::size_t maxConcurrentBuilds,
+    BuildFunc build,
+    UploadFunc upload);
+  ~PreviewCache();
+
+  PreviewCache(const PreviewCache&) = delete;
+  PreviewCache& operator=(const PreviewCache&) = delete;
+
+  /** Drops all items, failures and requests
+   *
+   * Waits for builds in progress. Afterwards, the build function doesn't
+   * run anymore until the next request, so state it depends on can be
+   * changed safely.
+   */
+  void clear();
+
+  /** Uploads finished builds, and evicts the least recently used items */
+  void update();
+
+  /** Returns the item's preview if it exists, and marks it as recently used
+   */
+  Item* find(std::size_t index);
+
+  bool hasFailed(std::size_t index) const
+  {
+    return mFailedItems.count(index) != 0;
+  }
+
+  /** Asks for the item's preview to be built, see submitRequests() */
+  void request(std::size_t index);
+
+  /** Replaces the previous frame's requests with the ones made since
+   *
+   * Items requested first are built first.
+   */
+  void submitRequests();
+
+  std::size_t size() const { return mItems.size(); }
+
+private:
+  struct Entry
+  {
+    Item mItem;
+    std::list<std::size_t>::iterator mLruPosition;
+  };
+
+  struct BuildResult
+  {
+    std::size_t mIndex;
+    std::optional<Data> moData;
+  };
+
+  void runBuilds();
+
+  const std::size_t mMaxItems;
+  const std::size_t mMaxConcurrentBuilds;
+  BuildFunc mBuild;
+  UploadFunc mUpload;
+
+  std::unordered_map<std::size_t, Entry> mItems;
+  std::list<std::size_t> mLruOrder; // most recently used first
+  std::unordered_set<std::size_t> mFailedItems;
+  std::vector<std::size_t> mMissingItems;
+
+  std::mutex mMutex;
+  std::condition_variable mBuildsFinished;
+  std::vector<std::size_t> mRequests; // next one to build at the back
+  std::unordered_set<std::size_t> mItemsInProgress;
+  std::vector<BuildResult> mBuildResults;
+  std::size_t mNumRunningTasks = 0;
+};
+
+
+template <typename Data, typename Item>
+PreviewCache<Data, Item>::PreviewCache(
+  const std::size_t maxItems,
+  const std::size_t maxConcurrentBuilds,
+  BuildFunc build,
+  UploadFunc upload)
+  : mMaxItems(maxItems)
+  , mMaxConcurrentBuilds(std::max(maxConcurrentBuilds, std::size_t(1)))
+  , mBuild(std::move(build))
+  , mUpload(std::move(upload))
+{
+}
+
+
+template <typename Data, typename Item>
+PreviewCache<Data, Item>::~PreviewCache()
+{
+  // Tasks on the pool refer to this object
+  clear();
+}
+
+
+template <typename Data, typename Item>
+void PreviewCache<Data, Item>::clear()
+{
+  {
+    std::unique_lock<std::mutex> lock(mMutex);
+    mRequests.clear();
+    mBuildsFinished.wait(lock, [this]() { return mNumRunningTasks == 0; });
+    mBuildResults.clear();
+  }
+
+  mItems.clear();
+  mLruOrder.clear();
+  mFailedItems.clear();
+  mMissingItems.clear();
+}
+
+
+template <typename Data, typename Item>
+void PreviewCache<Data, Item>::update()
+{
+  std::vector<BuildResult> results;
+
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    std::swap(results, mBuildResults);
+  }
+
+  for (auto& result : results)
+  {
+    if (!result.moData)
+    {
+      mFailedItems.insert(result.mIndex);
+      continue;
+    }
+
+    if (mItems.count(result.mIndex))
+    {
+      continue;
+    }
+
+    mLruOrder.push_front(result.mIndex);
+    mItems.emplace(
+      result.mIndex,
+      Entry{mUpload(std::move(*result.moData)), mLruOrder.begin()});
+  }
+
+  while (mItems.size() > mMaxItems)
+  {
+    mItems.erase(mLruOrder.back());
+    mLruOrder.pop_back();
+  }
+}
+
+
+template <typename Data, typename Item>
+Item* PreviewCache<Data, Item>::find(const std::size_t index)
+{
+  const auto iEntry = mItems.find(index);
+
+  if (iEntry == mItems.end())
+  {
+    return nullptr;
+  }
+
+  auto& entry = iEntry->second;
+  mLruOrder.splice(mLruOrder.begin(), mLruOrder, entry.mLruPosition);
+
+  return &entry.mItem;
+}
+
+
+template <typename Data, typename Item>
+void PreviewCache<Data, Item>::request(const std::size_t index)
+{
+  if (!hasFailed(index))
+  {
+    mMissingItems.push_back(index);
+  }
+}
+
+
+template <typename Data, typename Item>
+void PreviewCache<Data, Item>::submitRequests()
+{
+  auto numTasksToStart = std::size_t(0);
+
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    // Builds take requests from the back, hence the reverse order
+    mRequests.clear();
+
+    for (auto it = mMissingItems.rbegin(); it != mMissingItems.rend(); ++it)
+    {
+      if (!mItemsInProgress.count(*it))
+      {
+        mRequests.push_back(*it);
+      }
+    }
+
+    // Limiting the number of tasks leaves the rest of the pool to level
+    // loading, which also uses it
+    const auto numTasksWanted =
+      std::min(mRequests.size(), mMaxConcurrentBuilds);
+
+    if (numTasksWanted > mNumRunningTasks)
+    {
+      numTasksToStart = numTasksWanted - mNumRunningTasks;
+      mNumRunningTasks = numTasksWanted;
+    }
+  }
+
+  mMissingItems.clear();
+
+  for (auto i = std::size_t(0); i < numTasksToStart; ++i)
+  {
+    runAsync([this]() { runBuilds(); });
+  }
+}
+
+
+template <typename Data, typename Item>
+void PreviewCache<Data, Item>::runBuilds()
+{
+  std::unique_lock<std::mutex> lock(mMutex);
+
+  while (!mRequests.empty())
+  {
+    const auto index = mRequests.back();
+    mRequests.pop_back();
+    mItemsInProgress.insert(index);
+
+    lock.unlock();
+    auto oData = mBuild(index);
+    lock.lock();
+
+    mItemsInProgress.erase(index);
+    mBuildResults.push_back({index, std::move(oData)});
+  }
+
+  // Notifying with the lock held, since clear() might otherwise return and
+  // this object be destroyed before the notification
+  --mNumRunningTasks;
+  mBuildsFinished.notify_all();
+}
+
+} // namespace saucer
@@ -0,0 +1,358 @@
+/* Copyright (C) 2024, Nikolai Wuttke. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "render_check.hpp"
+
+#include "camera_bookmarks.hpp"
+#include "map_file.hpp"
+#include "map_renderer.hpp"
+
+#include <rigel/base/clock.hpp>
+#include <rigel/base/image_loading.hpp>
+#include <rigel/base/warnings.hpp>
+#include <rigel/opengl/handle.hpp>
+#include <rigel/opengl/opengl.hpp>
+
+RIGEL_DISABLE_WARNINGS
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+RIGEL_RESTORE_WARNINGS
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+
+namespace saucer
+{
+
+using namespace rigel;
+
+
+namespace
+{
+
+constexpr auto VIEW_WIDTH = 320;
+constexpr auto VIEW_HEIGHT = 240;
+constexpr auto NUM_ORBIT_VIEWS = 4;
+
+// Rasterization rules and precision differ slightly between GL
+// implementations, so a few pixels are allowed to deviate a bit
+constexpr auto CHANNEL_TOLERANCE = 8;
+constexpr auto MAX_DIFFERING_PIXELS_FRACTION = 0.001;
+
+
+struct RenderTarget
+{
+  RenderTarget()
+    : mColorBuffer(opengl::Handle<opengl::tag::Renderbuffer>::create())
+    , mDepthBuffer(opengl::Handle<opengl::tag::Renderbuffer>::create())
+    , mFramebuffer(opengl::Handle<opengl::tag::Framebuffer>::create())
+  {
+    glBindRenderbuffer(GL_RENDERBUFFER, mColorBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, VIEW_WIDTH, VIEW_HEIGHT);
+    glBindRenderbuffer(GL_RENDERBUFFER, mDepthBuffer);
+    glRenderbufferStorage(
+      GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, VIEW_WIDTH, VIEW_HEIGHT);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer);
+    glFramebufferRenderbuffer(
+      GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, mColorBuffer);
+    glFramebufferRenderbuffer(
+      GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, mDepthBuffer);
+  }
+
+  bool isComplete() const
+  {
+    return glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+  }
+
+  opengl::Handle<opengl::tag::Renderbuffer> mColorBuffer;
+  opengl::Handle<opengl::tag::Renderbuffer> mDepthBuffer;
+  opengl::Handle<opengl::tag::Framebuffer> mFramebuffer;
+};
+
+
+/** Reads back the current framebuffer, as an opaque top-to-bottom image */
+base::Image readPixels()
+{
+  constexpr auto ROW_SIZE = std::size_t(VIEW_WIDTH) * sizeof(base::Color);
+
+  std::vector<std::uint8_t> data(ROW_SIZE * VIEW_HEIGHT);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(
+    0, 0, VIEW_WIDTH, VIEW_HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, data.data());
+
+  base::PixelBuffer pixels(std::size_t(VIEW_WIDTH) * VIEW_HEIGHT);
+
+  // OpenGL returns rows bottom to top
+  for (auto y = 0; y < VIEW_HEIGHT; ++y)
+  {
+    std::memcpy(
+      pixels.data() + std::size_t(y) * VIEW_WIDTH,
+      data.data() + std::size_t(VIEW_HEIGHT - 1 - y) * ROW_SIZE,
+      ROW_SIZE);
+  }
+
+  for (auto& pixel : pixels)
+  {
+    pixel.a = 255;
+  }
+
+  return base::Image{std::move(pixels), VIEW_WIDTH, VIEW_HEIGHT};
+}
+
+
+/** Fraction of pixels differing by more than the tolerance in any channel */
+double differingPixelsFraction(
+  const base::Image& actual,
+  const base::Image& expected)
+{
+  if (
+    actual.width() != expected.width() ||
+    actual.height() != expected.height())
+  {
+    return 1.0;
+  }
+
+  const auto& actualPixels = actual.pixelData();
+  const auto& expectedPixels = expected.pixelData();
+
+  auto exceedsTolerance = [](const int lhs, const int rhs) {
+    return std::abs(lhs - rhs) > CHANNEL_TOLERANCE;
+  };
+
+  auto numDiffering = std::size_t(0);
+
+  for (auto i = std::size_t(0); i < actualPixels.size(); ++i)
+  {
+    const auto& a = actualPixels[i];
+    const auto& e = expectedPixels[i];
+
+    if (
+      exceedsTolerance(a.r, e.r) || exceedsTolerance(a.g, e.g) ||
+      exceedsTolerance(a.b, e.b))
+    {
+      ++numDiffering;
+    }
+  }
+
+  return double(numDiffering) / double(actualPixels.size());
+}
+
+
+/** Views from all four sides, looking down towards the level's center */
+CameraBookmark orbitView(
+  const glm::vec3& boundsMin,
+  const glm::vec3& boundsMax,
+  const int view)
+{
+  const auto center = (boundsMin + boundsMax) * 0.5f;
+  const auto radius = glm::distance(boundsMin, boundsMax) * 0.5f;
+
+  const auto angle = float(view) * glm::half_pi<float>();
+  const auto direction =
+    glm::normalize(glm::vec3(std::cos(angle), -0.4f, std::sin(angle)));
+
+  return {
+    std::to_string(view), center - direction * (radius * 0.6f), direction};
+}
+
+
+/** The orbit views, followed by the map's own camera positions */
+std::vector<CameraBookmark>
+  checkedViews(const MapData& map, const LevelData& level)
+{
+  std::vector<CameraBookmark> views;
+
+  for (auto view = 0; view < NUM_ORBIT_VIEWS; ++view)
+  {
+    views.push_back(orbitView(level.mBoundsMin, level.mBoundsMax, view));
+  }
+
+  auto mapViews = mapCameraBookmarks(map);
+
+  for (auto i = std::size_t(0); i < mapViews.size(); ++i)
+  {
+    mapViews[i].mName = "cam" + std::to_string(i);
+    views.push_back(std::move(mapViews[i]));
+  }
+
+  return views;
+}
+
+
+/** Renders and checks all views of one level, returns number of failures
+ *
+ * With updateGoldenImages, views without a matching golden image replace it
+ * instead of failing.
+ */
+int checkLevel(
+  const std::filesystem::path& mapFile,
+  const std::filesystem::path& goldenImageDirectory,
+  const bool updateGoldenImages,
+  const RenderTarget& target)
+{
+  const auto mapName = mapFile.stem().u8string();
+
+  const auto oWad = loadWadFile(wadFileForMap(mapFile));
+  const auto oMap = oWad ? loadMapfile(mapFile, *oWad) : std::nullopt;
+
+  if (!oMap)
+  {
+    std::printf("%s: FAILED to load\n", mapName.c_str());
+    return 1;
+  }
+
+  auto level = buildLevelData(*oMap, *oWad);
+  const auto views = checkedViews(*oMap, level);
+
+  MapRenderer renderer;
+  renderer.addLevel(std::move(level), glm::vec3(0.0f));
+
+  glBindFramebuffer(GL_FRAMEBUFFER, target.mFramebuffer);
+  glViewport(0, 0, VIEW_WIDTH, VIEW_HEIGHT);
+
+  // Rendering once beforehand keeps one-time costs out of the timings
+  renderer.setCamera(views[0].mPosition, views[0].mDirection);
+  renderer.updateAndRender(0.0, {VIEW_WIDTH, VIEW_HEIGHT});
+  glFinish();
+
+  auto numFailures = 0;
+
+  for (const auto& view : views)
+  {
+    renderer.setCamera(view.mPosition, view.mDirection);
+
+    // Waiting for the GPU to finish makes the timing meaningful
+    const auto startTime = base::Clock::now();
+    renderer.updateAndRender(0.0, {VIEW_WIDTH, VIEW_HEIGHT});
+    glFinish();
+    const auto renderTime =
+      std::chrono::duration<double>(base::Clock::now() - startTime).count();
+
+    const auto actual = readPixels();
+
+    const auto imageName = mapName + "_" + view.mName;
+    const auto goldenPath = goldenImageDirectory / (imageName + ".png");
+
+    std::printf(
+      "%s view %s (%.2f ms): ",
+      mapName.c_str(),
+      view.mName.c_str(),
+      renderTime * 1000.0);
+
+    const auto oExpected = std::filesystem::exists(goldenPath)
+      ? base::loadImage(goldenPath.u8string())
+      : std::nullopt;
+    const auto fraction =
+      oExpected ? differingPixelsFraction(actual, *oExpected) : 1.0;
+
+    if (fraction <= MAX_DIFFERING_PIXELS_FRACTION)
+    {
+      std::printf("ok\n");
+      continue;
+    }
+
+    if (updateGoldenImages)
+    {
+      if (base::saveImage(goldenPath.u8string(), actual))
+      {
+        std::printf("updated golden image\n");
+        continue;
+      }
+
+      std::printf("FAILED to save golden image\n");
+      ++numFailures;
+      continue;
+    }
+
+    if (!oExpected)
+    {
+      std::printf("FAILED, missing or unreadable golden image\n");
+      ++numFailures;
+      continue;
+    }
+
+    const auto actualPath =
+      goldenImageDirectory / (imageName + "_actual.png");
+    base::saveImage(actualPath.u8string(), actual);
+
+    std::printf("FAILED, %.2f%% of pixels differ\n", fraction * 100.0);
+    ++numFailures;
+  }
+
+  return numFailures;
+}
+
+} // namespace
+
+
+int runRenderCheck(
+  const std::filesystem::path& mapDirectory,
+  const std::filesystem::path& goldenImageDirectory,
+  const bool updateGoldenImages)
+{
+  const auto mapFiles = findMapFiles(mapDirectory);
+
+  if (mapFiles.empty())
+  {
+    std::fprintf(
+      stderr, "No map files found in '%s'\n", mapDirectory.u8string().c_str());
+    return 1;
+  }
+
+  if (updateGoldenImages)
+  {
+    std::error_code error;
+    std::filesystem::create_directories(goldenImageDirectory, error);
+  }
+
+  const auto target = RenderTarget{};
+
+  if (!target.isComplete())
+  {
+    std::fprintf(stderr, "Failed to create offscreen render target\n");
+    return 1;
+  }
+
+  auto numFailures = 0;
+
+  for (const auto& mapFile : mapFiles)
+  {
+    numFailures += checkLevel(
+      mapFile, goldenImageDirectory, updateGoldenImages, target);
+  }
+
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+  if (numFailures > 0)
+  {
+    std::printf("%d failures\n", numFailures);
+    return 1;
+  }
+
+  return 0;
+}
+
+} // namespace saucer
@@ -0,0 +1,46 @@
+/* Copyright (C) 2024, Nikolai Wuttke. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <filesystem>
+
+
+namespace saucer
+{
+
+/** Renders fixed views of all maps in a directory, and compares to goldens
+ *
+ * For each map, a few views from around the level towards its center are
+ * rendered into an offscreen target of fixed size. Each view is compared
+ * against a PNG file of the same name in the golden image directory,
+ * allowing for small per-channel differences. A missing golden image counts
+ * as a mismatch. For mismatches, the actual result is saved next to the
+ * golden image, with an "_actual" suffix. With updateGoldenImages, the
+ * actual result replaces missing or mismatching golden images instead, and
+ * these views don't count as failures.
+ *
+ * Prints one line per view, including the time it took to render. Requires
+ * a current OpenGL context. Returns the process exit code, which is
+ * non-zero if any view didn't match or any map failed to load.
+ */
+int runRenderCheck(
+  const std::filesystem::path& mapDirectory,
+  const std::filesystem::path& goldenImageDirectory,
+  bool updateGoldenImages);
+
+} // namespace saucer
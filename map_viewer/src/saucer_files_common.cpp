@@ -16,7 +16,7 @@
 
 #include "saucer_files_common.hpp"
 
-#include <rigel/base/binary_io.hpp>
+#include "file_format_records.hpp"
 
 
 namespace saucer
@@ -41,24 +41,23 @@ std::string readString(std::istream& stream, int maxLength)
 
 TextureDef readTextureDef(std::istream& f)
 {
-  using namespace rigel::base;
+  const auto record = readRecord<TextureDefRecord>(f);
+
+  const auto uvs = std::array{
+    record.get<TextureDefRecord::Uv1>(),
+    record.get<TextureDefRecord::Uv2>(),
+    record.get<TextureDefRecord::Uv3>(),
+    record.get<TextureDefRecord::Uv4>()};
 
   TextureDef def;
 
-  def.uvs[0].u = read<uint8_t>(f);
-  def.uvs[0].v = read<uint8_t>(f);
-  def.bitmapIndex = read<uint16_t>(f);
-  def.uvs[1].u = read<uint8_t>(f);
-  def.uvs[1].v = read<uint8_t>(f);
-  skipBytes(f, sizeof(uint8_t) * 2);
-  def.uvs[2].u = read<uint8_t>(f);
-  def.uvs[2].v = read<uint8_t>(f);
-  skipBytes(f, sizeof(uint16_t));
-  def.uvs[3].u = read<uint8_t>(f);
-  def.uvs[3].v = read<uint8_t>(f);
-
-  const auto flags = read<uint16_t>(f);
-  def.isMasked = flags & 1;
+  for (auto i = 0u; i < uvs.size(); ++i)
+  {
+    def.uvs[i] = UvPair{uvs[i][0], uvs[i][1]};
+  }
+
+  def.bitmapIndex = record.get<TextureDefRecord::BitmapIndex>();
+  def.isMasked = record.get<TextureDefRecord::Flags>() & 1;
 
   return def;
 }
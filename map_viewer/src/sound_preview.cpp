@@ -0,0 +1,192 @@
+/* Copyright (C) 2024, Nikolai Wuttke. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "sound_preview.hpp"
+
+#include <rigel/base/warnings.hpp>
+
+RIGEL_DISABLE_WARNINGS
+#include <SDL.h>
+#include <loguru.hpp>
+RIGEL_RESTORE_WARNINGS
+
+#include <algorithm>
+#include <cstring>
+
+
+namespace saucer
+{
+
+namespace
+{
+
+SDL_AudioFormat audioFormat(const SoundData& sound)
+{
+  // WAVE files store 8-bit samples as unsigned, everything else as signed
+  return sound.bitsPerSample == 8 ? AUDIO_U8 : AUDIO_S16LSB;
+}
+
+} // namespace
+
+
+SoundPreview::SoundPreview()
+{
+  if (SDL_InitSubSystem(SDL_INIT_AUDIO) == 0)
+  {
+    mAudioAvailable = true;
+  }
+  else
+  {
+    LOG_F(ERROR, "Failed to initialize audio: %s", SDL_GetError());
+  }
+}
+
+
+SoundPreview::~SoundPreview()
+{
+  if (mAudioAvailable)
+  {
+    closeDevice();
+    SDL_QuitSubSystem(SDL_INIT_AUDIO);
+  }
+}
+
+
+void SoundPreview::play(const SoundData& sound)
+{
+  if (!prepareDevice(sound))
+  {
+    return;
+  }
+
+  // Drop a trailing partial sample frame, if any
+  const auto frameSize =
+    std::size_t(sound.numChannels) * (sound.bitsPerSample / 8);
+  const auto numBytes = sound.samples.size() - sound.samples.size() % frameSize;
+
+  SDL_LockAudioDevice(mDevice);
+  mpNextSample = sound.samples.data();
+  mBytesRemaining = numBytes;
+  SDL_UnlockAudioDevice(mDevice);
+
+  SDL_PauseAudioDevice(mDevice, 0);
+}
+
+
+void SoundPreview::stop()
+{
+  if (!mDevice)
+  {
+    return;
+  }
+
+  SDL_LockAudioDevice(mDevice);
+  mpNextSample = nullptr;
+  mBytesRemaining = 0;
+  SDL_UnlockAudioDevice(mDevice);
+}
+
+
+bool SoundPreview::isPlaying() const
+{
+  if (!mDevice)
+  {
+    return false;
+  }
+
+  SDL_LockAudioDevice(mDevice);
+  const auto result = mBytesRemaining != 0;
+  SDL_UnlockAudioDevice(mDevice);
+
+  return result;
+}
+
+
+void SoundPreview::fillBuffer(
+  void* pUserData,
+  Uint8* pBuffer,
+  const int size)
+{
+  auto& self = *static_cast<SoundPreview*>(pUserData);
+
+  const auto numBytes = std::min(std::size_t(size), self.mBytesRemaining);
+
+  if (numBytes != 0)
+  {
+    std::memcpy(pBuffer, self.mpNextSample, numBytes);
+    self.mpNextSample += numBytes;
+    self.mBytesRemaining -= numBytes;
+  }
+
+  std::memset(
+    pBuffer + numBytes, self.mDeviceSpec.silence, std::size_t(size) - numBytes);
+}
+
+
+bool SoundPreview::prepareDevice(const SoundData& sound)
+{
+  if (!mAudioAvailable || sound.numChannels == 0)
+  {
+    return false;
+  }
+
+  const auto format = audioFormat(sound);
+
+  if (
+    mDevice && mDeviceSpec.freq == int(sound.sampleRate) &&
+    mDeviceSpec.format == format &&
+    mDeviceSpec.channels == sound.numChannels)
+  {
+    return true;
+  }
+
+  closeDevice();
+
+  SDL_AudioSpec desired{};
+  desired.freq = int(sound.sampleRate);
+  desired.format = format;
+  desired.channels = Uint8(sound.numChannels);
+  desired.samples = 2048;
+  desired.callback = fillBuffer;
+  desired.userdata = this;
+
+  // Passing no allowed changes makes SDL convert from the sound's format to
+  // whatever the hardware needs, so that the callback can always copy the
+  // samples as they are.
+  mDevice = SDL_OpenAudioDevice(nullptr, 0, &desired, &mDeviceSpec, 0);
+
+  if (!mDevice)
+  {
+    LOG_F(ERROR, "Failed to open audio device: %s", SDL_GetError());
+    return false;
+  }
+
+  return true;
+}
+
+
+void SoundPreview::closeDevice()
+{
+  if (mDevice)
+  {
+    SDL_CloseAudioDevice(mDevice);
+    mDevice = 0;
+    mpNextSample = nullptr;
+    mBytesRemaining = 0;
+  }
+}
+
+} // namespace saucer
@@ -0,0 +1,68 @@
+/* Copyright (C) 2024, Nikolai Wuttke. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "wad_file.hpp"
+
+#include <SDL_audio.h>
+
+#include <cstddef>
+#include <cstdint>
+
+
+namespace saucer
+{
+
+/** Plays back sound effects straight out of a WAD file's packed data
+ *
+ * The audio callback reads from the sound's sample view directly, so
+ * starting playback neither copies nor allocates. The audio device is only
+ * reopened when the sample format changes between sounds, SDL converts to
+ * the output format on the fly.
+ *
+ * The WadData that a playing sound belongs to must stay alive until the
+ * sound has finished, or stop() has been called.
+ */
+class SoundPreview
+{
+public:
+  SoundPreview();
+  ~SoundPreview();
+
+  SoundPreview(const SoundPreview&) = delete;
+  SoundPreview& operator=(const SoundPreview&) = delete;
+
+  void play(const SoundData& sound);
+  void stop();
+  bool isPlaying() const;
+
+private:
+  static void fillBuffer(void* pUserData, Uint8* pBuffer, int size);
+
+  bool prepareDevice(const SoundData& sound);
+  void closeDevice();
+
+  SDL_AudioDeviceID mDevice = 0;
+  SDL_AudioSpec mDeviceSpec{};
+  bool mAudioAvailable = false;
+
+  // Shared with the audio thread, only accessed while the device is locked
+  const std::uint8_t* mpNextSample = nullptr;
+  std::size_t mBytesRemaining = 0;
+};
+
+} // namespace saucer
@@ -0,0 +1,230 @@
+/* Copyright (C) 2024, Nikolai Wuttke. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "test_level.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+
+namespace saucer
+{
+
+namespace
+{
+
+constexpr auto PALETTE_SIZE_BYTES = std::size_t(256 * 4);
+constexpr auto PAGE_SIZE_BYTES =
+  std::size_t(TEXTURE_PAGE_SIZE * TEXTURE_PAGE_SIZE);
+
+constexpr auto NUM_PAGES = 3;
+
+// Map texture definitions, 0 means no texture
+constexpr auto TEXTURE_GRASS = uint16_t(1);
+constexpr auto TEXTURE_ROCK = uint16_t(2);
+constexpr auto TEXTURE_WALL = uint16_t(3);
+constexpr auto TEXTURE_FENCE = uint16_t(4);
+
+constexpr auto BLOCK_DEF_GRASS = uint32_t(1);
+constexpr auto BLOCK_DEF_ROCK = uint32_t(2);
+constexpr auto BLOCK_DEF_CUBE = uint32_t(3);
+constexpr auto BLOCK_DEF_FENCE = uint32_t(4);
+
+// Terrain covers a square in the middle of the map
+constexpr auto TERRAIN_START = 20;
+constexpr auto TERRAIN_SIZE = 24;
+
+
+/** Pixel value (palette index) of the given texture page at x, y */
+uint8_t pagePixel(const int page, const int x, const int y)
+{
+  switch (page)
+  {
+    case 0: // Checkerboard
+      return uint8_t(1 + ((x / 16 + y / 16) % 2) + (x / 128) * 2);
+
+    case 1: // Diagonal stripes
+      return uint8_t(5 + ((x + y) / 8) % 4);
+
+    default: // Grid with transparent holes
+      return x % 32 < 4 || y % 32 < 4 ? uint8_t(9) : uint8_t(0);
+  }
+}
+
+
+void fillWad(WadData& wad)
+{
+  wad.mBackgroundColor = 10;
+  wad.mPackedData.resize(PALETTE_SIZE_BYTES + NUM_PAGES * PAGE_SIZE_BYTES);
+
+  for (auto i = 0; i < 256; ++i)
+  {
+    const auto color = rigel::base::Color{
+      uint8_t(i * 37), uint8_t(255 - i * 11), uint8_t(i * 3), 0};
+    std::memcpy(&wad.mPackedData[i * sizeof(color)], &color, sizeof(color));
+  }
+
+  for (auto page = 0; page < NUM_PAGES; ++page)
+  {
+    const auto offset = PALETTE_SIZE_BYTES + page * PAGE_SIZE_BYTES;
+    wad.mBitmaps.push_back(
+      {uint32_t(offset), TEXTURE_PAGE_SIZE, TEXTURE_PAGE_SIZE});
+
+    for (auto y = 0; y < TEXTURE_PAGE_SIZE; ++y)
+    {
+      for (auto x = 0; x < TEXTURE_PAGE_SIZE; ++x)
+      {
+        wad.mPackedData[offset + x + y * TEXTURE_PAGE_SIZE] =
+          pagePixel(page, x, y);
+      }
+    }
+  }
+}
+
+
+TextureDef makeTextureDef(
+  const uint16_t page,
+  const uint8_t left,
+  const uint8_t top,
+  const uint8_t right,
+  const uint8_t bottom,
+  const bool isMasked = false)
+{
+  return TextureDef{
+    {{{left, top}, {right, top}, {right, bottom}, {left, bottom}}},
+    page,
+    isMasked};
+}
+
+
+BlockDef makeBlockDef(
+  const uint16_t sides,
+  const uint16_t top,
+  const uint16_t bottom,
+  const int16_t height)
+{
+  auto blockDef = BlockDef{};
+  blockDef.texturesInside = {sides, top, sides, sides, sides, bottom};
+  blockDef.texturesOutside = {sides, top, sides, sides, sides, bottom};
+  blockDef.vertexCoordinatesY = {0, 0, 0, 0, height, height, height, height};
+  return blockDef;
+}
+
+
+/** Terrain height at the given corner, a hill with a flat top */
+int16_t terrainHeightAt(const int x, const int y)
+{
+  const auto distance = std::abs(x - 32) + std::abs(y - 32);
+  return int16_t(-std::max(0, std::min(8, 14 - distance)) * 48);
+}
+
+
+void fillMap(MapData& map)
+{
+  map.mTextureDefs = {
+    TextureDef{},
+    makeTextureDef(0, 0, 0, 127, 127),
+    makeTextureDef(0, 128, 0, 255, 127),
+    makeTextureDef(1, 0, 0, 255, 255),
+    makeTextureDef(2, 0, 0, 255, 255, true)};
+
+  auto terrainDef = [](const uint16_t texture) {
+    auto blockDef = BlockDef{};
+    blockDef.texturesInside.bottom = texture;
+    return blockDef;
+  };
+
+  map.mBlockDefs = {
+    BlockDef{},
+    terrainDef(TEXTURE_GRASS),
+    terrainDef(TEXTURE_ROCK),
+    makeBlockDef(TEXTURE_WALL, TEXTURE_WALL, TEXTURE_WALL, -256),
+    makeBlockDef(TEXTURE_FENCE, 0, 0, -128)};
+
+  for (auto y = TERRAIN_START; y < TERRAIN_START + TERRAIN_SIZE; ++y)
+  {
+    for (auto x = TERRAIN_START; x < TERRAIN_START + TERRAIN_SIZE; ++x)
+    {
+      auto& tile = map.terrainAt(x, y);
+      tile.x = uint16_t(x);
+      tile.y = uint16_t(y);
+      tile.blockDefIndex =
+        (x / 4 + y / 4) % 3 == 0 ? BLOCK_DEF_ROCK : BLOCK_DEF_GRASS;
+      tile.flags = uint8_t(((x + y) % 4) << 4);
+      tile.brightnessAdjustment = int16_t(((x * y) % 5 - 2) * 16);
+      tile.verticalOffset = terrainHeightAt(x, y);
+    }
+  }
+
+  // A ramp leading up the hill
+  for (auto i = 0; i < 4; ++i)
+  {
+    auto tile = ExtraTerrainTile{};
+    tile.x = uint16_t(24 + i);
+    tile.y = 36;
+    tile.blockDefIndex = BLOCK_DEF_ROCK;
+    tile.flags = uint8_t(i << 4);
+    tile.brightnessAdjustment = int16_t(i * 32);
+
+    const auto low = int16_t(-64 - i * 96);
+    const auto high = int16_t(low - 96);
+    tile.vertexCoordinatesY = {low, high, high, low};
+    map.mItems.push_back(tile);
+  }
+
+  // Closed cubes, standing next to each other and partly stacked
+  auto addBlock = [&](
+                    const uint32_t blockDef,
+                    const int x,
+                    const int y,
+                    const int16_t verticalOffset,
+                    const uint8_t flags) {
+    auto block = BlockInstance{};
+    block.x = uint16_t(x);
+    block.y = uint16_t(y);
+    block.blockDefIndex = blockDef;
+    block.flags = flags;
+    block.brightnessAdjustment = 0;
+    block.verticalOffset = verticalOffset;
+    block.vertexOffsetsY = {};
+    map.mItems.push_back(block);
+  };
+
+  addBlock(BLOCK_DEF_CUBE, 23, 23, 0, 0);
+  addBlock(BLOCK_DEF_CUBE, 24, 23, 0, 0x10);
+  addBlock(BLOCK_DEF_CUBE, 23, 23, -256, 0x20);
+
+  // A fence around the top of the hill
+  for (auto i = 0; i < 4; ++i)
+  {
+    addBlock(BLOCK_DEF_FENCE, 30 + i, 29, -384, uint8_t(i << 4));
+  }
+}
+
+} // namespace
+
+
+TestLevel makeTestLevel()
+{
+  TestLevel level;
+  fillWad(level.mWad);
+  fillMap(level.mMap);
+  return level;
+}
+
+} // namespace saucer
@@ -0,0 +1,43 @@
+/* Copyright (C) 2024, Nikolai Wuttke. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "map_file.hpp"
+#include "wad_file.hpp"
+
+
+namespace saucer
+{
+
+/** A small generated level, for testing without the game's files
+ *
+ * Has terrain of varying height, extra terrain, closed and open blocks, and
+ * masked as well as solid textures, but no models. The contents never
+ * change, so the level data built from it only changes when the build
+ * process does.
+ */
+struct TestLevel
+{
+  WadData mWad;
+  MapData mMap;
+};
+
+
+TestLevel makeTestLevel();
+
+} // namespace saucer
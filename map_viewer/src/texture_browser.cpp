@@ -0,0 +1,213 @@
+/* Copyright (C) 2024, Nikolai Wuttke. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "texture_browser.hpp"
+
+#include <rigel/base/warnings.hpp>
+#include <rigel/opengl/utils.hpp>
+
+RIGEL_DISABLE_WARNINGS
+#include <imgui.h>
+RIGEL_RESTORE_WARNINGS
+
+#include <algorithm>
+
+
+namespace saucer
+{
+
+using namespace rigel;
+
+
+namespace
+{
+
+constexpr auto THUMBNAIL_SIZE = 64;
+
+// 64x64 RGBA thumbnails take up 16 KiB each, so this limits the cache to
+// 16 MiB of texture memory. It needs to be larger than the number of
+// thumbnails which fit on screen at once.
+constexpr auto MAX_CACHED_THUMBNAILS = std::size_t(1024);
+
+constexpr auto MAX_CONCURRENT_DECODES = std::size_t(4);
+
+
+/** Scales the bitmap down to fit into a thumbnail, preserving aspect ratio
+ *
+ * Smaller bitmaps are kept at their original size. The result is always
+ * THUMBNAIL_SIZE squared, with the bitmap centered on a transparent
+ * background, so that all thumbnails can be laid out in a regular grid.
+ */
+base::Image makeThumbnail(
+  const WadData& wad,
+  const Palette& palette,
+  const std::size_t bitmapIndex)
+{
+  base::PixelBuffer pixels(THUMBNAIL_SIZE * THUMBNAIL_SIZE);
+
+  const auto& bitmap = wad.mBitmaps[bitmapIndex];
+  const auto sourceWidth = int(bitmap.width);
+  const auto sourceHeight = int(bitmap.height);
+  const auto numPixels = std::size_t(sourceWidth) * sourceHeight;
+
+  if (
+    numPixels == 0 || bitmap.offset > wad.mPackedData.size() ||
+    wad.mPackedData.size() - bitmap.offset < numPixels)
+  {
+    return base::Image{std::move(pixels), THUMBNAIL_SIZE, THUMBNAIL_SIZE};
+  }
+
+  const auto scale = std::min(
+    1.0f, float(THUMBNAIL_SIZE) / float(std::max(sourceWidth, sourceHeight)));
+  const auto width = std::max(int(float(sourceWidth) * scale), 1);
+  const auto height = std::max(int(float(sourceHeight) * scale), 1);
+  const auto left = (THUMBNAIL_SIZE - width) / 2;
+  const auto top = (THUMBNAIL_SIZE - height) / 2;
+
+  const auto* pSourceData = wad.mPackedData.data() + bitmap.offset;
+
+  for (auto y = 0; y < height; ++y)
+  {
+    const auto* pSourceRow =
+      pSourceData + (y * sourceHeight / height) * sourceWidth;
+    auto* pDestRow = pixels.data() + (top + y) * THUMBNAIL_SIZE + left;
+
+    for (auto x = 0; x < width; ++x)
+    {
+      pDestRow[x] = palette[pSourceRow[x * sourceWidth / width]];
+    }
+  }
+
+  return base::Image{std::move(pixels), THUMBNAIL_SIZE, THUMBNAIL_SIZE};
+}
+
+} // namespace
+
+
+TextureBrowser::TextureBrowser()
+  : mThumbnails(
+      MAX_CACHED_THUMBNAILS,
+      MAX_CONCURRENT_DECODES,
+      [this](const std::size_t bitmapIndex) {
+        // The WadData and palette remain valid while a bitmap is in
+        // progress, since setWad() waits for all of them to be finished.
+        return std::optional<base::Image>{
+          makeThumbnail(*mpWad, *mpPalette, bitmapIndex)};
+      },
+      [](base::Image&& image) { return opengl::createTexture(image); })
+{
+}
+
+
+void TextureBrowser::setWad(const WadData* pWad)
+{
+  mThumbnails.clear();
+
+  mpWad = pWad;
+  mpPalette = pWad ? pWad->loadPalette() : nullptr;
+}
+
+
+void TextureBrowser::updateAndRender(bool* pIsOpen)
+{
+  mThumbnails.update();
+
+  const auto fontSize = ImGui::GetFontSize();
+  ImGui::SetNextWindowSize(
+    {fontSize * 30.0f, fontSize * 30.0f}, ImGuiCond_FirstUseEver);
+
+  if (!ImGui::Begin("Textures", pIsOpen))
+  {
+    ImGui::End();
+    return;
+  }
+
+  if (!mpWad || mpWad->mBitmaps.empty())
+  {
+    ImGui::TextDisabled(mpWad ? "No bitmaps in WAD file" : "No map loaded");
+    ImGui::End();
+    return;
+  }
+
+  ImGui::Text(
+    "%zu bitmaps, %zu thumbnails cached",
+    mpWad->mBitmaps.size(),
+    mThumbnails.size());
+
+  ImGui::BeginChild("Thumbnails");
+
+  const auto& style = ImGui::GetStyle();
+  const auto thumbnailSize =
+    ImVec2{float(THUMBNAIL_SIZE), float(THUMBNAIL_SIZE)};
+  const auto numColumns = std::max(
+    int(
+      (ImGui::GetContentRegionAvail().x + style.ItemSpacing.x) /
+      (thumbnailSize.x + style.ItemSpacing.x)),
+    1);
+  const auto numBitmaps = int(mpWad->mBitmaps.size());
+  const auto numRows = (numBitmaps + numColumns - 1) / numColumns;
+
+  // Only rows that are actually visible are submitted, and only those
+  // request thumbnails
+  ImGuiListClipper clipper;
+  clipper.Begin(numRows, thumbnailSize.y + style.ItemSpacing.y);
+
+  while (clipper.Step())
+  {
+    for (auto row = clipper.DisplayStart; row < clipper.DisplayEnd; ++row)
+    {
+      const auto rowEnd = std::min((row + 1) * numColumns, numBitmaps);
+
+      for (auto i = row * numColumns; i < rowEnd; ++i)
+      {
+        const auto index = std::size_t(i);
+
+        if (i != row * numColumns)
+        {
+          ImGui::SameLine();
+        }
+
+        if (const auto pThumbnail = mThumbnails.find(index))
+        {
+          ImGui::Image(toImTextureId(*pThumbnail), thumbnailSize);
+        }
+        else
+        {
+          ImGui::Dummy(thumbnailSize);
+          mThumbnails.request(index);
+        }
+
+        if (ImGui::IsItemHovered())
+        {
+          const auto& bitmap = mpWad->mBitmaps[index];
+          ImGui::SetTooltip(
+            "Bitmap %zu\n%ux%u, offset 0x%X",
+            index,
+            unsigned(bitmap.width),
+            unsigned(bitmap.height),
+            unsigned(bitmap.offset));
+        }
+      }
+    }
+  }
+
+  ImGui::EndChild();
+  ImGui::End();
+
+  mThumbnails.submitRequests();
+}
+
+} // namespace saucer
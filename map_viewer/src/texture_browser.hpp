@@ -0,0 +1,67 @@
+/* Copyright (C) 2024, Nikolai Wuttke. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "preview_cache.hpp"
+#include "wad_file.hpp"
+
+#include <rigel/base/image.hpp>
+#include <rigel/opengl/handle.hpp>
+
+#include <memory>
+
+
+namespace saucer
+{
+
+/** Panel showing thumbnails of all bitmaps in a WAD file
+ *
+ * Only thumbnails for the visible part of the list are created. Decoding
+ * and downscaling happens on the shared worker pool, the main thread only
+ * uploads finished thumbnails. The resulting textures are kept in an LRU
+ * cache of bounded size, so scrolling back and forth doesn't redo any work
+ * while GPU memory use stays fixed regardless of the number of bitmaps.
+ */
+class TextureBrowser
+{
+public:
+  TextureBrowser();
+
+  TextureBrowser(const TextureBrowser&) = delete;
+  TextureBrowser& operator=(const TextureBrowser&) = delete;
+
+  /** Switches to another WAD file, or none if nullptr
+   *
+   * Must be called before the currently set WadData is destroyed. Waits for
+   * thumbnails which are currently being decoded.
+   */
+  void setWad(const WadData* pWad);
+
+  void updateAndRender(bool* pIsOpen);
+
+private:
+  using Thumbnail = rigel::opengl::Handle<rigel::opengl::tag::Texture>;
+
+  const WadData* mpWad = nullptr;
+  std::unique_ptr<Palette> mpPalette;
+
+  // Declared last, so that it's destroyed first. Its destructor waits for
+  // thumbnails in progress, which use the WAD and palette.
+  PreviewCache<rigel::base::Image, Thumbnail> mThumbnails;
+};
+
+} // namespace saucer
@@ -0,0 +1,295 @@
+/* Copyright (C) 2024, Nikolai Wuttke. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "texture_compression.hpp"
+
+#include "bake_cache.hpp"
+#include "worker_pool.hpp"
+
+#include <rigel/base/warnings.hpp>
+
+RIGEL_DISABLE_WARNINGS
+#include <glm/glm.hpp>
+RIGEL_RESTORE_WARNINGS
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+
+namespace saucer
+{
+
+namespace
+{
+
+// Bump this whenever the encoder changes, to invalidate previously cached
+// results
+constexpr auto BC1_BAKE_VERSION = std::uint64_t(2);
+
+constexpr auto BLOCK_SIZE = std::size_t(4);
+constexpr auto BYTES_PER_BLOCK = std::size_t(8);
+
+
+std::uint16_t toRgb565(const glm::vec3& color)
+{
+  const auto r = std::uint16_t(std::lround(color.x * 31.0f / 255.0f));
+  const auto g = std::uint16_t(std::lround(color.y * 63.0f / 255.0f));
+  const auto b = std::uint16_t(std::lround(color.z * 31.0f / 255.0f));
+  return std::uint16_t((r << 11) | (g << 5) | b);
+}
+
+
+glm::vec3 fromRgb565(const std::uint16_t value)
+{
+  const auto r = (value >> 11) & 0x1F;
+  const auto g = (value >> 5) & 0x3F;
+  const auto b = value & 0x1F;
+
+  return glm::vec3(
+    float((r << 3) | (r >> 2)),
+    float((g << 2) | (g >> 4)),
+    float((b << 3) | (b >> 2)));
+}
+
+
+/** Direction of largest variance among the given colors */
+glm::vec3 principalAxis(const glm::vec3* pColors, const std::size_t count)
+{
+  auto mean = glm::vec3(0.0f);
+
+  for (auto i = std::size_t(0); i < count; ++i)
+  {
+    mean += pColors[i];
+  }
+
+  mean /= float(count);
+
+  auto covariance = glm::mat3(0.0f);
+
+  for (auto i = std::size_t(0); i < count; ++i)
+  {
+    const auto& color = pColors[i];
+    const auto d = color - mean;
+    covariance += glm::outerProduct(d, d);
+  }
+
+  // Power iteration converges quickly for the 3x3 case
+  auto axis = glm::vec3(1.0f, 1.0f, 1.0f);
+
+  for (auto i = 0; i < 8; ++i)
+  {
+    const auto next = covariance * axis;
+    const auto length = glm::length(next);
+
+    if (length < 1e-6f)
+    {
+      break;
+    }
+
+    axis = next / length;
+  }
+
+  return glm::normalize(axis);
+}
+
+
+/** Encodes one block of 4x4 texels
+ *
+ * Without alphaTested, transparent texels are encoded by their color like
+ * all others, since that's what they show when drawn without alpha testing.
+ */
+void encodeBlock(
+  const std::array<rigel::base::Color, 16>& texels,
+  const bool alphaTested,
+  std::uint8_t* pOutput)
+{
+  auto isOpaque = [&](const rigel::base::Color& texel) {
+    return !alphaTested || texel.a >= 128;
+  };
+
+  std::array<glm::vec3, 16> opaqueColors;
+  auto numOpaque = std::size_t(0);
+
+  for (const auto& texel : texels)
+  {
+    if (isOpaque(texel))
+    {
+      opaqueColors[numOpaque++] = glm::vec3(texel.r, texel.g, texel.b);
+    }
+  }
+
+  const auto hasTransparency = numOpaque < texels.size();
+
+  // Endpoints are the extremes of the colors projected onto their principal
+  // axis. For blocks with up to two distinct colors, as is common for
+  // palette textures, these are exactly the colors themselves.
+  auto endpoints = std::array<std::uint16_t, 2>{0, 0};
+
+  if (numOpaque > 0)
+  {
+    const auto axis = principalAxis(opaqueColors.data(), numOpaque);
+    const auto iEnd = opaqueColors.begin() + numOpaque;
+    auto iMin = opaqueColors.begin();
+    auto iMax = opaqueColors.begin();
+
+    for (auto it = opaqueColors.begin(); it != iEnd; ++it)
+    {
+      if (glm::dot(*it, axis) < glm::dot(*iMin, axis))
+      {
+        iMin = it;
+      }
+
+      if (glm::dot(*it, axis) > glm::dot(*iMax, axis))
+      {
+        iMax = it;
+      }
+    }
+
+    endpoints = {toRgb565(*iMax), toRgb565(*iMin)};
+  }
+
+  // The order of the endpoints selects the mode: 4 colors if the first one
+  // is larger, otherwise 3 colors plus transparent
+  if (hasTransparency == (endpoints[0] > endpoints[1]))
+  {
+    std::swap(endpoints[0], endpoints[1]);
+  }
+
+  const auto c0 = fromRgb565(endpoints[0]);
+  const auto c1 = fromRgb565(endpoints[1]);
+  const auto isFourColorMode = endpoints[0] > endpoints[1];
+
+  const auto palette = isFourColorMode
+    ? std::array<glm::vec3, 4>{
+        c0, c1, (c0 * 2.0f + c1) / 3.0f, (c0 + c1 * 2.0f) / 3.0f}
+    : std::array<glm::vec3, 4>{c0, c1, (c0 + c1) * 0.5f, glm::vec3(0.0f)};
+  const auto numOpaqueEntries = isFourColorMode ? 4u : 3u;
+
+  auto indices = std::uint32_t(0);
+
+  for (auto i = 0u; i < texels.size(); ++i)
+  {
+    const auto& texel = texels[i];
+    auto bestIndex = 3u;
+
+    if (isOpaque(texel))
+    {
+      const auto color = glm::vec3(texel.r, texel.g, texel.b);
+      auto bestError = std::numeric_limits<float>::max();
+
+      for (auto entry = 0u; entry < numOpaqueEntries; ++entry)
+      {
+        const auto d = color - palette[entry];
+        const auto error = glm::dot(d, d);
+
+        if (error < bestError)
+        {
+          bestError = error;
+          bestIndex = entry;
+        }
+      }
+    }
+
+    indices |= bestIndex << (i * 2);
+  }
+
+  pOutput[0] = std::uint8_t(endpoints[0]);
+  pOutput[1] = std::uint8_t(endpoints[0] >> 8);
+  pOutput[2] = std::uint8_t(endpoints[1]);
+  pOutput[3] = std::uint8_t(endpoints[1] >> 8);
+
+  for (auto i = 0; i < 4; ++i)
+  {
+    pOutput[4 + i] = std::uint8_t(indices >> (i * 8));
+  }
+}
+
+} // namespace
+
+
+std::vector<std::uint8_t> compressBc1(
+  const rigel::base::Image& image,
+  const std::vector<bool>& alphaTestedPages,
+  const bool useCache)
+{
+  const auto width = image.width();
+  const auto height = image.height();
+  const auto& pixels = image.pixelData();
+
+  const auto sizeInfo = std::array<std::uint64_t, 2>{width, height};
+  const auto pageFlags =
+    std::vector<std::uint8_t>(alphaTestedPages.begin(), alphaTestedPages.end());
+
+  auto cacheKey = hashBytes(
+    &BC1_BAKE_VERSION, sizeof(BC1_BAKE_VERSION), INITIAL_BAKE_HASH);
+  cacheKey = hashBytes(sizeInfo.data(), sizeof(sizeInfo), cacheKey);
+  cacheKey = hashBytes(pageFlags.data(), pageFlags.size(), cacheKey);
+  cacheKey = hashBytes(
+    pixels.data(), pixels.size() * sizeof(rigel::base::Color), cacheKey);
+
+  const auto numBlocksX = width / BLOCK_SIZE;
+  const auto numBlockRows = height / BLOCK_SIZE;
+
+  std::vector<std::uint8_t> result(
+    numBlocksX * numBlockRows * BYTES_PER_BLOCK);
+
+  if (const auto oCached =
+        useCache ? loadBakedData("bc1", cacheKey) : std::nullopt;
+      oCached && oCached->size() == result.size())
+  {
+    return *oCached;
+  }
+
+
+  auto isAlphaTested = [&](const std::size_t blockX) {
+    const auto page = height > 0 ? blockX * BLOCK_SIZE / height : 0;
+    return page < alphaTestedPages.size() && alphaTestedPages[page];
+  };
+
+  parallelFor(numBlockRows, [&](const std::size_t row) {
+    for (auto blockX = std::size_t(0); blockX < numBlocksX; ++blockX)
+    {
+      std::array<rigel::base::Color, 16> texels;
+
+      for (auto y = std::size_t(0); y < BLOCK_SIZE; ++y)
+      {
+        const auto* pSource = pixels.data() +
+          (row * BLOCK_SIZE + y) * width + blockX * BLOCK_SIZE;
+        std::copy(pSource, pSource + BLOCK_SIZE, &texels[y * BLOCK_SIZE]);
+      }
+
+      encodeBlock(
+        texels,
+        isAlphaTested(blockX),
+        result.data() + (row * numBlocksX + blockX) * BYTES_PER_BLOCK);
+    }
+  });
+
+
+  if (useCache)
+  {
+    storeBakedData("bc1", cacheKey, result);
+  }
+
+  return result;
+}
+
+} // namespace saucer
@@ -0,0 +1,46 @@
+/* Copyright (C) 2024, Nikolai Wuttke. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <rigel/base/image.hpp>
+
+#include <cstdint>
+#include <vector>
+
+
+namespace saucer
+{
+
+/** Encodes the given image in the BC1 (DXT1) block compression format
+ *
+ * The image is a horizontal strip of square pages, as in texture atlases.
+ * Blocks on pages flagged in alphaTestedPages use BC1's 1-bit alpha mode if
+ * they contain transparent texels, which matches the binary alpha of
+ * palette-based textures. On all other pages, transparent texels keep their
+ * color, since these are drawn without alpha testing.
+ *
+ * Width and height must be multiples of 4. Blocks are encoded in parallel,
+ * see parallelFor(). Unless useCache is false, results are cached on disk,
+ * keyed by the inputs.
+ */
+std::vector<std::uint8_t> compressBc1(
+  const rigel::base::Image& image,
+  const std::vector<bool>& alphaTestedPages,
+  bool useCache);
+
+} // namespace saucer
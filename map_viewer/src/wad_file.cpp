@@ -16,11 +16,15 @@
 
 #include "wad_file.hpp"
 
+#include "bake_cache.hpp"
+#include "file_format_records.hpp"
+
 #include <rigel/base/binary_io.hpp>
-#include <rigel/base/byte_buffer.hpp>
 
+#include <algorithm>
+#include <cstring>
 #include <fstream>
-#include <numeric>
+#include <unordered_map>
 
 
 namespace saucer
@@ -29,13 +33,49 @@ namespace saucer
 namespace
 {
 
-struct LanguageHeader
+std::vector<uint32_t> findCanonicalBitmaps(const WadData& wad)
 {
-  std::uint16_t unknown;
-  std::uint16_t numEntries;
-  std::uint32_t dataStart;
-  std::uint32_t dataEnd;
-};
+  constexpr auto PAGE_SIZE_BYTES =
+    std::size_t(TEXTURE_PAGE_SIZE * TEXTURE_PAGE_SIZE);
+
+  std::vector<uint32_t> result(wad.mBitmaps.size());
+  std::unordered_multimap<std::uint64_t, uint32_t> pagesByHash;
+
+  auto pageData = [&](const uint32_t index) {
+    return wad.mPackedData.data() + wad.mBitmaps[index].offset;
+  };
+
+  for (auto i = uint32_t(0); i < wad.mBitmaps.size(); ++i)
+  {
+    result[i] = i;
+
+    const auto offset = std::size_t(wad.mBitmaps[i].offset);
+
+    if (offset + PAGE_SIZE_BYTES > wad.mPackedData.size())
+    {
+      continue;
+    }
+
+    const auto hash =
+      hashBytes(pageData(i), PAGE_SIZE_BYTES, INITIAL_BAKE_HASH);
+    const auto [iFirst, iLast] = pagesByHash.equal_range(hash);
+    const auto iMatch = std::find_if(iFirst, iLast, [&](const auto& entry) {
+      const auto pOther = pageData(entry.second);
+      return std::memcmp(pageData(i), pOther, PAGE_SIZE_BYTES) == 0;
+    });
+
+    if (iMatch != iLast)
+    {
+      result[i] = iMatch->second;
+    }
+    else
+    {
+      pagesByHash.emplace(hash, i);
+    }
+  }
+
+  return result;
+}
 
 } // namespace
 
@@ -152,17 +192,13 @@ std::optional<WadData> loadWadFile(const std::filesystem::path& path)
 
   // Skip language data
   {
-    std::array<LanguageHeader, 7> languageHeaders;
+    auto totalEntries = uint32_t(0);
 
-    readArray(f, languageHeaders.data(), 7);
-
-    const auto totalEntries = std::accumulate(
-      languageHeaders.begin(),
-      languageHeaders.end(),
-      uint32_t(0),
-      [](uint32_t sum, const LanguageHeader& header) {
-        return sum + header.numEntries;
-      });
+    for (auto i = 0; i < 7; ++i)
+    {
+      const auto header = readRecord<LanguageHeaderRecord>(f);
+      totalEntries += header.get<LanguageHeaderRecord::Count>();
+    }
 
     skipBytes(f, totalEntries * sizeof(uint16_t));
   }
@@ -178,12 +214,12 @@ std::optional<WadData> loadWadFile(const std::filesystem::path& path)
 
     for (auto i = 0u; i < numBitmaps; ++i)
     {
-      const auto offset = read<uint32_t>(f);
-      skipBytes(f, sizeof(uint32_t));
-      const auto width = read<uint16_t>(f);
-      const auto height = read<uint16_t>(f);
+      const auto record = readRecord<BitmapRecord>(f);
 
-      wad.mBitmaps.push_back({offset, width, height});
+      wad.mBitmaps.push_back(
+        {record.get<BitmapRecord::Offset>(),
+         record.get<BitmapRecord::Width>(),
+         record.get<BitmapRecord::Height>()});
     }
   }
 
@@ -224,17 +260,32 @@ std::optional<WadData> loadWadFile(const std::filesystem::path& path)
 
     for (auto i = 0u; i < numModels; ++i)
     {
-      const auto offsetData = read<uint32_t>(f);
-      skipBytes(f, 8);
-      const auto offsetParams = read<uint32_t>(f);
-      skipBytes(f, 20);
+      const auto record = readRecord<ModelTableRecord>(f);
 
-      wad.mModels[modelNames[i]] = ModelInfo{offsetData, offsetParams};
+      wad.mModels[modelNames[i]] = ModelInfo{
+        record.get<ModelTableRecord::DataOffset>(),
+        record.get<ModelTableRecord::ParamsOffset>()};
     }
   }
 
-  // Sound info table
-  skipRecords(16 + 116);
+  {
+    const auto numSounds = read<uint32_t>(f);
+    wad.mSounds.resize(numSounds);
+
+    for (auto& sound : wad.mSounds)
+    {
+      sound.name = readString(f, 16);
+    }
+
+    for (auto& sound : wad.mSounds)
+    {
+      const auto record = readRecord<SoundEffectRecord>(f);
+
+      sound.offsetFormat = record.get<SoundEffectRecord::FormatOffset>();
+      sound.offsetData = record.get<SoundEffectRecord::DataOffset>();
+      sound.size = record.get<SoundEffectRecord::Size>();
+    }
+  }
 
   // Palette info table
   skipBytes(f, 5 * sizeof(int32_t));
@@ -253,6 +304,8 @@ std::optional<WadData> loadWadFile(const std::filesystem::path& path)
   wad.mPackedData.resize(packedDataSize);
   readArray(f, wad.mPackedData.data(), packedDataSize);
 
+  wad.mCanonicalBitmaps = findCanonicalBitmaps(wad);
+
   return wad;
 }
 
@@ -264,15 +317,14 @@ ModelData WadData::loadModel(const std::string& name) const
   const auto& entry = mModels.at(name);
 
   {
-    const auto iData = mPackedData.begin() + entry.offsetData;
+    using Data = ModelDataRecord;
 
-    auto headerReader = rigel::base::LeStreamReader(iData, iData + 80);
-    headerReader.skipBytes(40);
+    const auto header = recordAt<Data>(mPackedData, entry.offsetData);
 
-    const auto numVertices = headerReader.readU32();
-    const auto vertexListStart = headerReader.readU32();
-    const auto numFaces = headerReader.readU32();
-    const auto faceListStart = headerReader.readU32();
+    const auto numVertices = header.get<Data::NumVertices>();
+    const auto vertexListStart = header.get<Data::VertexListOffset>();
+    const auto numFaces = header.get<Data::NumFaces>();
+    const auto faceListStart = header.get<Data::FaceListOffset>();
 
     model.vertices = rigel::base::ArrayView<ModelVertex>(
       reinterpret_cast<const ModelVertex*>(
@@ -281,43 +333,69 @@ ModelData WadData::loadModel(const std::string& name) const
 
     model.faces.reserve(numFaces);
 
-    const auto iFacesData = mPackedData.begin() + faceListStart;
-    auto facesReader =
-      rigel::base::LeStreamReader(iFacesData, iFacesData + numFaces * 32);
-
     for (auto i = 0u; i < numFaces; ++i)
     {
-      ModelFace face;
-      face.mTexture = facesReader.readU32();
-
-      for (auto& index : face.mIndices)
-      {
-        index = facesReader.readU16();
-      }
+      using Face = ModelFaceRecord;
 
-      const auto type = facesReader.readU16();
+      const auto record = recordAt<Face>(
+        mPackedData, faceListStart + i * Face::Layout::SIZE);
 
-      face.mType =
-        type == 0x8000 ? ModelFace::Type::Quad : ModelFace::Type::Triangle;
-
-      facesReader.skipBytes(18);
+      ModelFace face;
+      face.mTexture = record.get<Face::Texture>();
+      face.mIndices = record.get<Face::Indices>();
+      face.mType = record.get<Face::Type>() == 0x8000
+        ? ModelFace::Type::Quad
+        : ModelFace::Type::Triangle;
 
       model.faces.push_back(face);
     }
   }
 
   {
-    const auto iData = mPackedData.begin() + entry.offsetParams;
+    const auto params =
+      recordAt<ModelParamsRecord>(mPackedData, entry.offsetParams);
 
-    auto reader = rigel::base::LeStreamReader(iData, iData + 60);
-
-    for (auto& entry : model.transformationMatrix)
-    {
-      entry = reader.readS16();
-    }
+    model.transformationMatrix =
+      params.get<ModelParamsRecord::TransformationMatrix>();
   }
 
   return model;
 }
 
+
+std::optional<SoundData> WadData::soundData(const std::size_t index) const
+{
+  using Format = WaveFormatRecord;
+
+  constexpr auto WAVE_FORMAT_PCM = 1;
+
+  const auto& sound = mSounds.at(index);
+
+  if (
+    sound.offsetFormat > mPackedData.size() ||
+    mPackedData.size() - sound.offsetFormat < Format::Layout::SIZE ||
+    sound.offsetData > mPackedData.size() ||
+    mPackedData.size() - sound.offsetData < sound.size)
+  {
+    return {};
+  }
+
+  const auto format = recordAt<Format>(mPackedData, sound.offsetFormat);
+  const auto bitsPerSample = format.get<Format::BitsPerSample>();
+
+  if (
+    format.get<Format::FormatTag>() != WAVE_FORMAT_PCM ||
+    (bitsPerSample != 8 && bitsPerSample != 16))
+  {
+    return {};
+  }
+
+  return SoundData{
+    format.get<Format::SamplesPerSecond>(),
+    format.get<Format::NumChannels>(),
+    bitsPerSample,
+    rigel::base::ArrayView<uint8_t>(
+      mPackedData.data() + sound.offsetData, sound.size)};
+}
+
 } // namespace saucer
@@ -22,9 +22,11 @@
 #include <rigel/base/image.hpp>
 
 #include <array>
+#include <cstddef>
 #include <cstdint>
 #include <filesystem>
 #include <optional>
+#include <string>
 #include <unordered_map>
 #include <vector>
 
@@ -47,6 +49,30 @@ struct ModelInfo
 };
 
 
+/** Location of a sound effect within the packed data block */
+struct SoundInfo
+{
+  std::string name;
+  uint32_t offsetFormat;
+  uint32_t offsetData;
+  uint32_t size;
+};
+
+
+/** PCM audio data of a sound effect
+ *
+ * The samples are a view into the WAD's packed data block, which needs to
+ * outlive the sound.
+ */
+struct SoundData
+{
+  uint32_t sampleRate;
+  uint16_t numChannels;
+  uint16_t bitsPerSample;
+  rigel::base::ArrayView<uint8_t> samples;
+};
+
+
 struct ModelVertex
 {
   int16_t x;
@@ -96,12 +122,34 @@ struct WadData
   std::vector<TextureDef> mTextureDefs;
   std::unordered_map<std::string, uint32_t> mTexturePages;
   std::unordered_map<std::string, ModelInfo> mModels;
+  std::vector<SoundInfo> mSounds;
   std::vector<uint8_t> mPackedData;
 
+  // For each bitmap, the index of the first bitmap with identical pixel data
+  std::vector<uint32_t> mCanonicalBitmaps;
+
   std::unique_ptr<Palette> loadPalette() const;
   rigel::base::Color lookupColorIndex(uint8_t index) const;
   rigel::base::Image buildTextureAtlas(rigel::base::ArrayView<int> pages) const;
+
+  /** Returns the index of the first bitmap with the same contents
+   *
+   * Texture atlases only need to contain canonical bitmaps, since
+   * duplicates can use the same pixel data.
+   */
+  uint32_t canonicalBitmap(uint32_t index) const
+  {
+    return index < mCanonicalBitmaps.size() ? mCanonicalBitmaps[index] : index;
+  }
+
   ModelData loadModel(const std::string& name) const;
+
+  /** Returns the given sound's audio data, without copying it
+   *
+   * Returns an empty optional if the sound is not in PCM format, or its
+   * location is outside of the packed data block.
+   */
+  std::optional<SoundData> soundData(std::size_t index) const;
 };
 
 
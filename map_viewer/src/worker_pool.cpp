@@ -0,0 +1,205 @@
+/* Copyright (C) 2024, Nikolai Wuttke. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "worker_pool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+
+namespace saucer
+{
+
+namespace
+{
+
+struct Job
+{
+  Job(std::function<void(std::size_t)> body, const std::size_t count)
+    : mBody(std::move(body))
+    , mCount(count)
+  {
+  }
+
+  const std::function<void(std::size_t)> mBody;
+  const std::size_t mCount;
+  std::atomic<std::size_t> mNextIndex{0};
+  std::atomic<std::size_t> mNumFinished{0};
+};
+
+
+class WorkerPool
+{
+public:
+  WorkerPool()
+  {
+    // The threads calling parallelFor() make up for the missing core
+    const auto numWorkers =
+      std::max(std::thread::hardware_concurrency(), 2u) - 1;
+
+    for (auto i = 0u; i < numWorkers; ++i)
+    {
+      mWorkers.emplace_back([this]() { runWorker(); });
+    }
+  }
+
+  ~WorkerPool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mQuit = true;
+    }
+
+    mJobAdded.notify_all();
+
+    for (auto& worker : mWorkers)
+    {
+      worker.join();
+    }
+  }
+
+  void run(
+    const std::size_t count,
+    const std::function<void(std::size_t)>& body)
+  {
+    // Only references are copied into the job, since body's captures are
+    // typically by reference
+    auto pJob = std::make_shared<Job>(
+      [&body](const std::size_t index) { body(index); }, count);
+    addJob(pJob);
+
+    processIndices(*pJob);
+
+    std::unique_lock<std::mutex> lock(mMutex);
+    mJobFinished.wait(
+      lock, [&]() { return pJob->mNumFinished == pJob->mCount; });
+    removeJob(pJob);
+  }
+
+  void runAsync(std::function<void()> task)
+  {
+    addJob(std::make_shared<Job>(
+      [task = std::move(task)](std::size_t) { task(); }, 1));
+  }
+
+private:
+  void addJob(std::shared_ptr<Job> pJob)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mJobs.push_back(std::move(pJob));
+    }
+
+    mJobAdded.notify_all();
+  }
+
+  void runWorker()
+  {
+    std::unique_lock<std::mutex> lock(mMutex);
+
+    for (;;)
+    {
+      mJobAdded.wait(lock, [this]() { return mQuit || !mJobs.empty(); });
+
+      if (mQuit)
+      {
+        return;
+      }
+
+      // Jobs are worked on in the order they were added. Once all indices
+      // of a job are taken, it's removed, so that workers move on to the
+      // next one while the remaining indices are still being processed.
+      const auto pJob = mJobs.front();
+      lock.unlock();
+
+      processIndices(*pJob);
+
+      lock.lock();
+      removeJob(pJob);
+    }
+  }
+
+  void processIndices(Job& job)
+  {
+    for (;;)
+    {
+      const auto index = job.mNextIndex.fetch_add(1);
+
+      if (index >= job.mCount)
+      {
+        return;
+      }
+
+      job.mBody(index);
+
+      if (job.mNumFinished.fetch_add(1) + 1 == job.mCount)
+      {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mJobFinished.notify_all();
+      }
+    }
+  }
+
+  // Must be called with the mutex locked
+  void removeJob(const std::shared_ptr<Job>& pJob)
+  {
+    mJobs.erase(std::remove(mJobs.begin(), mJobs.end(), pJob), mJobs.end());
+  }
+
+  std::mutex mMutex;
+  std::condition_variable mJobAdded;
+  std::condition_variable mJobFinished;
+  std::deque<std::shared_ptr<Job>> mJobs;
+  std::vector<std::thread> mWorkers;
+  bool mQuit = false;
+};
+
+WorkerPool& pool()
+{
+  static WorkerPool instance;
+  return instance;
+}
+
+} // namespace
+
+
+void parallelFor(
+  const std::size_t count,
+  const std::function<void(std::size_t)>& body)
+{
+  if (count == 0)
+  {
+    return;
+  }
+
+  pool().run(count, body);
+}
+
+
+void runAsync(std::function<void()> task)
+{
+  pool().runAsync(std::move(task));
+}
+
+} // namespace saucer
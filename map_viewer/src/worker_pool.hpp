@@ -0,0 +1,48 @@
+/* Copyright (C) 2024, Nikolai Wuttke. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+
+namespace saucer
+{
+
+/** Calls body for every index in [0, count), spread over multiple threads
+ *
+ * All calls share a single pool of worker threads, sized to the number of
+ * CPU cores. Concurrent callers, like levels being built in parallel, thus
+ * split the cores between them instead of each starting a full set of
+ * threads. The calling thread processes indices as well, and the function
+ * returns once all of them are done.
+ */
+void parallelFor(
+  std::size_t count,
+  const std::function<void(std::size_t)>& body);
+
+/** Runs the task on the pool used by parallelFor(), without waiting for it
+ *
+ * Tasks queue up behind parallelFor() work that was started earlier. The
+ * caller must make sure that anything the task accesses stays alive until
+ * it has finished. Tasks which haven't started by the time the program
+ * exits are dropped.
+ */
+void runAsync(std::function<void()> task);
+
+} // namespace saucer
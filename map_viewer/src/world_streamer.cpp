@@ -0,0 +1,252 @@
+/* Copyright (C) 2024, Nikolai Wuttke. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "world_streamer.hpp"
+
+#include "map_file.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+
+namespace saucer
+{
+
+namespace
+{
+
+// Distance between the centers of neighboring levels
+constexpr auto GRID_SPACING = float(MAP_SIZE + 16);
+
+// Resident levels are only dropped once they are this much farther away than
+// the view distance, so that moving back and forth along the edge doesn't
+// cause constant reloading.
+constexpr auto UNLOAD_HYSTERESIS = 16.0f;
+
+// Bakes during level building already share a worker pool using all CPU
+// cores, more parallel loads would only add to peak memory usage.
+constexpr auto MAX_CONCURRENT_LOADS = std::size_t(2);
+
+} // namespace
+
+
+WorldStreamer::WorldStreamer(
+  MapRenderer& renderer,
+  const std::vector<std::filesystem::path>& mapFiles,
+  const std::size_t memoryBudget,
+  const LevelBuildOptions& buildOptions)
+  : mMemoryBudget(memoryBudget)
+  , mRenderer(renderer)
+  , mBuildOptions(buildOptions)
+{
+  mBuildOptions.mCompressTextures &= renderer.supportsTextureCompression();
+
+  const auto numColumns =
+    std::max(int(std::ceil(std::sqrt(double(mapFiles.size())))), 1);
+
+  for (auto i = 0; i < int(mapFiles.size()); ++i)
+  {
+    auto& level = mLevels.emplace_back();
+    level.mMapFile = mapFiles[i];
+    level.mOffset = glm::vec3(
+      float(i % numColumns) * GRID_SPACING,
+      0.0f,
+      float(i / numColumns) * GRID_SPACING);
+  }
+}
+
+
+void WorldStreamer::update()
+{
+  finishPendingLoads();
+
+  std::vector<StreamedLevel*> levelsByDistance;
+  levelsByDistance.reserve(mLevels.size());
+
+  for (auto& level : mLevels)
+  {
+    levelsByDistance.push_back(&level);
+  }
+
+  std::sort(
+    levelsByDistance.begin(),
+    levelsByDistance.end(),
+    [&](const StreamedLevel* pLhs, const StreamedLevel* pRhs) {
+      return distanceToCamera(*pLhs) < distanceToCamera(*pRhs);
+    });
+
+  const auto averageUsage = averageMemoryUsage();
+  auto plannedUsage = std::size_t(0);
+  auto numLoading = numLoadingLevels();
+
+  for (const auto pLevel : levelsByDistance)
+  {
+    auto& level = *pLevel;
+
+    const auto maxDistance = level.moLevelId
+      ? MAX_VIEW_DISTANCE + UNLOAD_HYSTERESIS
+      : MAX_VIEW_DISTANCE;
+    const auto expectedUsage =
+      level.mMemoryUsage != 0 ? level.mMemoryUsage : averageUsage;
+
+    const auto shouldBeResident = !level.mFailedToLoad &&
+      distanceToCamera(level) <= maxDistance &&
+      plannedUsage + expectedUsage <= mMemoryBudget;
+
+    if (shouldBeResident)
+    {
+      plannedUsage += expectedUsage;
+
+      if (
+        !level.moLevelId && !level.mPendingData.valid() &&
+        numLoading < MAX_CONCURRENT_LOADS)
+      {
+        level.mPendingData = std::async(
+          std::launch::async,
+          loadLevelData,
+          level.mMapFile,
+          mBuildOptions);
+        ++numLoading;
+      }
+    }
+    else if (level.moLevelId)
+    {
+      mRenderer.removeLevel(*level.moLevelId);
+      level.moLevelId.reset();
+    }
+  }
+}
+
+
+std::size_t WorldStreamer::numResidentLevels() const
+{
+  return std::count_if(
+    mLevels.begin(), mLevels.end(), [](const StreamedLevel& level) {
+      return level.moLevelId.has_value();
+    });
+}
+
+
+std::size_t WorldStreamer::numLoadingLevels() const
+{
+  return std::count_if(
+    mLevels.begin(), mLevels.end(), [](const StreamedLevel& level) {
+      return level.mPendingData.valid();
+    });
+}
+
+
+std::vector<NamedLevelStatistics>
+  WorldStreamer::residentLevelStatistics() const
+{
+  std::vector<NamedLevelStatistics> statistics;
+
+  for (const auto& level : mLevels)
+  {
+    if (!level.moLevelId)
+    {
+      continue;
+    }
+
+    if (const auto pStatistics = mRenderer.levelStatistics(*level.moLevelId))
+    {
+      statistics.push_back({level.mMapFile.stem().u8string(), pStatistics});
+    }
+  }
+
+  return statistics;
+}
+
+
+std::size_t WorldStreamer::memoryUsage() const
+{
+  auto usage = std::size_t(0);
+
+  for (const auto& level : mLevels)
+  {
+    if (level.moLevelId)
+    {
+      usage += level.mMemoryUsage;
+    }
+  }
+
+  return usage;
+}
+
+
+void WorldStreamer::finishPendingLoads()
+{
+  for (auto& level : mLevels)
+  {
+    if (
+      !level.mPendingData.valid() ||
+      level.mPendingData.wait_for(std::chrono::seconds(0)) !=
+        std::future_status::ready)
+    {
+      continue;
+    }
+
+    auto oData = level.mPendingData.get();
+
+    if (!oData)
+    {
+      level.mFailedToLoad = true;
+      continue;
+    }
+
+    // The camera might have moved away in the meantime. In that case, the
+    // level is removed again by the following residency check.
+    level.mMemoryUsage = oData->estimatedMemoryUsage();
+    level.moLevelId = mRenderer.addLevel(std::move(*oData), level.mOffset);
+  }
+}
+
+
+float WorldStreamer::distanceToCamera(const StreamedLevel& level) const
+{
+  // Distance to the level's square on the ground plane, zero when the camera
+  // is above the level
+  const auto& cameraPosition = mRenderer.cameraPosition();
+  const auto halfSize = float(MAP_SIZE) / 2.0f;
+
+  const auto dx =
+    std::max(std::abs(cameraPosition.x - level.mOffset.x) - halfSize, 0.0f);
+  const auto dz =
+    std::max(std::abs(cameraPosition.z - level.mOffset.z) - halfSize, 0.0f);
+
+  return std::sqrt(dx * dx + dz * dz);
+}
+
+
+std::size_t WorldStreamer::averageMemoryUsage() const
+{
+  auto total = std::size_t(0);
+  auto count = std::size_t(0);
+
+  for (const auto& level : mLevels)
+  {
+    if (level.mMemoryUsage != 0)
+    {
+      total += level.mMemoryUsage;
+      ++count;
+    }
+  }
+
+  return count != 0 ? total / count : 0;
+}
+
+} // namespace saucer
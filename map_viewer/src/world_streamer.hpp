@@ -0,0 +1,91 @@
+/* Copyright (C) 2024, Nikolai Wuttke. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "map_renderer.hpp"
+
+#include <rigel/base/warnings.hpp>
+
+RIGEL_DISABLE_WARNINGS
+#include <glm/vec3.hpp>
+RIGEL_RESTORE_WARNINGS
+
+#include <cstddef>
+#include <filesystem>
+#include <future>
+#include <optional>
+#include <vector>
+
+
+namespace saucer
+{
+
+/** Shows a set of levels side by side in a single scene
+ *
+ * Levels are laid out on a grid, and streamed in and out of the renderer
+ * depending on their distance to the camera. Level data is built on
+ * background threads, only the upload happens in update().
+ *
+ * The estimated memory usage of all resident levels is kept within the
+ * budget, with levels closer to the camera taking precedence. Until a level
+ * has been loaded once, its size is assumed to be the average of the levels
+ * loaded so far.
+ *
+ * Destruction waits for loads that are still in progress.
+ */
+class WorldStreamer
+{
+public:
+  WorldStreamer(
+    MapRenderer& renderer,
+    const std::vector<std::filesystem::path>& mapFiles,
+    std::size_t memoryBudget,
+    const LevelBuildOptions& buildOptions = {});
+
+  void update();
+
+  std::size_t numLevels() const { return mLevels.size(); }
+  std::size_t numResidentLevels() const;
+  std::size_t numLoadingLevels() const;
+  std::size_t memoryUsage() const;
+
+  /** Statistics of all resident levels, named after their map files */
+  std::vector<NamedLevelStatistics> residentLevelStatistics() const;
+
+  std::size_t mMemoryBudget;
+
+private:
+  struct StreamedLevel
+  {
+    std::filesystem::path mMapFile;
+    glm::vec3 mOffset;
+    std::future<std::optional<LevelData>> mPendingData;
+    std::optional<LevelId> moLevelId;
+    std::size_t mMemoryUsage = 0;
+    bool mFailedToLoad = false;
+  };
+
+  void finishPendingLoads();
+  float distanceToCamera(const StreamedLevel& level) const;
+  std::size_t averageMemoryUsage() const;
+
+  MapRenderer& mRenderer;
+  std::vector<StreamedLevel> mLevels;
+  LevelBuildOptions mBuildOptions;
+};
+
+} // namespace saucer